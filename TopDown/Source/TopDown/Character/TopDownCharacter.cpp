@@ -13,7 +13,11 @@
 #include "Kismet/GameplayStatics.h"
 #include "Kismet/KismetMathLibrary.h"
 #include "Math/UnrealMathUtility.h"
+#include "../TopDown.h"
+#include "../FuncLibrary/TopDownAllocCounter.h"
 #include "../Game/TopDownGameInstance.h"
+#include "../Subsystem/DebrisSubsystem.h"
+#include "../Subsystem/RadialDamageSubsystem.h"
 
 ATopDownCharacter::ATopDownCharacter()
 {
@@ -53,9 +57,22 @@ void ATopDownCharacter::BeginPlay()
 {
 	Super::BeginPlay();
 
+	//explosions find the character through the grid of URadialDamageSubsystem
+	if (URadialDamageSubsystem* RadialDamage = GetWorld()->GetSubsystem<URadialDamageSubsystem>())
+		RadialDamage->RegisterDamageable(this);
+
 	InitWeapon(InitWeaponName);
 }
 
+void ATopDownCharacter::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	//the weapon belongs to the character, a level teardown destroys it by itself
+	if (EndPlayReason == EEndPlayReason::Destroyed)
+		DestroyCurrentWeapon();
+
+	Super::EndPlay(EndPlayReason);
+}
+
 void ATopDownCharacter::Tick(float DeltaSeconds)
 {
     Super::Tick(DeltaSeconds);
@@ -97,7 +114,7 @@ void ATopDownCharacter::OnSprintKeyReleased()
 
 void ATopDownCharacter::OnRightMouseButtonKeyPressed()
 {
-	UE_LOG(LogTemp, Warning, TEXT("OnRightMouseButtonKeyPressed"));
+	UE_LOG(LogTopDownVerbose, Verbose, TEXT("ATopDownCharacter::OnRightMouseButtonKeyPressed"));
 
 	AttackCharEvent(true);
 }
@@ -131,6 +148,8 @@ void ATopDownCharacter::AttackCharEvent(bool bIsFiring)
 		//ToDo Check melee or range
 		myWeapon->SetWeaponStateFire(bIsFiring);
 	}
+	else if (bWeaponLoading)
+		UE_LOG(LogTopDownVerbose, Verbose, TEXT("ATopDownCharacter::AttackCharEvent - weapon assets are still loading"));
 	else
 		UE_LOG(LogTemp, Warning, TEXT("ATPSCharacter::AttackCharEvent - CurrentWeapon -NULL"));
 }
@@ -142,12 +161,16 @@ AWeaponDefault* ATopDownCharacter::GetCurrentWeapon()
 
 void ATopDownCharacter::MovementTick(float DeltaTime)
 {
+	TOPDOWN_SCOPE(CharacterMovementTick);
+	TOPDOWN_ALLOC_SCOPE(MovementTick);
+
 	AddMovementInput(FVector(1.0f, 0.0f, 0.0f), AxisY);
 	AddMovementInput(FVector(0.0f, 1.0f, 0.0f), AxisX);
 	
 	APlayerController* myController = UGameplayStatics::GetPlayerController(GetWorld(), 0);
 
-	if (myController)
+	//only the possessed character follows the cursor, unpossessed ones (combat benchmark) keep their own aim
+	if (myController && GetController() == myController)
 	{
 		FHitResult ResultHit;
 		myController->GetHitResultUnderCursorByChannel(ETraceTypeQuery::TraceTypeQuery6, false, ResultHit);
@@ -289,51 +312,97 @@ void ATopDownCharacter::CameraAimOffset(APlayerController* myController)
 
 void ATopDownCharacter::InitWeapon(FName IdWeaponName)
 {
+	//the last call wins, loads requested before are ignored when they finish
+	WeaponLoadRequest++;
+	bWeaponLoading = false;
+
 	UTopDownGameInstance* myGI = Cast<UTopDownGameInstance>(GetGameInstance());
-	FWeaponInfo myWeaponInfo;
 	if (myGI)
 	{
-		if (myGI->GetWeaponInfoByName(IdWeaponName, myWeaponInfo))
+		UWeaponRegistry* myWeaponRegistry = myGI->GetWeaponRegistry();
+		const FWeaponHandle myWeaponHandle = myWeaponRegistry->FindWeaponHandle(IdWeaponName);
+		if (myWeaponHandle.IsValid())
 		{
-			if (myWeaponInfo.WeaponClass)
-			{
-				FVector SpawnLocation = FVector(0);
-				FRotator SpawnRotation = FRotator(0);
+			//sounds, FX and meshes are soft references, the weapon is spawned when they are resident.
+			//The current weapon is kept until then
+			bWeaponLoading = true;
+			myWeaponRegistry->LoadWeaponAssets(myWeaponHandle, FStreamableDelegate::CreateUObject(this, &ATopDownCharacter::OnWeaponAssetsLoaded, myWeaponHandle, WeaponLoadRequest));
+		}
+		else
+		{
+			UE_LOG(LogTopDown, Warning, TEXT("ATopDownCharacter::InitWeapon - Weapon not found in table -NULL"));
+		}
+	}
+}
 
-				FActorSpawnParameters SpawnParams;
-				SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
-				SpawnParams.Owner = GetOwner();
-				SpawnParams.Instigator = GetInstigator();
+void ATopDownCharacter::OnWeaponAssetsLoaded(FWeaponHandle WeaponHandle, uint32 Request)
+{
+	//streaming is shared with other characters and isn't cancelled, a newer InitWeapon just ignores it
+	if (Request != WeaponLoadRequest)
+		return;
 
-				AWeaponDefault* myWeapon = Cast<AWeaponDefault>(GetWorld()->SpawnActor(myWeaponInfo.WeaponClass, &SpawnLocation, &SpawnRotation, SpawnParams));
-				if (myWeapon)
-				{
-					FAttachmentTransformRules Rule(EAttachmentRule::SnapToTarget, false);
-					myWeapon->AttachToComponent(GetMesh(), Rule, FName("WeaponSocketRightHand"));
-					CurrentWeapon = myWeapon;
+	bWeaponLoading = false;
 
-					myWeapon->WeaponSetting = myWeaponInfo;
-					myWeapon->UpdateStateWeapon(MovementState);
+	UTopDownGameInstance* myGI = Cast<UTopDownGameInstance>(GetGameInstance());
+	if (!myGI || !GetWorld())
+		return;
 
-					myWeapon->OnWeaponReloadStart.AddDynamic(this, &ATopDownCharacter::WeaponReloadStart);
-					myWeapon->OnWeaponReloadEnd.AddDynamic(this, &ATopDownCharacter::WeaponReloadEnd);
+	UWeaponRegistry* myWeaponRegistry = myGI->GetWeaponRegistry();
+	const FWeaponDefinition* myWeaponDefinition = myWeaponRegistry->FindDefinition(WeaponHandle);
 
-					myWeapon->WeaponInit();
-				}
-			}
-		}
-		else
+	if (myWeaponDefinition && myWeaponDefinition->Info.WeaponClass)
+	{
+		DestroyCurrentWeapon();
+
+		FVector SpawnLocation = FVector(0);
+		FRotator SpawnRotation = FRotator(0);
+
+		//the weapon actor, its effects and sounds are tagged by their subsystems
+		LLM_SCOPE_BYTAG(TopDown_Weapons);
+
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+		SpawnParams.Owner = GetOwner();
+		SpawnParams.Instigator = GetInstigator();
+
+		AWeaponDefault* myWeapon = Cast<AWeaponDefault>(GetWorld()->SpawnActor(myWeaponDefinition->Info.WeaponClass, &SpawnLocation, &SpawnRotation, SpawnParams));
+		if (myWeapon)
 		{
-			UE_LOG(LogTemp, Warning, TEXT("ATopDownCharacter::InitWeapon - Weapon not found in table -NULL"));
+			FAttachmentTransformRules Rule(EAttachmentRule::SnapToTarget, false);
+			myWeapon->AttachToComponent(GetMesh(), Rule, FName("WeaponSocketRightHand"));
+			CurrentWeapon = myWeapon;
+
+			myWeapon->SetWeaponDefinition(myWeaponRegistry, WeaponHandle);
+			myWeapon->UpdateStateWeapon(MovementState);
+
+			myWeapon->OnWeaponReloadStart.AddDynamic(this, &ATopDownCharacter::WeaponReloadStart);
+			myWeapon->OnWeaponReloadEnd.AddDynamic(this, &ATopDownCharacter::WeaponReloadEnd);
+
+			myWeapon->WeaponInit();
 		}
 	}
 }
 
+void ATopDownCharacter::DestroyCurrentWeapon()
+{
+	if (!CurrentWeapon)
+		return;
+
+	//the magazine in the hand is a component of the weapon
+	GetWorldTimerManager().ClearTimer(ReloadMagazineTimerHandle);
+	CurrentReloadMagazineStage = EReloadMagazineStages::Not_Reload;
+	TempSaveMagazineComponent = nullptr;
+
+	CurrentWeapon->Destroy();
+	CurrentWeapon = nullptr;
+}
+
 void ATopDownCharacter::TryReloadWeapon()
 {
-	if (CurrentWeapon)
+	const FWeaponInfo* WeaponSetting = CurrentWeapon ? CurrentWeapon->GetWeaponSetting() : nullptr;
+	if (WeaponSetting)
 	{
-		if (CurrentWeapon->GetWeaponRound() <= CurrentWeapon->WeaponSetting.MaxRound)
+		if (CurrentWeapon->GetWeaponRound() <= WeaponSetting->MaxRound)
 			CurrentWeapon->InitReload();
 	}
 }
@@ -346,9 +415,10 @@ void ATopDownCharacter::WeaponReloadStart(UAnimMontage* Anim)
 	{
 		CurrentWeapon->SetWeaponStateFire(false);
 
-		if (CurrentWeapon->WeaponSetting.AnimCharReload)
+		const FWeaponInfo* WeaponSetting = CurrentWeapon->GetWeaponSetting();
+		if (WeaponSetting && WeaponSetting->AnimCharReload.Get())
 		{
-			PlayAnimMontage(CurrentWeapon->WeaponSetting.AnimCharReload);
+			PlayAnimMontage(WeaponSetting->AnimCharReload.Get());
 
 			CurrentReloadMagazineStage = EReloadMagazineStages::Drop_Magazine;
 			GetWorldTimerManager().SetTimer(ReloadMagazineTimerHandle, this, &ATopDownCharacter::OnReloadMagazineTimer, 0.7f, false);
@@ -358,11 +428,21 @@ void ATopDownCharacter::WeaponReloadStart(UAnimMontage* Anim)
 
 void ATopDownCharacter::OnReloadMagazineTimer()
 {
+	TOPDOWN_SCOPE(CharacterReloadMagazine);
+
+	//the weapon may be gone or replaced while the magazine was in the air
+	const FWeaponInfo* WeaponSetting = CurrentWeapon ? CurrentWeapon->GetWeaponSetting() : nullptr;
+	if (!WeaponSetting)
+	{
+		CurrentReloadMagazineStage = EReloadMagazineStages::Not_Reload;
+		return;
+	}
+
 	switch (CurrentReloadMagazineStage)
 	{
 		case EReloadMagazineStages::Drop_Magazine:
 		{
-			if (CurrentWeapon->WeaponSetting.MagazineDrop)
+			if (WeaponSetting->MagazineDrop.Get())
 			{
 				USceneComponent* MagazineComponent = CurrentWeapon->StaticMeshWeapon->GetChildComponent(0);
 
@@ -375,28 +455,10 @@ void ATopDownCharacter::OnReloadMagazineTimer()
 
 				MagazineComponent->SetVisibility(false);
 
-				AStaticMeshActor* MagazineActor = GetWorld()->SpawnActor<AStaticMeshActor>(MagazineLocation, MagazineRotation);
-
-				if (MagazineActor)
+				//simulated, settled and removed by the debris budget
+				if (UDebrisSubsystem* Debris = GetWorld()->GetSubsystem<UDebrisSubsystem>())
 				{
-					auto MeshComponent = MagazineActor->GetStaticMeshComponent();
-
-					if (!MeshComponent)
-						return;
-
-					MagazineActor->SetMobility(EComponentMobility::Movable);
-					MagazineActor->SetActorScale3D(MagazineScale);
-
-					MeshComponent->SetStaticMesh(CurrentWeapon->WeaponSetting.MagazineDrop);
-					MeshComponent->SetCollisionProfileName("Pawn");
-					MeshComponent->SetSimulatePhysics(true);
-
-					UPrimitiveComponent* PrimitiveComponent = MagazineActor->FindComponentByClass<UPrimitiveComponent>();
-
-					if (PrimitiveComponent)
-					{
-						PrimitiveComponent->AddImpulse((-GetActorRightVector() + GetActorForwardVector()) * 30.0f);
-					}
+					Debris->SpawnDebris(WeaponSetting->MagazineDrop.Get(), FTransform(MagazineRotation, MagazineLocation, MagazineScale), (-GetActorRightVector() + GetActorForwardVector()) * 30.0f, this);
 				}
 			}
 
@@ -404,12 +466,12 @@ void ATopDownCharacter::OnReloadMagazineTimer()
 
 			GetWorldTimerManager().SetTimer(ReloadMagazineTimerHandle, this, &ATopDownCharacter::OnReloadMagazineTimer, 0.6f, false);
 
-			UE_LOG(LogTemp, Warning, TEXT("Drop Magazine"));
+			UE_LOG(LogTopDownVerbose, Verbose, TEXT("Drop Magazine"));
 			break;
 		}
 		case EReloadMagazineStages::Take_Magazine:
 		{
-			if (CurrentWeapon->WeaponSetting.MagazineDrop)
+			if (WeaponSetting->MagazineDrop.Get())
 			{
 				USceneComponent* MagazineComponent = CurrentWeapon->StaticMeshWeapon->GetChildComponent(0);
 
@@ -428,13 +490,13 @@ void ATopDownCharacter::OnReloadMagazineTimer()
 
 				GetWorldTimerManager().SetTimer(ReloadMagazineTimerHandle, this, &ATopDownCharacter::OnReloadMagazineTimer, 1.3f, false);
 
-				UE_LOG(LogTemp, Warning, TEXT("Take Magazine"));
+				UE_LOG(LogTopDownVerbose, Verbose, TEXT("Take Magazine"));
 			}
 			break;
 		}
 		case EReloadMagazineStages::Put_Magazine:
 		{
-			if (CurrentWeapon->WeaponSetting.MagazineDrop)
+			if (WeaponSetting->MagazineDrop.Get())
 			{
 				if (!TempSaveMagazineComponent)
 					return;
@@ -447,7 +509,7 @@ void ATopDownCharacter::OnReloadMagazineTimer()
 
 				CurrentReloadMagazineStage = EReloadMagazineStages::Not_Reload;
 
-				UE_LOG(LogTemp, Warning, TEXT("Put Magazine"));
+				UE_LOG(LogTopDownVerbose, Verbose, TEXT("Put Magazine"));
 			}
 			break;
 		}
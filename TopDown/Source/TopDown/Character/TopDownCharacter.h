@@ -17,6 +17,7 @@ class ATopDownCharacter : public ACharacter
 
 protected:
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 public:
 	ATopDownCharacter();
@@ -86,8 +87,14 @@ public:
 
 	UFUNCTION()
 	void InitWeapon(FName IdWeaponName);
+	//spawns the weapon once its assets are streamed in and destroys the previous one, unless InitWeapon was called again meanwhile
+	void OnWeaponAssetsLoaded(FWeaponHandle WeaponHandle, uint32 Request);
+	void DestroyCurrentWeapon();
 
 	AWeaponDefault* CurrentWeapon = nullptr;
+	//InitWeapon calls so far, only the last one spawns its weapon
+	uint32 WeaponLoadRequest = 0;
+	bool bWeaponLoading = false;
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Init Weapon Class")
 	TSubclassOf<AWeaponDefault> InitWeaponClass = nullptr;
@@ -3,3 +3,111 @@
 
 #include "MyTypes.h"
 #include "TopDown/TopDown.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Engine/World.h"
+
+AActor* UMyTypes::SpawnInstancedMeshHost(UWorld* World, FName HostName)
+{
+	if (!World)
+		return nullptr;
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.Name = MakeUniqueObjectName(World->PersistentLevel, AActor::StaticClass(), HostName);
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	SpawnParams.ObjectFlags |= RF_Transient;
+
+	AActor* Host = World->SpawnActor<AActor>(AActor::StaticClass(), FTransform::Identity, SpawnParams);
+	if (Host)
+	{
+		USceneComponent* Root = NewObject<USceneComponent>(Host, TEXT("Root"));
+		Root->SetMobility(EComponentMobility::Static);
+		Host->SetRootComponent(Root);
+		Root->RegisterComponent();
+	}
+
+	return Host;
+}
+
+UInstancedStaticMeshComponent* UMyTypes::AddInstancedMeshComponent(AActor* Host, UStaticMesh* Mesh)
+{
+	if (!Host || !Mesh)
+		return nullptr;
+
+	UInstancedStaticMeshComponent* InstancedMesh = NewObject<UInstancedStaticMeshComponent>(Host);
+	InstancedMesh->SetMobility(EComponentMobility::Movable);
+	InstancedMesh->SetStaticMesh(Mesh);
+	InstancedMesh->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	InstancedMesh->SetGenerateOverlapEvents(false);
+	InstancedMesh->SetCanEverAffectNavigation(false);
+	InstancedMesh->SetupAttachment(Host->GetRootComponent());
+	InstancedMesh->RegisterComponent();
+	Host->AddInstanceComponent(InstancedMesh);
+
+	return InstancedMesh;
+}
+
+int32 UMyTypes::MakeShotSeed(int32 WeaponSeed, uint32 ShotIndex)
+{
+	return (int32)HashCombine((uint32)WeaponSeed, ShotIndex);
+}
+
+void UMyTypes::SampleDispersionCone(const FVector& Direction, float ConeHalfAngleRad, int32 ShotSeed, TArrayView<FVector> OutDirections)
+{
+	const FVector Axis = Direction.GetSafeNormal();
+	if (ConeHalfAngleRad <= 0.0f)
+	{
+		for (FVector& OutDirection : OutDirections)
+			OutDirection = Axis;
+		return;
+	}
+
+	//basis is shared by all pellets, FRandomStream::VRandCone would build it for each one
+	FVector AxisY, AxisZ;
+	Axis.FindBestAxisVectors(AxisY, AxisZ);
+
+	const float CosHalfAngle = FMath::Cos(ConeHalfAngleRad);
+	FRandomStream Stream(ShotSeed);
+
+	for (FVector& OutDirection : OutDirections)
+	{
+		//uniform over the spherical cap
+		const float CosAngle = FMath::Lerp(1.0f, CosHalfAngle, Stream.GetFraction());
+		const float SinAngle = FMath::Sqrt(FMath::Max(0.0f, 1.0f - CosAngle * CosAngle));
+
+		float SinRoll, CosRoll;
+		FMath::SinCos(&SinRoll, &CosRoll, Stream.GetFraction() * 2.0f * PI);
+
+		OutDirection = Axis * CosAngle + (AxisY * CosRoll + AxisZ * SinRoll) * SinAngle;
+	}
+}
+
+TSharedRef<const FSurfaceImpactTable> FSurfaceImpactTable::Compile(const FProjectileInfo& Info, TSharedPtr<FStreamableHandle> AssetsHandle)
+{
+	TSharedRef<FSurfaceImpactTable> Table = MakeShared<FSurfaceImpactTable>();
+	Table->AssetsHandle = AssetsHandle;
+
+	for (int32 Surface = 0; Surface < SurfaceType_Max; Surface++)
+		Table->Impacts[Surface].Sound = Info.HitSound.Get();
+
+	for (const TPair<TEnumAsByte<EPhysicalSurface>, TSoftObjectPtr<UMaterialInterface>>& Decal : Info.HitDecals)
+		Table->Impacts[Decal.Key].Decal = Decal.Value.Get();
+
+	for (const TPair<TEnumAsByte<EPhysicalSurface>, TSoftObjectPtr<UParticleSystem>>& FX : Info.HitFXs)
+		Table->Impacts[FX.Key].FX = FX.Value.Get();
+
+	for (const TPair<TEnumAsByte<EPhysicalSurface>, TSoftObjectPtr<UNiagaraSystem>>& BatchedFX : Info.HitBatchedFXs)
+		Table->Impacts[BatchedFX.Key].BatchedFX = BatchedFX.Value.Get();
+
+	return Table;
+}
+
+TSharedRef<const FSurfaceImpactTable> FSurfaceImpactTable::Compile(const TMap<TEnumAsByte<EPhysicalSurface>, TSoftObjectPtr<UMaterialInterface>>& Decals, TSharedPtr<FStreamableHandle> AssetsHandle)
+{
+	TSharedRef<FSurfaceImpactTable> Table = MakeShared<FSurfaceImpactTable>();
+	Table->AssetsHandle = AssetsHandle;
+
+	for (const TPair<TEnumAsByte<EPhysicalSurface>, TSoftObjectPtr<UMaterialInterface>>& Decal : Decals)
+		Table->Impacts[Decal.Key].Decal = Decal.Value.Get();
+
+	return Table;
+}
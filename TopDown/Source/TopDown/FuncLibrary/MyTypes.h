@@ -8,6 +8,8 @@
 #include "NiagaraComponent.h"
 #include "MyTypes.generated.h"
 
+struct FStreamableHandle;
+
 UENUM(BlueprintType)
 enum class EMovementState : uint8
 {
@@ -27,6 +29,15 @@ enum class EReloadMagazineStages : uint8
 	Put_Magazine UMETA(DisplayName = "Put Magazine")
 };
 
+UENUM(BlueprintType)
+enum class EWeaponState : uint8
+{
+	Idle UMETA(DisplayName = "Idle"),
+	Firing UMETA(DisplayName = "Firing"),
+	Reloading UMETA(DisplayName = "Reloading"),
+	RecoveringDispersion UMETA(DisplayName = "Recovering Dispersion")
+};
+
 USTRUCT(BlueprintType)
 struct FCharacterSpeed
 {
@@ -60,21 +71,28 @@ struct FProjectileInfo
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ProjectileSetting")
 	float ProjectileInitSpeed = 2000.0f;
 
+	//fly as data in UBulletSimulationSubsystem, no actor is spawned (grenades always use the actor)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ProjectileSetting")
+	bool bLightweightSimulation = false;
+
 	//material to decal on hit
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ProjectileSetting")
-	TMap<TEnumAsByte<EPhysicalSurface>, UMaterialInterface*> HitDecals;
+	TMap<TEnumAsByte<EPhysicalSurface>, TSoftObjectPtr<UMaterialInterface>> HitDecals;
 
 	//Sound when hit
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ProjectileSetting")
-	USoundBase* HitSound = nullptr;
+	TSoftObjectPtr<USoundBase> HitSound;
 	//fx when hit check by surface
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ProjectileSetting")
-	TMap<TEnumAsByte<EPhysicalSurface>, UParticleSystem*> HitFXs;
+	TMap<TEnumAsByte<EPhysicalSurface>, TSoftObjectPtr<UParticleSystem>> HitFXs;
+	//one Niagara system draws all hits of a frame from the ImpactPositions/ImpactNormals arrays, used instead of HitFXs for the surface
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ProjectileSetting")
+	TMap<TEnumAsByte<EPhysicalSurface>, TSoftObjectPtr<UNiagaraSystem>> HitBatchedFXs;
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ProjectileSetting")
-	UParticleSystem* ExploseFX = nullptr;
+	TSoftObjectPtr<UParticleSystem> ExploseFX;
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ProjectileSetting")
-	USoundBase* ExploseSound = nullptr;
+	TSoftObjectPtr<USoundBase> ExploseSound;
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ProjectileSetting")
 	float ProjectileMaxRadiusDamage = 200.0f;
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ProjectileSetting")
@@ -166,13 +184,17 @@ struct FWeaponInfo : public FTableRowBase
 	FWeaponDispersion DispersionWeapon;
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sound ")
-	USoundBase* SoundFireWeapon = nullptr;
+	TSoftObjectPtr<USoundBase> SoundFireWeapon;
+
+	//looped while the weapon fires, replaces SoundFireWeapon of every shot when set
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sound ")
+	TSoftObjectPtr<USoundBase> SoundFireLoop;
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sound ")
-	USoundBase* SoundReloadWeapon = nullptr;
+	TSoftObjectPtr<USoundBase> SoundReloadWeapon;
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FX ")
-	UNiagaraSystem* EffectFireWeapon = nullptr;
+	TSoftObjectPtr<UNiagaraSystem> EffectFireWeapon;
 
 	//if null use trace logic (TSubclassOf<class AProjectileDefault> Projectile = nullptr)
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Projectile ")
@@ -189,23 +211,56 @@ struct FWeaponInfo : public FTableRowBase
 	UDecalComponent* DecalOnHit = nullptr;
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Anim ")
-	UAnimMontage* AnimCharFire = nullptr;
+	TSoftObjectPtr<UAnimMontage> AnimCharFire;
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Anim ")
-	UAnimMontage* AnimCharReload = nullptr;
+	TSoftObjectPtr<UAnimMontage> AnimCharReload;
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Mesh ")
-	UStaticMesh* MagazineDrop = nullptr;
+	TSoftObjectPtr<UStaticMesh> MagazineDrop;
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Mesh ")
-	UStaticMesh* ShellBullets = nullptr;
+	TSoftObjectPtr<UStaticMesh> ShellBullets;
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "HitEffect ")
-	TMap<TEnumAsByte<EPhysicalSurface>, UMaterialInterface*> HitScanDecals;
+	TMap<TEnumAsByte<EPhysicalSurface>, TSoftObjectPtr<UMaterialInterface>> HitScanDecals;
+};
+
+//what is spawned on a hit of one surface type
+struct FSurfaceImpact
+{
+	UMaterialInterface* Decal = nullptr;
+	UParticleSystem* FX = nullptr;
+	UNiagaraSystem* BatchedFX = nullptr;
+	USoundBase* Sound = nullptr;
+};
+
+//HitDecals, HitFXs and HitSound (or HitScanDecals) compiled into an array indexed by surface type.
+//Shared by pointer, compiled after the assets are streamed in
+struct FSurfaceImpactTable
+{
+	FSurfaceImpact Impacts[SurfaceType_Max];
+	//assets of the weapon stay resident while a weapon, projectile or bullet type holds one of its tables
+	TSharedPtr<FStreamableHandle> AssetsHandle;
+
+	const FSurfaceImpact& GetImpact(EPhysicalSurface SurfaceType) const { return Impacts[SurfaceType < SurfaceType_Max ? SurfaceType : SurfaceType_Default]; }
+
+	static TSharedRef<const FSurfaceImpactTable> Compile(const FProjectileInfo& Info, TSharedPtr<FStreamableHandle> AssetsHandle = nullptr);
+	static TSharedRef<const FSurfaceImpactTable> Compile(const TMap<TEnumAsByte<EPhysicalSurface>, TSoftObjectPtr<UMaterialInterface>>& Decals, TSharedPtr<FStreamableHandle> AssetsHandle = nullptr);
 };
 
 UCLASS()
 class UMyTypes : public UBlueprintFunctionLibrary
 {
 	GENERATED_BODY()
+
+public:
+	//transient actor owning the instanced meshes and pooled components of world subsystems
+	static AActor* SpawnInstancedMeshHost(UWorld* World, FName HostName);
+	static class UInstancedStaticMeshComponent* AddInstancedMeshComponent(AActor* Host, UStaticMesh* Mesh);
+
+	//stream seed of one shot, the same weapon seed and shot index give the same pellets everywhere
+	static int32 MakeShotSeed(int32 WeaponSeed, uint32 ShotIndex);
+	//fills OutDirections with directions uniformly distributed in the cone around Direction
+	static void SampleDispersionCone(const FVector& Direction, float ConeHalfAngleRad, int32 ShotSeed, TArrayView<FVector> OutDirections);
 };
\ No newline at end of file
@@ -0,0 +1,202 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TopDownAllocCounter.h"
+
+#if TOPDOWN_ALLOC_COUNTING
+
+#include "HAL/IConsoleManager.h"
+#include "HAL/MemoryBase.h"
+#include "Misc/CommandLine.h"
+#include "Misc/CoreDelegates.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+#include "TopDown/TopDown.h"
+
+CSV_DEFINE_CATEGORY(TopDownAllocs, true);
+
+static TAutoConsoleVariable<int32> CVarAllocReport(
+	TEXT("TopDown.Alloc.Report"),
+	0,
+	TEXT("1 - log the allocations of every TOPDOWN_ALLOC_SCOPE site at the end of each frame it allocated in"));
+
+static FAutoConsoleCommand AllocDumpCommand(
+	TEXT("TopDown.Alloc.Dump"),
+	TEXT("Log allocations and calls of every TOPDOWN_ALLOC_SCOPE site since counting started or the last reset"),
+	FConsoleCommandDelegate::CreateLambda([]()
+	{
+		if (!TopDownAllocCounter::IsInstalled())
+			UE_LOG(LogTopDown, Display, TEXT("TopDown.Alloc.Dump - counting is off, start with -TopDownAllocCounting"));
+
+		for (FTopDownAllocSite* Site = TopDownAllocCounter::GetFirstSite(); Site; Site = Site->Next)
+		{
+			const uint64 Calls = Site->GetCalls();
+			UE_LOG(LogTopDown, Display, TEXT("TopDown.Alloc.Dump - %s: %llu allocations in %llu calls, %.2f per call"),
+				Site->Name, Site->GetAllocs(), Calls, Calls > 0 ? double(Site->GetAllocs()) / Calls : 0.0);
+		}
+	}));
+
+static thread_local uint64 GThreadAllocCount = 0;
+static FTopDownAllocSite* GFirstSite = nullptr;
+class FTopDownCountingMalloc;
+static FTopDownCountingMalloc* GCountingMalloc = nullptr;
+static FDelegateHandle GEndFrameHandle;
+
+//Pass-through in front of the engine allocator, blocks allocated before it was installed are freed by the same inner allocator.
+//It sits outside the poison, thread safe and LLM proxies, so every FMemory call counts once whatever is configured inside.
+//A reallocation counts as an allocation, TArray growth goes through it
+class FTopDownCountingMalloc final : public FMalloc
+{
+public:
+	explicit FTopDownCountingMalloc(FMalloc* InInner)
+		: Inner(InInner)
+	{
+	}
+
+	virtual void* Malloc(SIZE_T Count, uint32 Alignment) override
+	{
+		GThreadAllocCount++;
+		return Inner->Malloc(Count, Alignment);
+	}
+
+	virtual void* TryMalloc(SIZE_T Count, uint32 Alignment) override
+	{
+		GThreadAllocCount++;
+		return Inner->TryMalloc(Count, Alignment);
+	}
+
+	virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override
+	{
+		if (Count > 0)
+			GThreadAllocCount++;
+		return Inner->Realloc(Original, Count, Alignment);
+	}
+
+	virtual void* TryRealloc(void* Original, SIZE_T Count, uint32 Alignment) override
+	{
+		if (Count > 0)
+			GThreadAllocCount++;
+		return Inner->TryRealloc(Original, Count, Alignment);
+	}
+
+	virtual void Free(void* Original) override { Inner->Free(Original); }
+	virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override { return Inner->QuantizeSize(Count, Alignment); }
+	virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override { return Inner->GetAllocationSize(Original, SizeOut); }
+	virtual void Trim(bool bTrimThreadCaches) override { Inner->Trim(bTrimThreadCaches); }
+	virtual void SetupTLSCachesOnCurrentThread() override { Inner->SetupTLSCachesOnCurrentThread(); }
+	virtual void ClearAndDisableTLSCachesOnCurrentThread() override { Inner->ClearAndDisableTLSCachesOnCurrentThread(); }
+	virtual void InitializeStatsMetadata() override { Inner->InitializeStatsMetadata(); }
+	virtual void UpdateStats() override { Inner->UpdateStats(); }
+	virtual void GetAllocatorStats(FGenericMemoryStats& OutStats) override { Inner->GetAllocatorStats(OutStats); }
+	virtual void DumpAllocatorStats(FOutputDevice& Ar) override { Inner->DumpAllocatorStats(Ar); }
+	virtual bool IsInternallyThreadSafe() const override { return Inner->IsInternallyThreadSafe(); }
+	virtual bool ValidateHeap() override { return Inner->ValidateHeap(); }
+	virtual const TCHAR* GetDescriptiveName() override { return Inner->GetDescriptiveName(); }
+
+	FMalloc* GetInner() const { return Inner; }
+
+private:
+	FMalloc* Inner;
+};
+
+FTopDownAllocSite::FTopDownAllocSite(const TCHAR* InName)
+	: Name(InName)
+	, CsvStatName(InName)
+	, Next(GFirstSite)
+{
+	GFirstSite = this;
+}
+
+static void RollAllocFrame()
+{
+	const bool bReport = CVarAllocReport.GetValueOnGameThread() > 0;
+
+	for (FTopDownAllocSite* Site = GFirstSite; Site; Site = Site->Next)
+	{
+#if CSV_PROFILER
+		FCsvProfiler::RecordCustomStat(Site->CsvStatName, CSV_CATEGORY_INDEX(TopDownAllocs), int32(Site->FrameAllocs), ECsvCustomStatOp::Set);
+#endif
+
+		if (bReport && Site->FrameAllocs > 0)
+			UE_LOG(LogTopDown, Display, TEXT("TopDown.Alloc - %s: %u allocations in %u calls"), Site->Name, Site->FrameAllocs, Site->FrameCalls);
+
+		Site->TotalCalls += Site->FrameCalls;
+		Site->TotalAllocs += Site->FrameAllocs;
+		Site->FrameCalls = 0;
+		Site->FrameAllocs = 0;
+	}
+}
+
+void TopDownAllocCounter::InstallIfRequested()
+{
+	check(IsInGameThread());
+
+	FString BenchmarkCounts;
+	const bool bRequested = FParse::Param(FCommandLine::Get(), TEXT("TopDownAllocCounting"))
+		|| FParse::Value(FCommandLine::Get(), TEXT("TopDownBenchmark="), BenchmarkCounts, false);
+	if (!bRequested || GCountingMalloc)
+		return;
+
+	//fully built before it is published, a thread still holding the old pointer ends in the same allocator
+	FTopDownCountingMalloc* CountingMalloc = new FTopDownCountingMalloc(GMalloc);
+	FPlatformMisc::MemoryBarrier();
+	GMalloc = CountingMalloc;
+	GCountingMalloc = CountingMalloc;
+
+	GEndFrameHandle = FCoreDelegates::OnEndFrame.AddStatic(&RollAllocFrame);
+
+	UE_LOG(LogTopDown, Log, TEXT("TopDownAllocCounter::InstallIfRequested - counting allocations"));
+}
+
+void TopDownAllocCounter::Uninstall()
+{
+	if (!GCountingMalloc)
+		return;
+
+	FCoreDelegates::OnEndFrame.Remove(GEndFrameHandle);
+	GEndFrameHandle.Reset();
+
+	//something wrapped GMalloc after the proxy, it has to stay in the chain
+	if (GMalloc == GCountingMalloc)
+		GMalloc = GCountingMalloc->GetInner();
+
+	//not deleted, another thread can still be inside one of its calls
+	GCountingMalloc = nullptr;
+}
+
+bool TopDownAllocCounter::IsInstalled()
+{
+	return GCountingMalloc != nullptr;
+}
+
+uint64 TopDownAllocCounter::GetThreadAllocCount()
+{
+	return GThreadAllocCount;
+}
+
+FTopDownAllocSite* TopDownAllocCounter::GetFirstSite()
+{
+	return GFirstSite;
+}
+
+FTopDownAllocSite* TopDownAllocCounter::FindSite(const TCHAR* Name)
+{
+	for (FTopDownAllocSite* Site = GFirstSite; Site; Site = Site->Next)
+	{
+		if (FCString::Strcmp(Site->Name, Name) == 0)
+			return Site;
+	}
+	return nullptr;
+}
+
+void TopDownAllocCounter::ResetTotals()
+{
+	for (FTopDownAllocSite* Site = GFirstSite; Site; Site = Site->Next)
+	{
+		Site->FrameCalls = 0;
+		Site->FrameAllocs = 0;
+		Site->TotalCalls = 0;
+		Site->TotalAllocs = 0;
+	}
+}
+
+#endif
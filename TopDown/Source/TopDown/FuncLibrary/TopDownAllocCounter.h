@@ -0,0 +1,77 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//allocation counting exists only in Debug/Development/Test builds
+#define TOPDOWN_ALLOC_COUNTING (!UE_BUILD_SHIPPING)
+
+#if TOPDOWN_ALLOC_COUNTING
+
+//One TOPDOWN_ALLOC_SCOPE call site. Counts are inclusive (FireBatch contains Fire contains BulletEffect), sites are used on the game thread only
+struct FTopDownAllocSite
+{
+	explicit FTopDownAllocSite(const TCHAR* InName);
+
+	const TCHAR* Name;
+	FName CsvStatName;
+	FTopDownAllocSite* Next = nullptr;
+
+	//rolled into the totals at the end of the frame
+	uint32 FrameCalls = 0;
+	uint32 FrameAllocs = 0;
+	uint64 TotalCalls = 0;
+	uint64 TotalAllocs = 0;
+
+	uint64 GetCalls() const { return TotalCalls + FrameCalls; }
+	uint64 GetAllocs() const { return TotalAllocs + FrameAllocs; }
+};
+
+//Counts allocations of the current thread through a proxy in front of GMalloc.
+//The proxy goes in at module startup with -TopDownAllocCounting or -TopDownBenchmark=, before any world exists, and
+//is never swapped in while the game runs. Without it counts stay 0
+namespace TopDownAllocCounter
+{
+	void InstallIfRequested();
+	//GMalloc goes back to the allocator the proxy wrapped
+	void Uninstall();
+	bool IsInstalled();
+	//allocations made by the calling thread since Install
+	uint64 GetThreadAllocCount();
+
+	//sites register on their first call, Next walks the rest
+	FTopDownAllocSite* GetFirstSite();
+	//nullptr until the site ran once
+	FTopDownAllocSite* FindSite(const TCHAR* Name);
+	void ResetTotals();
+}
+
+struct FTopDownAllocScope
+{
+	explicit FTopDownAllocScope(FTopDownAllocSite& InSite)
+		: Site(InSite)
+		, StartCount(TopDownAllocCounter::GetThreadAllocCount())
+	{
+	}
+
+	~FTopDownAllocScope()
+	{
+		Site.FrameCalls++;
+		Site.FrameAllocs += uint32(TopDownAllocCounter::GetThreadAllocCount() - StartCount);
+	}
+
+	FTopDownAllocSite& Site;
+	uint64 StartCount;
+};
+
+//allocations until the end of the enclosing scope, per frame in CSV captures (TopDownAllocs) and TopDown.Alloc.Report
+#define TOPDOWN_ALLOC_SCOPE(Name) \
+	static FTopDownAllocSite TopDownAllocSite_##Name(TEXT(#Name)); \
+	FTopDownAllocScope TopDownAllocScope_##Name(TopDownAllocSite_##Name)
+
+#else
+
+#define TOPDOWN_ALLOC_SCOPE(Name)
+
+#endif
@@ -0,0 +1,187 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TopDownDebugDraw.h"
+
+#if TOPDOWN_DEBUG_DRAW
+
+#include "Components/LineBatchComponent.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Tickable.h"
+
+static TAutoConsoleVariable<int32> CVarDebugWeapons(
+	TEXT("TopDown.Debug.Weapons"),
+	0,
+	TEXT("1 - draw shot directions and hit-scan traces"));
+
+static TAutoConsoleVariable<int32> CVarDebugDispersion(
+	TEXT("TopDown.Debug.Dispersion"),
+	0,
+	TEXT("1 - draw the dispersion cone of weapons"));
+
+static TAutoConsoleVariable<int32> CVarDebugExplosions(
+	TEXT("TopDown.Debug.Explosions"),
+	0,
+	TEXT("1 - draw damage radii of explosions"));
+
+static TAutoConsoleVariable<int32> CVarDebugCursor(
+	TEXT("TopDown.Debug.Cursor"),
+	0,
+	TEXT("1 - draw the location under the cursor"));
+
+namespace TopDownDebugDraw
+{
+	//lines of one world until the end of the frame
+	struct FWorldLines
+	{
+		TWeakObjectPtr<const UWorld> World;
+		TArray<FBatchedLine> FrameLines;
+		TArray<FBatchedLine> PersistentLines;
+	};
+
+	class FLineBuffer : public FTickableGameObject
+	{
+	public:
+		FWorldLines* FindOrAddWorld(const UWorld* World)
+		{
+			if (!World || World->GetNetMode() == NM_DedicatedServer)
+				return nullptr;
+
+			for (FWorldLines& Lines : Worlds)
+			{
+				if (Lines.World.Get() == World)
+					return &Lines;
+			}
+
+			FWorldLines& Lines = Worlds.AddDefaulted_GetRef();
+			Lines.World = World;
+			return &Lines;
+		}
+
+		virtual void Tick(float DeltaTime) override
+		{
+			for (int32 i = 0; i < Worlds.Num(); i++)
+			{
+				FWorldLines& Lines = Worlds[i];
+				const UWorld* World = Lines.World.Get();
+				if (!World)
+				{
+					Worlds.RemoveAtSwap(i--, 1, false);
+					continue;
+				}
+
+				if (Lines.FrameLines.Num() > 0 && World->LineBatcher)
+					World->LineBatcher->DrawLines(Lines.FrameLines);
+				if (Lines.PersistentLines.Num() > 0 && World->PersistentLineBatcher)
+					World->PersistentLineBatcher->DrawLines(Lines.PersistentLines);
+
+				Lines.FrameLines.Reset();
+				Lines.PersistentLines.Reset();
+			}
+		}
+
+		virtual ETickableTickType GetTickableTickType() const override { return ETickableTickType::Always; }
+		virtual bool IsTickableWhenPaused() const override { return true; }
+		virtual TStatId GetStatId() const override { RETURN_QUICK_DECLARE_CYCLE_STAT(FTopDownDebugLineBuffer, STATGROUP_Tickables); }
+
+	private:
+		TArray<FWorldLines> Worlds;
+	};
+
+	//created with the first line, a static instance would unregister itself after the engine is gone
+	static TUniquePtr<FLineBuffer> LineBuffer;
+
+	static FLineBuffer& GetLineBuffer()
+	{
+		if (!LineBuffer)
+			LineBuffer = MakeUnique<FLineBuffer>();
+		return *LineBuffer;
+	}
+
+	void Shutdown()
+	{
+		LineBuffer.Reset();
+	}
+
+	static void AddBatchedLine(FWorldLines& Lines, const FVector& Start, const FVector& End, const FColor& Color, float LifeTime, float Thickness)
+	{
+		//same split DrawDebugLine does, one-frame lines go to the batcher that is cleared every frame
+		TArray<FBatchedLine>& Target = LifeTime > 0.0f ? Lines.PersistentLines : Lines.FrameLines;
+		Target.Emplace(Start, End, FLinearColor(Color), LifeTime, Thickness, SDPG_World);
+	}
+
+	bool IsEnabled(ETopDownDebugCategory Category)
+	{
+		switch (Category)
+		{
+		case ETopDownDebugCategory::Weapons:
+			return CVarDebugWeapons.GetValueOnGameThread() > 0;
+		case ETopDownDebugCategory::Dispersion:
+			return CVarDebugDispersion.GetValueOnGameThread() > 0;
+		case ETopDownDebugCategory::Explosions:
+			return CVarDebugExplosions.GetValueOnGameThread() > 0;
+		case ETopDownDebugCategory::Cursor:
+			return CVarDebugCursor.GetValueOnGameThread() > 0;
+		default:
+			return false;
+		}
+	}
+
+	void AddLine(const UWorld* World, const FVector& Start, const FVector& End, const FColor& Color, float LifeTime, float Thickness)
+	{
+		if (FWorldLines* Lines = GetLineBuffer().FindOrAddWorld(World))
+			AddBatchedLine(*Lines, Start, End, Color, LifeTime, Thickness);
+	}
+
+	void AddSphere(const UWorld* World, const FVector& Center, float Radius, int32 Segments, const FColor& Color, float LifeTime, float Thickness)
+	{
+		FWorldLines* Lines = GetLineBuffer().FindOrAddWorld(World);
+		if (!Lines)
+			return;
+
+		//three great circles
+		Segments = FMath::Max(Segments, 4);
+		const float AngleStep = 2.0f * PI / Segments;
+		for (int32 i = 0; i < Segments; i++)
+		{
+			float SinA, CosA, SinB, CosB;
+			FMath::SinCos(&SinA, &CosA, AngleStep * i);
+			FMath::SinCos(&SinB, &CosB, AngleStep * (i + 1));
+
+			AddBatchedLine(*Lines, Center + Radius * FVector(CosA, SinA, 0.0f), Center + Radius * FVector(CosB, SinB, 0.0f), Color, LifeTime, Thickness);
+			AddBatchedLine(*Lines, Center + Radius * FVector(CosA, 0.0f, SinA), Center + Radius * FVector(CosB, 0.0f, SinB), Color, LifeTime, Thickness);
+			AddBatchedLine(*Lines, Center + Radius * FVector(0.0f, CosA, SinA), Center + Radius * FVector(0.0f, CosB, SinB), Color, LifeTime, Thickness);
+		}
+	}
+
+	void AddCone(const UWorld* World, const FVector& Origin, const FVector& Direction, float Length, float AngleRad, int32 Sides, const FColor& Color, float LifeTime, float Thickness)
+	{
+		FWorldLines* Lines = GetLineBuffer().FindOrAddWorld(World);
+		if (!Lines)
+			return;
+
+		const FVector Axis = Direction.GetSafeNormal();
+		FVector Y, Z;
+		Axis.FindBestAxisVectors(Y, Z);
+
+		//rim circle at the end of the cone and a ray to every rim point
+		Sides = FMath::Max(Sides, 4);
+		const FVector Center = Origin + Axis * Length * FMath::Cos(AngleRad);
+		const float RimRadius = Length * FMath::Sin(AngleRad);
+
+		FVector PrevRim = Center + Y * RimRadius;
+		for (int32 i = 1; i <= Sides; i++)
+		{
+			float Sin, Cos;
+			FMath::SinCos(&Sin, &Cos, 2.0f * PI * i / Sides);
+			const FVector Rim = Center + (Y * Cos + Z * Sin) * RimRadius;
+
+			AddBatchedLine(*Lines, PrevRim, Rim, Color, LifeTime, Thickness);
+			AddBatchedLine(*Lines, Origin, Rim, Color, LifeTime, Thickness);
+			PrevRim = Rim;
+		}
+	}
+}
+
+#endif
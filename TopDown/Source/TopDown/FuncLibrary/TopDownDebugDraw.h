@@ -0,0 +1,52 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//debug drawing exists only in Debug/Development builds
+#define TOPDOWN_DEBUG_DRAW (!(UE_BUILD_SHIPPING || UE_BUILD_TEST))
+
+//one TopDown.Debug.<Category> CVar each
+enum class ETopDownDebugCategory : uint8
+{
+	Weapons,
+	Dispersion,
+	Explosions,
+	Cursor,
+	Num
+};
+
+#if TOPDOWN_DEBUG_DRAW
+
+class UWorld;
+
+//Lines of a frame are gathered per world and handed to its line batchers in one call at the end of the frame
+namespace TopDownDebugDraw
+{
+	bool IsEnabled(ETopDownDebugCategory Category);
+
+	//LifeTime 0 - one frame
+	void AddLine(const UWorld* World, const FVector& Start, const FVector& End, const FColor& Color, float LifeTime, float Thickness = 0.0f);
+	void AddSphere(const UWorld* World, const FVector& Center, float Radius, int32 Segments, const FColor& Color, float LifeTime, float Thickness = 0.0f);
+	void AddCone(const UWorld* World, const FVector& Origin, const FVector& Direction, float Length, float AngleRad, int32 Sides, const FColor& Color, float LifeTime, float Thickness = 0.0f);
+
+	//from FTopDownModule::ShutdownModule, the line buffer is unregistered while the tickable list still exists
+	void Shutdown();
+}
+
+//arguments are evaluated only when the category is on
+#define TOPDOWN_DEBUG_LINE(Category, World, Start, End, Color, LifeTime, ...) \
+	do { if (TopDownDebugDraw::IsEnabled(ETopDownDebugCategory::Category)) TopDownDebugDraw::AddLine(World, Start, End, Color, LifeTime, ##__VA_ARGS__); } while (0)
+#define TOPDOWN_DEBUG_SPHERE(Category, World, Center, Radius, Segments, Color, LifeTime, ...) \
+	do { if (TopDownDebugDraw::IsEnabled(ETopDownDebugCategory::Category)) TopDownDebugDraw::AddSphere(World, Center, Radius, Segments, Color, LifeTime, ##__VA_ARGS__); } while (0)
+#define TOPDOWN_DEBUG_CONE(Category, World, Origin, Direction, Length, AngleRad, Sides, Color, LifeTime, ...) \
+	do { if (TopDownDebugDraw::IsEnabled(ETopDownDebugCategory::Category)) TopDownDebugDraw::AddCone(World, Origin, Direction, Length, AngleRad, Sides, Color, LifeTime, ##__VA_ARGS__); } while (0)
+
+#else
+
+#define TOPDOWN_DEBUG_LINE(Category, World, Start, End, Color, LifeTime, ...) do {} while (0)
+#define TOPDOWN_DEBUG_SPHERE(Category, World, Center, Radius, Segments, Color, LifeTime, ...) do {} while (0)
+#define TOPDOWN_DEBUG_CONE(Category, World, Origin, Direction, Length, AngleRad, Sides, Color, LifeTime, ...) do {} while (0)
+
+#endif
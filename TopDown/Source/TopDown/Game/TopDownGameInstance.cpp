@@ -2,20 +2,41 @@
 
 
 #include "TopDownGameInstance.h"
+#include "HAL/IConsoleManager.h"
+#include "TopDown/TopDown.h"
 
+static TAutoConsoleVariable<int32> CVarUseWeaponRegistryCache(
+	TEXT("TopDown.WeaponRegistry.UseCache"),
+	0,
+	TEXT("1 - dedicated servers load the weapon registry from Saved/WeaponRegistry.bin instead of WeaponInfoTable, unless the rows changed since it was saved"));
+
+void UTopDownGameInstance::Init()
+{
+	Super::Init();
+
+	WeaponRegistry = NewObject<UWeaponRegistry>(this, TEXT("WeaponRegistry"));
+
+	const bool bLoadCache = IsDedicatedServerInstance() && CVarUseWeaponRegistryCache.GetValueOnGameThread() > 0;
+	if (!bLoadCache || !WeaponRegistry->LoadCache(UWeaponRegistry::GetDefaultCacheFileName(), WeaponInfoTable))
+	{
+		if (!WeaponInfoTable)
+			UE_LOG(LogTopDown, Warning, TEXT("UTopDownGameInstance::Init - WeaponInfoTable -NULL"));
+
+		WeaponRegistry->Build(WeaponInfoTable);
+	}
+}
 
 bool UTopDownGameInstance::GetWeaponInfoByName(FName NameWeapon, FWeaponInfo& OutInfo)
 {
 	bool bIsFind = false;
-	FWeaponInfo* WeaponInfoRow;
 
-	if (WeaponInfoTable)
+	if (WeaponInfoTable || GetWeaponRegistry()->Num() > 0)
 	{
-		WeaponInfoRow = WeaponInfoTable->FindRow<FWeaponInfo>(NameWeapon, "", false);
-		if (WeaponInfoRow)
+		const FWeaponDefinition* WeaponDefinition = FindWeaponDefinition(NameWeapon);
+		if (WeaponDefinition)
 		{
 			bIsFind = true;
-			OutInfo = *WeaponInfoRow;
+			OutInfo = WeaponDefinition->Info;
 		}
 	}
 	else
@@ -26,3 +47,18 @@ bool UTopDownGameInstance::GetWeaponInfoByName(FName NameWeapon, FWeaponInfo& Ou
 	return bIsFind;
 }
 
+UWeaponRegistry* UTopDownGameInstance::GetWeaponRegistry()
+{
+	if (!WeaponRegistry)
+	{
+		WeaponRegistry = NewObject<UWeaponRegistry>(this, TEXT("WeaponRegistry"));
+		WeaponRegistry->Build(WeaponInfoTable);
+	}
+
+	return WeaponRegistry;
+}
+
+const FWeaponDefinition* UTopDownGameInstance::FindWeaponDefinition(FName NameWeapon)
+{
+	return GetWeaponRegistry()->FindDefinition(NameWeapon);
+}
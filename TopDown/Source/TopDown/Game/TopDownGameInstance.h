@@ -7,6 +7,7 @@
 #include "../FuncLibrary/MyTypes.h"
 #include "Engine/DataTable.h"
 #include "../WeaponDefault.h"
+#include "WeaponRegistry.h"
 #include "TopDownGameInstance.generated.h"
 
 UCLASS()
@@ -16,10 +17,20 @@ class UTopDownGameInstance : public UGameInstance
 
 
 public:
+	virtual void Init() override;
+
 	//table
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = " WeaponSetting ")
 	UDataTable* WeaponInfoTable = nullptr;
 
 	UFUNCTION(BlueprintCallable)
 	bool GetWeaponInfoByName(FName NameWeapon, FWeaponInfo& OutInfo);
-};
\ No newline at end of file
+
+	//built in Init, with TopDown.WeaponRegistry.UseCache dedicated servers load it from the cache in Saved/ when it matches WeaponInfoTable
+	UWeaponRegistry* GetWeaponRegistry();
+	const FWeaponDefinition* FindWeaponDefinition(FName NameWeapon);
+
+protected:
+	UPROPERTY()
+	UWeaponRegistry* WeaponRegistry = nullptr;
+};
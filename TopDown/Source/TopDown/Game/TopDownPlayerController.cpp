@@ -11,6 +11,8 @@
 #include "InputActionValue.h"
 #include "EnhancedInputSubsystems.h"
 #include "Engine/LocalPlayer.h"
+#include "TopDown/Subsystem/TopDownFXSubsystem.h"
+#include "TopDown/FuncLibrary/TopDownDebugDraw.h"
 
 DEFINE_LOG_CATEGORY(LogTemplateCharacter);
 
@@ -88,6 +90,7 @@ void ATopDownPlayerController::OnSetDestinationTriggered()
 	{
 		CachedDestination = Hit.Location;
 	}
+	TOPDOWN_DEBUG_SPHERE(Cursor, GetWorld(), CachedDestination, 16.0f, 8, bHitSuccessful ? FColor::Green : FColor::Red, 0.0f);
 	
 	// Move towards mouse pointer or touch
 	APawn* ControlledPawn = GetPawn();
@@ -105,7 +108,8 @@ void ATopDownPlayerController::OnSetDestinationReleased()
 	{
 		// We move there and spawn some particles
 		UAIBlueprintHelperLibrary::SimpleMoveToLocation(this, CachedDestination);
-		UNiagaraFunctionLibrary::SpawnSystemAtLocation(this, FXCursor, CachedDestination, FRotator::ZeroRotator, FVector(1.f, 1.f, 1.f), true, true, ENCPoolMethod::None, true);
+		if (UTopDownFXSubsystem* FX = GetWorld()->GetSubsystem<UTopDownFXSubsystem>())
+			FX->SpawnNiagaraAtLocation(FXCursor, CachedDestination, FRotator::ZeroRotator, FVector(1.f, 1.f, 1.f));
 	}
 
 	FollowTime = 0.f;
@@ -0,0 +1,368 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "WeaponRegistry.h"
+#include "Engine/AssetManager.h"
+#include "Engine/DataTable.h"
+#include "Engine/GameInstance.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "Serialization/ObjectAndNameAsStringProxyArchive.h"
+#include "TopDown/TopDown.h"
+#include "TopDown/Game/TopDownGameInstance.h"
+
+//bump when the cache layout changes, edited rows are caught by the source hash
+static constexpr int32 WeaponRegistryCacheVersion = 4;
+static constexpr uint32 WeaponRegistryCacheMagic = 0x57524547;
+
+static FAutoConsoleCommandWithWorld SaveWeaponRegistryCacheCommand(
+	TEXT("TopDown.WeaponRegistry.SaveCache"),
+	TEXT("Saves the weapon registry built from WeaponInfoTable to Saved/, dedicated servers load it instead of the table"),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* World)
+	{
+		UTopDownGameInstance* GameInstance = World ? Cast<UTopDownGameInstance>(World->GetGameInstance()) : nullptr;
+		if (GameInstance)
+			GameInstance->GetWeaponRegistry()->SaveCache(UWeaponRegistry::GetDefaultCacheFileName());
+	}));
+
+static FAutoConsoleCommandWithWorld WeaponRegistryMemReportCommand(
+	TEXT("TopDown.WeaponRegistry.MemReport"),
+	TEXT("Logs which weapon assets are streamed in and their size"),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* World)
+	{
+		UTopDownGameInstance* GameInstance = World ? Cast<UTopDownGameInstance>(World->GetGameInstance()) : nullptr;
+		if (GameInstance)
+			GameInstance->GetWeaponRegistry()->DumpMemoryReport();
+	}));
+
+void UWeaponRegistry::Build(const UDataTable* WeaponInfoTable)
+{
+	LLM_SCOPE_BYTAG(TopDown_WeaponDefinitions);
+
+	Definitions.Reset();
+	SourceHash = ComputeSourceHash(WeaponInfoTable);
+
+	if (!WeaponInfoTable)
+	{
+		FinishDefinitions();
+		return;
+	}
+
+	Definitions.Reserve(WeaponInfoTable->GetRowMap().Num());
+
+	WeaponInfoTable->ForeachRow<FWeaponInfo>(TEXT("UWeaponRegistry::Build"), [this](const FName& RowName, const FWeaponInfo& Row)
+	{
+		FWeaponDefinition Definition;
+		Definition.Name = RowName;
+		Definition.Info = Row;
+
+		if (ValidateDefinition(Definition))
+			Definitions.Add(MoveTemp(Definition));
+	});
+
+	FinishDefinitions();
+
+	UE_LOG(LogTopDown, Log, TEXT("UWeaponRegistry::Build - %d weapons"), Definitions.Num());
+}
+
+bool UWeaponRegistry::ValidateDefinition(FWeaponDefinition& Definition)
+{
+	FWeaponInfo& Info = Definition.Info;
+
+	if (!Info.WeaponClass)
+	{
+		UE_LOG(LogTopDown, Warning, TEXT("UWeaponRegistry::ValidateDefinition - %s has no WeaponClass, skipped"), *Definition.Name.ToString());
+		return false;
+	}
+
+	if (Info.RateOfFire <= 0.0f)
+	{
+		UE_LOG(LogTopDown, Warning, TEXT("UWeaponRegistry::ValidateDefinition - %s RateOfFire %f, clamped"), *Definition.Name.ToString(), Info.RateOfFire);
+		Info.RateOfFire = KINDA_SMALL_NUMBER;
+	}
+
+	if (Info.MaxRound <= 0)
+	{
+		UE_LOG(LogTopDown, Warning, TEXT("UWeaponRegistry::ValidateDefinition - %s MaxRound %d, clamped"), *Definition.Name.ToString(), Info.MaxRound);
+		Info.MaxRound = 1;
+	}
+
+	if (Info.NumberProjectileByShot <= 0)
+	{
+		UE_LOG(LogTopDown, Warning, TEXT("UWeaponRegistry::ValidateDefinition - %s NumberProjectileByShot %d, clamped"), *Definition.Name.ToString(), Info.NumberProjectileByShot);
+		Info.NumberProjectileByShot = 1;
+	}
+
+	if (Info.ProjectileSetting.Projectile && Info.ProjectileSetting.ProjectileInitSpeed <= 0.0f)
+	{
+		UE_LOG(LogTopDown, Warning, TEXT("UWeaponRegistry::ValidateDefinition - %s projectile doesn't move, ProjectileInitSpeed %f"), *Definition.Name.ToString(), Info.ProjectileSetting.ProjectileInitSpeed);
+	}
+
+	return true;
+}
+
+void UWeaponRegistry::FinishDefinitions()
+{
+	NameToIndex.Reset();
+	NameToIndex.Reserve(Definitions.Num());
+
+	for (int32 Index = 0; Index < Definitions.Num(); Index++)
+	{
+		FWeaponDefinition& Definition = Definitions[Index];
+		Definition.Handle.Index = Index;
+
+		NameToIndex.Add(Definition.Name, Index);
+	}
+}
+
+uint32 UWeaponRegistry::ComputeSourceHash(const UDataTable* WeaponInfoTable)
+{
+	if (!WeaponInfoTable || !WeaponInfoTable->GetRowStruct() || !WeaponInfoTable->GetRowStruct()->IsChildOf(FWeaponInfo::StaticStruct()))
+		return 0;
+
+	//tagged serialization, property names are hashed too and a changed FWeaponInfo layout invalidates the cache as well
+	TArray<uint8> Bytes;
+	FMemoryWriter Writer(Bytes, true);
+	FObjectAndNameAsStringProxyArchive Ar(Writer, false);
+
+	for (const TPair<FName, uint8*>& Row : WeaponInfoTable->GetRowMap())
+	{
+		FName RowName = Row.Key;
+		Ar << RowName;
+		FWeaponInfo::StaticStruct()->SerializeItem(Ar, Row.Value, nullptr);
+	}
+
+	return FCrc::MemCrc32(Bytes.GetData(), Bytes.Num());
+}
+
+FString UWeaponRegistry::GetDefaultCacheFileName()
+{
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("WeaponRegistry.bin"));
+}
+
+bool UWeaponRegistry::SaveCache(const FString& FileName) const
+{
+	TArray<uint8> Bytes;
+	FMemoryWriter Writer(Bytes, true);
+	//asset references are written as paths and loaded back by path
+	FObjectAndNameAsStringProxyArchive Ar(Writer, false);
+
+	uint32 Magic = WeaponRegistryCacheMagic;
+	int32 Version = WeaponRegistryCacheVersion;
+	uint32 Hash = SourceHash;
+	int32 NumDefinitions = Definitions.Num();
+	Ar << Magic << Version << Hash << NumDefinitions;
+
+	for (const FWeaponDefinition& Definition : Definitions)
+	{
+		FWeaponDefinition::StaticStruct()->SerializeItem(Ar, const_cast<FWeaponDefinition*>(&Definition), nullptr);
+	}
+
+	if (!FFileHelper::SaveArrayToFile(Bytes, *FileName))
+	{
+		UE_LOG(LogTopDown, Warning, TEXT("UWeaponRegistry::SaveCache - can't write %s"), *FileName);
+		return false;
+	}
+
+	UE_LOG(LogTopDown, Log, TEXT("UWeaponRegistry::SaveCache - %d weapons, %d bytes to %s"), NumDefinitions, Bytes.Num(), *FileName);
+	return true;
+}
+
+bool UWeaponRegistry::LoadCache(const FString& FileName, const UDataTable* SourceTable)
+{
+	LLM_SCOPE_BYTAG(TopDown_WeaponDefinitions);
+
+	TArray<uint8> Bytes;
+	if (!FFileHelper::LoadFileToArray(Bytes, *FileName, FILEREAD_Silent))
+		return false;
+
+	FMemoryReader Reader(Bytes, true);
+	FObjectAndNameAsStringProxyArchive Ar(Reader, true);
+
+	uint32 Magic = 0;
+	int32 Version = 0;
+	uint32 Hash = 0;
+	int32 NumDefinitions = 0;
+	Ar << Magic << Version << Hash << NumDefinitions;
+
+	if (Magic != WeaponRegistryCacheMagic || Version != WeaponRegistryCacheVersion || NumDefinitions < 0)
+	{
+		UE_LOG(LogTopDown, Warning, TEXT("UWeaponRegistry::LoadCache - %s is outdated, ignored"), *FileName);
+		return false;
+	}
+
+	//without the table the cache is all there is
+	const uint32 ExpectedHash = ComputeSourceHash(SourceTable);
+	if (SourceTable && Hash != ExpectedHash)
+	{
+		UE_LOG(LogTopDown, Warning, TEXT("UWeaponRegistry::LoadCache - %s was saved from other rows of %s, ignored"), *FileName, *SourceTable->GetName());
+		return false;
+	}
+
+	Definitions.Reset(NumDefinitions);
+	for (int32 Index = 0; Index < NumDefinitions && !Ar.IsError(); Index++)
+	{
+		FWeaponDefinition::StaticStruct()->SerializeItem(Ar, &Definitions.AddDefaulted_GetRef(), nullptr);
+	}
+
+	if (Ar.IsError())
+	{
+		UE_LOG(LogTopDown, Warning, TEXT("UWeaponRegistry::LoadCache - %s is corrupted, ignored"), *FileName);
+		Definitions.Reset();
+		return false;
+	}
+
+	SourceHash = Hash;
+	FinishDefinitions();
+
+	UE_LOG(LogTopDown, Log, TEXT("UWeaponRegistry::LoadCache - %d weapons from %s"), Definitions.Num(), *FileName);
+	return true;
+}
+
+FWeaponHandle UWeaponRegistry::FindWeaponHandle(FName WeaponName) const
+{
+	FWeaponHandle Handle;
+	if (const int32* Index = NameToIndex.Find(WeaponName))
+		Handle.Index = *Index;
+
+	return Handle;
+}
+
+const FWeaponDefinition* UWeaponRegistry::FindDefinition(FName WeaponName) const
+{
+	const FWeaponHandle Handle = FindWeaponHandle(WeaponName);
+	return Handle.IsValid() ? &GetDefinition(Handle) : nullptr;
+}
+
+void UWeaponRegistry::GatherWeaponAssets(const FWeaponInfo& Info, bool bCosmetics, TArray<FSoftObjectPath>& OutAssets)
+{
+	auto AddAsset = [&OutAssets](const auto& Asset)
+	{
+		if (!Asset.IsNull())
+			OutAssets.AddUnique(Asset.ToSoftObjectPath());
+	};
+
+	//montages drive reload on the server too
+	AddAsset(Info.AnimCharFire);
+	AddAsset(Info.AnimCharReload);
+
+	if (!bCosmetics)
+		return;
+
+	AddAsset(Info.SoundFireWeapon);
+	AddAsset(Info.SoundFireLoop);
+	AddAsset(Info.SoundReloadWeapon);
+	AddAsset(Info.EffectFireWeapon);
+	AddAsset(Info.MagazineDrop);
+	AddAsset(Info.ShellBullets);
+
+	for (const TPair<TEnumAsByte<EPhysicalSurface>, TSoftObjectPtr<UMaterialInterface>>& Decal : Info.HitScanDecals)
+		AddAsset(Decal.Value);
+
+	const FProjectileInfo& Projectile = Info.ProjectileSetting;
+	AddAsset(Projectile.HitSound);
+	AddAsset(Projectile.ExploseFX);
+	AddAsset(Projectile.ExploseSound);
+
+	for (const TPair<TEnumAsByte<EPhysicalSurface>, TSoftObjectPtr<UMaterialInterface>>& Decal : Projectile.HitDecals)
+		AddAsset(Decal.Value);
+
+	for (const TPair<TEnumAsByte<EPhysicalSurface>, TSoftObjectPtr<UParticleSystem>>& FX : Projectile.HitFXs)
+		AddAsset(FX.Value);
+
+	for (const TPair<TEnumAsByte<EPhysicalSurface>, TSoftObjectPtr<UNiagaraSystem>>& BatchedFX : Projectile.HitBatchedFXs)
+		AddAsset(BatchedFX.Value);
+}
+
+void UWeaponRegistry::LoadWeaponAssets(FWeaponHandle Handle, FStreamableDelegate OnLoaded)
+{
+	if (!Definitions.IsValidIndex(Handle.Index))
+		return;
+
+	FWeaponDefinition& Definition = Definitions[Handle.Index];
+
+	if (Definition.AreAssetsLoaded())
+	{
+		OnLoaded.ExecuteIfBound();
+		return;
+	}
+
+	Definition.OnAssetsLoaded.Add(OnLoaded);
+
+	//already streaming for another weapon
+	if (Definition.AssetsHandle.IsValid())
+		return;
+
+	TArray<FSoftObjectPath> Assets;
+	GatherWeaponAssets(Definition.Info, !IsRunningDedicatedServer(), Assets);
+
+	if (Assets.Num() == 0)
+	{
+		OnWeaponAssetsLoaded(Handle.Index);
+		return;
+	}
+
+	Definition.AssetsHandle = UAssetManager::GetStreamableManager().RequestAsyncLoad(Assets, FStreamableDelegate::CreateUObject(this, &UWeaponRegistry::OnWeaponAssetsLoaded, Handle.Index), FStreamableManager::AsyncLoadHighPriority);
+}
+
+void UWeaponRegistry::OnWeaponAssetsLoaded(int32 Index)
+{
+	LLM_SCOPE_BYTAG(TopDown_WeaponDefinitions);
+
+	if (!Definitions.IsValidIndex(Index) || Definitions[Index].AreAssetsLoaded())
+		return;
+
+	FWeaponDefinition& Definition = Definitions[Index];
+
+	//soft references resolve now, unloaded cosmetics stay null in the tables.
+	//The handle moves into the tables, whoever pins them in a callback keeps the assets resident
+	const TSharedPtr<FStreamableHandle> AssetsHandle = MoveTemp(Definition.AssetsHandle);
+	const TSharedRef<const FSurfaceImpactTable> ProjectileImpacts = FSurfaceImpactTable::Compile(Definition.Info.ProjectileSetting, AssetsHandle);
+	const TSharedRef<const FSurfaceImpactTable> HitScanImpacts = FSurfaceImpactTable::Compile(Definition.Info.HitScanDecals, AssetsHandle);
+	Definition.ProjectileImpacts = ProjectileImpacts;
+	Definition.HitScanImpacts = HitScanImpacts;
+
+	TArray<FStreamableDelegate> Callbacks = MoveTemp(Definition.OnAssetsLoaded);
+	for (FStreamableDelegate& Callback : Callbacks)
+	{
+		Callback.ExecuteIfBound();
+	}
+}
+
+void UWeaponRegistry::DumpMemoryReport() const
+{
+	const bool bCosmetics = !IsRunningDedicatedServer();
+	int64 TotalBytes = 0;
+	int32 TotalLoaded = 0;
+
+	UE_LOG(LogTopDown, Display, TEXT("Weapon assets (%s):"), bCosmetics ? TEXT("all") : TEXT("gameplay only"));
+
+	for (const FWeaponDefinition& Definition : Definitions)
+	{
+		TArray<FSoftObjectPath> Assets;
+		GatherWeaponAssets(Definition.Info, bCosmetics, Assets);
+
+		int32 NumLoaded = 0;
+		int64 Bytes = 0;
+		for (const FSoftObjectPath& Asset : Assets)
+		{
+			if (UObject* Object = Asset.ResolveObject())
+			{
+				NumLoaded++;
+				Bytes += Object->GetResourceSizeBytes(EResourceSizeMode::EstimatedTotal);
+			}
+		}
+
+		const TCHAR* State = Definition.AreAssetsLoaded() ? TEXT("loaded") : Definition.AssetsHandle.IsValid() ? TEXT("loading") : TEXT("not loaded");
+		UE_LOG(LogTopDown, Display, TEXT("  %s: %s, %d/%d assets resident, %.1f KB"), *Definition.Name.ToString(), State, NumLoaded, Assets.Num(), Bytes / 1024.0);
+
+		TotalBytes += Bytes;
+		TotalLoaded += NumLoaded;
+	}
+
+	UE_LOG(LogTopDown, Display, TEXT("  total: %d assets resident, %.1f KB"), TotalLoaded, TotalBytes / 1024.0);
+}
@@ -0,0 +1,92 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Object.h"
+#include "Engine/StreamableManager.h"
+#include "FuncLibrary/MyTypes.h"
+#include "WeaponRegistry.generated.h"
+
+//Index of a definition in UWeaponRegistry, stays valid while the game instance lives
+USTRUCT(BlueprintType)
+struct FWeaponHandle
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	int32 Index = INDEX_NONE;
+
+	bool IsValid() const { return Index != INDEX_NONE; }
+};
+
+//One WeaponInfoTable row, never changed after the registry is built.
+//Weapons and their projectiles point into it instead of copying FWeaponInfo
+USTRUCT()
+struct FWeaponDefinition
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	FName Name;
+	UPROPERTY()
+	FWeaponInfo Info;
+
+	FWeaponHandle Handle;
+	//compiled once the assets are loaded and owned by the weapons, projectiles and bullet types using them.
+	//They hold the streamable handle, the assets are released with the last of them
+	TWeakPtr<const FSurfaceImpactTable> ProjectileImpacts;
+	TWeakPtr<const FSurfaceImpactTable> HitScanImpacts;
+
+	//only while streaming, moved into the impact tables then
+	TSharedPtr<FStreamableHandle> AssetsHandle;
+	TArray<FStreamableDelegate> OnAssetsLoaded;
+
+	bool AreAssetsLoaded() const { return ProjectileImpacts.IsValid(); }
+};
+
+//Weapon definitions of the game, owned by UTopDownGameInstance.
+//Built from WeaponInfoTable or loaded from a binary cache in Saved/
+UCLASS()
+class UWeaponRegistry : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	void Build(const UDataTable* WeaponInfoTable);
+
+	bool SaveCache(const FString& FileName) const;
+	//false if the file is missing, outdated or was saved from other rows than SourceTable has now
+	bool LoadCache(const FString& FileName, const UDataTable* SourceTable);
+	static FString GetDefaultCacheFileName();
+	//CRC of the row names and values of the table, 0 without one
+	static uint32 ComputeSourceHash(const UDataTable* WeaponInfoTable);
+
+	FWeaponHandle FindWeaponHandle(FName WeaponName) const;
+	const FWeaponDefinition& GetDefinition(FWeaponHandle Handle) const { return Definitions[Handle.Index]; }
+	const FWeaponDefinition* FindDefinition(FName WeaponName) const;
+	//nullptr for an invalid handle or one from before a rebuild that has fewer weapons
+	const FWeaponDefinition* FindDefinition(FWeaponHandle Handle) const { return Definitions.IsValidIndex(Handle.Index) ? &Definitions[Handle.Index] : nullptr; }
+	int32 Num() const { return Definitions.Num(); }
+
+	//streams the soft referenced assets of the weapon, OnLoaded runs once they are resident.
+	//Pin the impact tables of the definition in OnLoaded to keep them so
+	void LoadWeaponAssets(FWeaponHandle Handle, FStreamableDelegate OnLoaded);
+	//dedicated servers skip sounds, FX, decals and cosmetic meshes
+	static void GatherWeaponAssets(const FWeaponInfo& Info, bool bCosmetics, TArray<FSoftObjectPath>& OutAssets);
+	void DumpMemoryReport() const;
+
+protected:
+	//false if the row can't be used, fixable values are clamped
+	static bool ValidateDefinition(FWeaponDefinition& Definition);
+	//handles, name map and impact tables of the definitions
+	void FinishDefinitions();
+	void OnWeaponAssetsLoaded(int32 Index);
+
+	//reallocated by Build and LoadCache, weapons keep handles instead of addresses
+	UPROPERTY()
+	TArray<FWeaponDefinition> Definitions;
+	TMap<FName, int32> NameToIndex;
+	//ComputeSourceHash of the table the definitions were built from, written to the cache
+	uint32 SourceHash = 0;
+};
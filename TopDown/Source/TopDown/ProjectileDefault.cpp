@@ -2,14 +2,22 @@
 
 
 #include "ProjectileDefault.h"
+#include "TopDown.h"
+#include "FuncLibrary/TopDownAllocCounter.h"
 #include "PhysicalMaterials/PhysicalMaterial.h"
 #include "Kismet/GameplayStatics.h"
+#include "TimerManager.h"
+#include "Subsystem/ProjectilePoolSubsystem.h"
+#include "Subsystem/TopDownFXSubsystem.h"
+#include "Subsystem/DecalManagerSubsystem.h"
+#include "Subsystem/ImpactRendererSubsystem.h"
+#include "Subsystem/WeaponAudioSubsystem.h"
 
 // Sets default values
 AProjectileDefault::AProjectileDefault()
 {
-	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
-	PrimaryActorTick.bCanEverTick = true;
+	//movement and hits come from the components, the actor itself has nothing to tick
+	PrimaryActorTick.bCanEverTick = false;
 
 	BulletCollisionSphere = CreateDefaultSubobject<USphereComponent>(TEXT("Collision Sphere"));
 
@@ -49,55 +57,45 @@ void AProjectileDefault::BeginPlay()
 	BulletCollisionSphere->OnComponentEndOverlap.AddDynamic(this, &AProjectileDefault::BulletCollisionSphereEndOverlap);
 }
 
-// Called every frame
-void AProjectileDefault::Tick(float DeltaTime)
-{
-	Super::Tick(DeltaTime);
-
-}
-
-void AProjectileDefault::InitProjectile(FProjectileInfo InitParam)
+void AProjectileDefault::InitProjectile(const FProjectileInfo& InitParam, TSharedPtr<const FSurfaceImpactTable> InImpactTable)
 {
 	BulletProjectileMovement->InitialSpeed = InitParam.ProjectileInitSpeed;
 	BulletProjectileMovement->MaxSpeed = InitParam.ProjectileInitSpeed;
 
-	UE_LOG(LogTemp, Warning, TEXT("AProjectileDefault::InitProjectile %f %f"), InitParam.ProjectileInitSpeed, InitParam.ProjectileInitSpeed);
+	UE_LOG(LogTopDownVerbose, Verbose, TEXT("AProjectileDefault::InitProjectile %f %f"), InitParam.ProjectileInitSpeed, InitParam.ProjectileInitSpeed);
+
+	//launch again, a pooled projectile keeps the velocity it was stopped with
+	BulletProjectileMovement->SetUpdatedComponent(RootComponent);
+	BulletProjectileMovement->Velocity = GetActorForwardVector() * InitParam.ProjectileInitSpeed;
+	BulletProjectileMovement->UpdateComponentVelocity();
+	BulletProjectileMovement->Activate(true);
 
-	this->SetLifeSpan(InitParam.ProjectileLifeTime);
+	//lifetime ends in the pool instead of Destroy
+	GetWorldTimerManager().SetTimer(LifeTimeTimerHandle, this, &AProjectileDefault::ReturnToPool, InitParam.ProjectileLifeTime, false);
 
-	ProjectileSetting = InitParam;
+	ProjectileSetting.ProjectileDamage = InitParam.ProjectileDamage;
+	ProjectileSetting.ExploseFX = InitParam.ExploseFX.Get();
+	ProjectileSetting.ExploseSound = InitParam.ExploseSound.Get();
+	ProjectileSetting.ProjectileMaxRadiusDamage = InitParam.ProjectileMaxRadiusDamage;
+	ProjectileSetting.ExploseMaxDamage = InitParam.ExploseMaxDamage;
+	ProjectileSetting.ExploseDecreaseRelativeCenter = InitParam.ExploseDecreaseRelativeCenter;
+	ProjectileSetting.ExploseDistanceMaxDamage = InitParam.ExploseDistanceMaxDamage;
+	bHasProjectileSetting = true;
+
+	//compiled here only for projectiles spawned without a weapon
+	ImpactTable = InImpactTable.IsValid() ? InImpactTable : TSharedPtr<const FSurfaceImpactTable>(FSurfaceImpactTable::Compile(InitParam));
 }
 
 void AProjectileDefault::BulletCollisionSphereHit(UPrimitiveComponent* HitComp, AActor* OtherActor, UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit)
 {
-	if (OtherActor && Hit.PhysMaterial.IsValid())
-	{
-		EPhysicalSurface mySurfacetype = UGameplayStatics::GetSurfaceType(Hit);
-
-		if (ProjectileSetting.HitDecals.Contains(mySurfacetype))
-		{
-			UMaterialInterface* myMaterial = ProjectileSetting.HitDecals[mySurfacetype];
-
-			if (myMaterial && OtherComp)
-			{
-				UGameplayStatics::SpawnDecalAttached(myMaterial, FVector(20.0f), OtherComp, NAME_None, Hit.ImpactPoint, Hit.ImpactNormal.Rotation(), EAttachLocation::KeepWorldPosition, 10.0f);
-			}
-		}
-		if (ProjectileSetting.HitFXs.Contains(mySurfacetype))
-		{
-			UParticleSystem* myParticle = ProjectileSetting.HitFXs[mySurfacetype];
-			if (myParticle)
-			{
-				UGameplayStatics::SpawnEmitterAtLocation(GetWorld(), myParticle, FTransform(Hit.ImpactNormal.Rotation(), Hit.ImpactPoint, FVector(1.0f)));
-			}
-		}
-		if (ProjectileSetting.HitSound)
-		{
-			UGameplayStatics::PlaySoundAtLocation(GetWorld(), ProjectileSetting.HitSound, Hit.ImpactPoint);
-		}
+	TOPDOWN_ALLOC_SCOPE(BulletCollisionSphereHit);
 
+	if (OtherActor && Hit.PhysMaterial.IsValid() && ImpactTable.IsValid())
+	{
+		SpawnHitEffects(GetWorld(), *ImpactTable, Hit);
 	}
-	UGameplayStatics::ApplyDamage(OtherActor, ProjectileSetting.ProjectileDamage, GetInstigatorController(), this, NULL);
+	if (bHasProjectileSetting)
+		UGameplayStatics::ApplyDamage(OtherActor, ProjectileSetting.ProjectileDamage, GetInstigatorController(), this, NULL);
 	ImpactProjectile();
 	//UGameplayStatics::ApplyRadialDamageWithFalloff()
 	//Apply damage cast to if char like bp? //OnAnyTakeDmage delegate
@@ -106,6 +104,32 @@ void AProjectileDefault::BulletCollisionSphereHit(UPrimitiveComponent* HitComp,
 
 }
 
+void AProjectileDefault::SpawnHitEffects(UWorld* World, const FSurfaceImpactTable& Impacts, const FHitResult& Hit)
+{
+	const FSurfaceImpact& Impact = Impacts.GetImpact(UGameplayStatics::GetSurfaceType(Hit));
+
+	UDecalManagerSubsystem* DecalManager = World && Impact.Decal ? World->GetSubsystem<UDecalManagerSubsystem>() : nullptr;
+	if (DecalManager)
+	{
+		DecalManager->AddDecal(Impact.Decal, UGameplayStatics::GetSurfaceType(Hit), Hit);
+	}
+	UImpactRendererSubsystem* ImpactRenderer = World && Impact.BatchedFX ? World->GetSubsystem<UImpactRendererSubsystem>() : nullptr;
+	UTopDownFXSubsystem* FX = World ? World->GetSubsystem<UTopDownFXSubsystem>() : nullptr;
+	if (ImpactRenderer)
+	{
+		ImpactRenderer->AddImpact(Impact.BatchedFX, Hit.ImpactPoint, Hit.ImpactNormal);
+	}
+	else if (Impact.FX && FX)
+	{
+		FX->SpawnCascadeAtLocation(Impact.FX, FTransform(Hit.ImpactNormal.Rotation(), Hit.ImpactPoint, FVector(1.0f)));
+	}
+	UWeaponAudioSubsystem* Audio = World && Impact.Sound ? World->GetSubsystem<UWeaponAudioSubsystem>() : nullptr;
+	if (Audio)
+	{
+		Audio->PlaySoundAtLocation(Impact.Sound, Hit.ImpactPoint, UWeaponAudioSubsystem::PriorityImpact);
+	}
+}
+
 void AProjectileDefault::BulletCollisionSphereBeginOverlap(UPrimitiveComponent* OverlappedComponent, AActor* OtherActor, UPrimitiveComponent* OtherComp, int32 OtherBodyIndex, bool bFromSweep, const FHitResult& SweepResult)
 {
 }
@@ -116,8 +140,48 @@ void AProjectileDefault::BulletCollisionSphereEndOverlap(UPrimitiveComponent* Ov
 
 void AProjectileDefault::ImpactProjectile()
 {
-	UE_LOG(LogTemp, Warning, TEXT("ImpactProjectile"));
-	//this->Destroy();
+	UE_LOG(LogTopDownVerbose, Verbose, TEXT("AProjectileDefault::ImpactProjectile"));
+	ReturnToPool();
+}
+
+void AProjectileDefault::OnAcquiredFromPool()
+{
+	bInPool = false;
+
+	SetActorHiddenInGame(false);
+	SetActorEnableCollision(true);
+
+	if (BulletFX && BulletFX->Template)
+		BulletFX->Activate(true);
+}
+
+void AProjectileDefault::OnReleasedToPool()
+{
+	bInPool = true;
+
+	GetWorldTimerManager().ClearTimer(LifeTimeTimerHandle);
+
+	BulletProjectileMovement->StopMovementImmediately();
+	BulletProjectileMovement->Deactivate();
+
+	if (BulletFX)
+		BulletFX->DeactivateImmediate();
+
+	SetActorHiddenInGame(true);
+	SetActorEnableCollision(false);
+
+	ProjectileSetting = FProjectileRuntimeSetting();
+	bHasProjectileSetting = false;
+	ImpactTable.Reset();
+}
+
+void AProjectileDefault::ReturnToPool()
+{
+	UProjectilePoolSubsystem* Pool = GetWorld() ? GetWorld()->GetSubsystem<UProjectilePoolSubsystem>() : nullptr;
+	if (Pool)
+		Pool->ReleaseProjectile(this);
+	else
+		this->Destroy();
 }
 
 
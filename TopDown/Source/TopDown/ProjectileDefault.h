@@ -8,6 +8,30 @@
 #include "FuncLibrary/MyTypes.h"
 #include "ProjectileDefault.generated.h"
 
+//What a fired projectile needs of FProjectileInfo, copied at InitProjectile since a rebuilt UWeaponRegistry moves the definition
+USTRUCT()
+struct FProjectileRuntimeSetting
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	float ProjectileDamage = 0.0f;
+
+	//grenade
+	UPROPERTY()
+	class UParticleSystem* ExploseFX = nullptr;
+	UPROPERTY()
+	class USoundBase* ExploseSound = nullptr;
+	UPROPERTY()
+	float ProjectileMaxRadiusDamage = 0.0f;
+	UPROPERTY()
+	float ExploseMaxDamage = 0.0f;
+	UPROPERTY()
+	float ExploseDecreaseRelativeCenter = 0.0f;
+	UPROPERTY()
+	float ExploseDistanceMaxDamage = 0.0f;
+};
+
 UCLASS()
 class AProjectileDefault : public AActor
 {
@@ -26,17 +50,20 @@ public:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, meta = (AllowPrivateAccess = "true"), Category = Components)
 	class UParticleSystemComponent* BulletFX = nullptr;
 
-	FProjectileInfo ProjectileSetting;
+	//copied from the definition of the weapon that fired it, valid while bHasProjectileSetting
+	UPROPERTY()
+	FProjectileRuntimeSetting ProjectileSetting;
+	bool bHasProjectileSetting = false;
+	//compiled from the projectile info, shared with the weapon that fired it
+	TSharedPtr<const FSurfaceImpactTable> ImpactTable;
 
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
 public:
-	// Called every frame
-	virtual void Tick(float DeltaTime) override;
-
-	void InitProjectile(FProjectileInfo InitParam);
+	//copies what it needs of InitParam, the explosion assets stay loaded through the impact table of the weapon
+	void InitProjectile(const FProjectileInfo& InitParam, TSharedPtr<const FSurfaceImpactTable> InImpactTable = nullptr);
 	UFUNCTION()
 	virtual void BulletCollisionSphereHit(class UPrimitiveComponent* HitComp, AActor* OtherActor, UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit);
 	UFUNCTION()
@@ -46,6 +73,17 @@ public:
 
 	UFUNCTION()
 	virtual void ImpactProjectile();
+
+	//decal, fx and sound on hit, shared with UBulletSimulationSubsystem and UHitScanSubsystem
+	static void SpawnHitEffects(UWorld* World, const FSurfaceImpactTable& Impacts, const FHitResult& Hit);
+
+	//Pool
+	virtual void OnAcquiredFromPool();
+	virtual void OnReleasedToPool();
+	void ReturnToPool();
+
+	bool bInPool = false;
+	FTimerHandle LifeTimeTimerHandle;
 };
 
 
@@ -2,35 +2,35 @@
 
 
 #include "ProjectileDefault_Grenade.h"
+#include "TopDown.h"
 #include "Kismet/GameplayStatics.h"
-
-void AProjectileDefault_Grenade::BeginPlay()
-{
-	Super::BeginPlay();
-	UE_LOG(LogTemp, Warning, TEXT("BeginPlay AProjectileDefault_Grenade"));
-}
-
-void AProjectileDefault_Grenade::Tick(float DeltaTime)
+#include "Subsystem/TopDownFXSubsystem.h"
+#include "Subsystem/WeaponAudioSubsystem.h"
+#include "Subsystem/RadialDamageSubsystem.h"
+#include "Subsystem/GrenadeFuseSubsystem.h"
+#include "FuncLibrary/TopDownDebugDraw.h"
+#include "FuncLibrary/TopDownAllocCounter.h"
+
+static TAutoConsoleVariable<float> CVarGrenadeSympatheticRadius(
+	TEXT("TopDown.Grenade.SympatheticRadius"),
+	0.0f,
+	TEXT("Armed grenades this close to an explosion go off too, 0 - no sympathetic detonation"));
+
+static TAutoConsoleVariable<float> CVarGrenadeSympatheticDelay(
+	TEXT("TopDown.Grenade.SympatheticDelay"),
+	0.15f,
+	TEXT("Seconds between an explosion and the grenades it sets off"));
+
+AProjectileDefault_Grenade::AProjectileDefault_Grenade()
 {
-	Super::Tick(DeltaTime);
-	TimerExplose(DeltaTime);
+	//the fuse is counted by UGrenadeFuseSubsystem
+	PrimaryActorTick.bCanEverTick = false;
 }
 
-void AProjectileDefault_Grenade::TimerExplose(float DeltaTime)
+void AProjectileDefault_Grenade::BeginPlay()
 {
-	if (TimerEnabled)
-	{
-		if (TimerToExplose > TimeToExplose)
-		{
-			//Explose
-			Explose();
-
-		}
-		else
-		{
-			TimerToExplose += DeltaTime;
-		}
-	}
+	Super::BeginPlay();
+	UE_LOG(LogTopDownVerbose, Verbose, TEXT("BeginPlay AProjectileDefault_Grenade"));
 }
 
 void AProjectileDefault_Grenade::BulletCollisionSphereHit(class UPrimitiveComponent* HitComp, AActor* OtherActor, UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit)
@@ -40,42 +40,71 @@ void AProjectileDefault_Grenade::BulletCollisionSphereHit(class UPrimitiveCompon
 
 void AProjectileDefault_Grenade::ImpactProjectile()
 {
-	UE_LOG(LogTemp, Warning, TEXT("AProjectileDefault_Grenade::ImpactProjectile"));
-	//Init Grenade
-	TimerEnabled = true;
+	UE_LOG(LogTopDownVerbose, Verbose, TEXT("AProjectileDefault_Grenade::ImpactProjectile"));
+	//Init Grenade, later bounces don't restart the fuse
+	if (FuseId != 0)
+		return;
+
+	if (UGrenadeFuseSubsystem* Fuses = GetWorld()->GetSubsystem<UGrenadeFuseSubsystem>())
+		Fuses->ScheduleFuse(this, TimeToExplose);
 }
 
 void AProjectileDefault_Grenade::Explose()
 {
-	UE_LOG(LogTemp, Warning, TEXT("Explose"));
+	TOPDOWN_SCOPE(GrenadeExplose);
+	TOPDOWN_ALLOC_SCOPE(GrenadeExplose);
+
+	UE_LOG(LogTopDownVerbose, Verbose, TEXT("AProjectileDefault_Grenade::Explose"));
 
-	TimerEnabled = false;
+	FuseId = 0;
 
-	if (ProjectileSetting.ExploseFX)
+	if (!bHasProjectileSetting)
 	{
-		UGameplayStatics::SpawnEmitterAtLocation(GetWorld(), ProjectileSetting.ExploseFX, GetActorLocation(), GetActorRotation(), FVector(1.0f));
+		ReturnToPool();
+		return;
 	}
-	if (ProjectileSetting.ExploseSound)
+
+	UTopDownFXSubsystem* FX = GetWorld()->GetSubsystem<UTopDownFXSubsystem>();
+	if (ProjectileSetting.ExploseFX && FX)
+	{
+		FX->SpawnCascadeAtLocation(ProjectileSetting.ExploseFX, FTransform(GetActorRotation(), GetActorLocation(), FVector(1.0f)));
+	}
+	UWeaponAudioSubsystem* Audio = GetWorld()->GetSubsystem<UWeaponAudioSubsystem>();
+	if (ProjectileSetting.ExploseSound && Audio)
 	{
-		UGameplayStatics::PlaySoundAtLocation(GetWorld(), ProjectileSetting.ExploseSound, GetActorLocation());
+		Audio->PlaySoundAtLocation(ProjectileSetting.ExploseSound, GetActorLocation(), UWeaponAudioSubsystem::PriorityExplosion, this);
 	}
 
-	DrawDebugSphere(GetWorld(), GetActorLocation(), ProjectileSetting.ProjectileMaxRadiusDamage, 8, FColor::Yellow, false, 6.0f); //   , +  
+	TOPDOWN_DEBUG_SPHERE(Explosions, GetWorld(), GetActorLocation(), ProjectileSetting.ProjectileMaxRadiusDamage, 8, FColor::Yellow, 6.0f); //   , +  
 
-	DrawDebugSphere(GetWorld(), GetActorLocation(), ProjectileSetting.ExploseDistanceMaxDamage, 8, FColor::Red, false, 6.0f); //      
+	TOPDOWN_DEBUG_SPHERE(Explosions, GetWorld(), GetActorLocation(), ProjectileSetting.ExploseDistanceMaxDamage, 8, FColor::Red, 6.0f); //      
 
-	DrawDebugSphere(GetWorld(), GetActorLocation(), ProjectileSetting.ProjectileMaxRadiusDamage / 2.0f, 8, FColor::Blue, false, 6.0f); //   50%   
+	TOPDOWN_DEBUG_SPHERE(Explosions, GetWorld(), GetActorLocation(), ProjectileSetting.ProjectileMaxRadiusDamage / 2.0f, 8, FColor::Blue, 6.0f); //   50%   
 
 
-	TArray<AActor*> IgnoredActor;
-	UGameplayStatics::ApplyRadialDamageWithFalloff(GetWorld(),
-		ProjectileSetting.ExploseMaxDamage,
-		ProjectileSetting.ExploseMaxDamage * 0.2f,
-		GetActorLocation(),
-		1000.0f,
-		2000.0f,
-		5,
-		NULL, IgnoredActor, nullptr, nullptr);
+	//full damage inside ExploseDistanceMaxDamage, falling off to 20% at ProjectileMaxRadiusDamage
+	if (URadialDamageSubsystem* RadialDamage = GetWorld()->GetSubsystem<URadialDamageSubsystem>())
+	{
+		const FRadialDamageParams DamageParams(ProjectileSetting.ExploseMaxDamage,
+			ProjectileSetting.ExploseMaxDamage * 0.2f,
+			ProjectileSetting.ExploseDistanceMaxDamage,
+			ProjectileSetting.ProjectileMaxRadiusDamage,
+			ProjectileSetting.ExploseDecreaseRelativeCenter);
+
+		RadialDamage->AddExplosion(GetActorLocation(), DamageParams, nullptr, this, GetInstigatorController());
+	}
+
+	//goes off in a later pass of the scheduler, not from inside this call
+	if (UGrenadeFuseSubsystem* Fuses = GetWorld()->GetSubsystem<UGrenadeFuseSubsystem>())
+		Fuses->TriggerSympathetic(GetActorLocation(), CVarGrenadeSympatheticRadius.GetValueOnGameThread(), CVarGrenadeSympatheticDelay.GetValueOnGameThread());
+
+	ReturnToPool();
+}
+
+void AProjectileDefault_Grenade::OnAcquiredFromPool()
+{
+	Super::OnAcquiredFromPool();
 
-	this->Destroy();
+	//a fuse lit before the grenade went back to the pool doesn't match anymore
+	FuseId = 0;
 }
@@ -13,23 +13,23 @@ class AProjectileDefault_Grenade : public AProjectileDefault
 	GENERATED_BODY()
 
 
+public:
+	AProjectileDefault_Grenade();
+
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
 public:
-	// Called every frame
-	virtual void Tick(float DeltaTime) override;
-
-	void TimerExplose(float DeltaTime);
-
 	virtual void BulletCollisionSphereHit(class UPrimitiveComponent* HitComp, AActor* OtherActor, UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit) override;
 
 	virtual void ImpactProjectile() override;
 
 	void Explose();
 
-	bool TimerEnabled = false;
-	float TimerToExplose = 0.0f;
+	virtual void OnAcquiredFromPool() override;
+
+	//set by UGrenadeFuseSubsystem when the fuse is lit on impact, 0 - not armed
+	uint32 FuseId = 0;
 	float TimeToExplose = 3.0f;
 };
@@ -0,0 +1,313 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BulletSimulationSubsystem.h"
+#include "Async/ParallelFor.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Kismet/GameplayStatics.h"
+#include "TopDown/TopDown.h"
+#include "TopDown/FuncLibrary/TopDownAllocCounter.h"
+#include "TopDown/ProjectileDefault.h"
+#include "TopDown/ProjectileDefault_Grenade.h"
+
+DECLARE_CYCLE_STAT(TEXT("Bullet Simulation"), STAT_TopDown_BulletSimulation, STATGROUP_TopDown);
+DECLARE_CYCLE_STAT(TEXT("Bullet Hits"), STAT_TopDown_BulletHits, STATGROUP_TopDown);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Lightweight Bullets"), STAT_TopDown_LightweightBullets, STATGROUP_TopDown);
+TRACE_DECLARE_INT_COUNTER(TopDown_LightweightBullets, TEXT("TopDown/LightweightBullets"));
+
+static TAutoConsoleVariable<int32> CVarForceLightweightProjectiles(
+	TEXT("TopDown.Projectile.Lightweight"),
+	0,
+	TEXT("0 - use bLightweightSimulation from FProjectileInfo, 1 - simulate every non grenade projectile without actors"));
+
+bool UBulletSimulationSubsystem::ShouldUseLightweightSimulation(const FProjectileInfo& Info)
+{
+	return Info.bLightweightSimulation || CVarForceLightweightProjectiles.GetValueOnGameThread() > 0;
+}
+
+bool UBulletSimulationSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void UBulletSimulationSubsystem::Deinitialize()
+{
+	DEC_DWORD_STAT_BY(STAT_TopDown_LightweightBullets, Positions.Num());
+
+	Positions.Empty();
+	Velocities.Empty();
+	LifeTimes.Empty();
+	TypeHandles.Empty();
+	DamageCausers.Empty();
+	Instigators.Empty();
+	IgnoredActors.Empty();
+	Types.Empty();
+	MeshBatches.Empty();
+
+	Super::Deinitialize();
+}
+
+TStatId UBulletSimulationSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UBulletSimulationSubsystem, STATGROUP_TopDown);
+}
+
+int32 UBulletSimulationSubsystem::RegisterProjectileType(FName DefinitionName, const FProjectileInfo& Info, TSharedPtr<const FSurfaceImpactTable> ImpactTable)
+{
+	//grenades need bounce and fuse logic of the actor
+	if (!Info.Projectile || Info.Projectile->IsChildOf(AProjectileDefault_Grenade::StaticClass()))
+		return INDEX_NONE;
+
+	//every weapon of a definition shares its type
+	const int32 Existing = Types.IndexOfByPredicate([DefinitionName](const FLightweightProjectileType& Type) { return Type.DefinitionName == DefinitionName; });
+	if (Existing != INDEX_NONE)
+	{
+		FLightweightProjectileType& Type = Types[Existing];
+		//every user of the type was gone and took the table with it
+		if (!Type.ImpactTable.IsValid())
+			Type.ImpactTable = ImpactTable.IsValid() ? ImpactTable : TSharedPtr<const FSurfaceImpactTable>(FSurfaceImpactTable::Compile(Info));
+		Type.NumUsers++;
+		return Existing;
+	}
+
+	const AProjectileDefault* ProjectileCDO = Info.Projectile->GetDefaultObject<AProjectileDefault>();
+	if (!ProjectileCDO || !ProjectileCDO->BulletCollisionSphere)
+		return INDEX_NONE;
+
+	FLightweightProjectileType& Type = Types.AddDefaulted_GetRef();
+	Type.DefinitionName = DefinitionName;
+	Type.LifeTime = Info.ProjectileLifeTime;
+	Type.Damage = Info.ProjectileDamage;
+	Type.NumUsers = 1;
+	Type.ImpactTable = ImpactTable.IsValid() ? ImpactTable : TSharedPtr<const FSurfaceImpactTable>(FSurfaceImpactTable::Compile(Info));
+	Type.CollisionRadius = ProjectileCDO->BulletCollisionSphere->GetScaledSphereRadius();
+	Type.CollisionChannel = ProjectileCDO->BulletCollisionSphere->GetCollisionObjectType();
+	Type.ResponseParams = FCollisionResponseParams(ProjectileCDO->BulletCollisionSphere->GetCollisionResponseToChannels());
+
+	if (ProjectileCDO->BulletProjectileMovement)
+		Type.GravityScale = ProjectileCDO->BulletProjectileMovement->ProjectileGravityScale;
+
+	if (ProjectileCDO->BulletMesh && GetWorld()->GetNetMode() != NM_DedicatedServer)
+	{
+		Type.MeshRelativeTransform = ProjectileCDO->BulletMesh->GetRelativeTransform();
+		Type.MeshBatch = FindOrAddMeshBatch(ProjectileCDO->BulletMesh->GetStaticMesh());
+	}
+
+	return Types.Num() - 1;
+}
+
+void UBulletSimulationSubsystem::UnregisterProjectileType(int32 TypeHandle)
+{
+	if (Types.IsValidIndex(TypeHandle))
+		ReleaseType(TypeHandle);
+}
+
+void UBulletSimulationSubsystem::ReleaseType(int32 TypeHandle)
+{
+	FLightweightProjectileType& Type = Types[TypeHandle];
+	if (--Type.NumUsers <= 0)
+	{
+		Type.NumUsers = 0;
+		Type.ImpactTable.Reset();
+	}
+}
+
+int32 UBulletSimulationSubsystem::FindOrAddMeshBatch(UStaticMesh* Mesh)
+{
+	LLM_SCOPE_BYTAG(TopDown_Projectiles);
+
+	if (!Mesh)
+		return INDEX_NONE;
+
+	const int32 Found = MeshBatches.IndexOfByPredicate([Mesh](const FLightweightProjectileMeshBatch& Batch) { return Batch.Mesh == Mesh; });
+	if (Found != INDEX_NONE)
+		return Found;
+
+	if (!InstancedMeshHost)
+		InstancedMeshHost = UMyTypes::SpawnInstancedMeshHost(GetWorld(), TEXT("LightweightBullets"));
+
+	UInstancedStaticMeshComponent* InstancedMesh = UMyTypes::AddInstancedMeshComponent(InstancedMeshHost, Mesh);
+	if (!InstancedMesh)
+		return INDEX_NONE;
+
+	InstancedMesh->SetCastShadow(false);
+
+	FLightweightProjectileMeshBatch& Batch = MeshBatches.AddDefaulted_GetRef();
+	Batch.Mesh = Mesh;
+	Batch.InstancedMesh = InstancedMesh;
+
+	return MeshBatches.Num() - 1;
+}
+
+void UBulletSimulationSubsystem::AddBullet(int32 TypeHandle, const FVector& Location, const FVector& Velocity, AActor* DamageCauser, AController* InstigatorController)
+{
+	LLM_SCOPE_BYTAG(TopDown_Projectiles);
+
+	if (!Types.IsValidIndex(TypeHandle))
+		return;
+
+	FLightweightProjectileType& Type = Types[TypeHandle];
+	//a bullet keeps its impact table after the weapon is gone
+	Type.NumUsers++;
+	const float LifeTime = Type.LifeTime;
+
+	Positions.Add(Location);
+	Velocities.Add(Velocity);
+	//zero life time means endless like SetLifeSpan(0)
+	LifeTimes.Add(LifeTime > 0.0f ? LifeTime : MAX_flt);
+	TypeHandles.Add(TypeHandle);
+	DamageCausers.Add(DamageCauser);
+	Instigators.Add(InstigatorController);
+	//weapon is attached to the character shooting it
+	IgnoredActors.Add(DamageCauser ? DamageCauser->GetAttachParentActor() : nullptr);
+
+	INC_DWORD_STAT(STAT_TopDown_LightweightBullets);
+}
+
+void UBulletSimulationSubsystem::Tick(float DeltaTime)
+{
+	if (Positions.Num() > 0)
+	{
+		SimulateBullets(DeltaTime);
+		ApplyHits();
+		RemoveDeadBullets();
+		UpdateInstancedMeshes();
+	}
+
+	TRACE_COUNTER_SET(TopDown_LightweightBullets, Positions.Num());
+}
+
+void UBulletSimulationSubsystem::SimulateBullets(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_TopDown_BulletSimulation);
+
+	UWorld* World = GetWorld();
+	const int32 NumBullets = Positions.Num();
+	const float GravityZ = World->GetGravityZ();
+
+	bHitThisFrame.SetNumZeroed(NumBullets, false);
+	HitResults.SetNum(NumBullets, false);
+
+	//scene queries are read only, same as the async trace tasks
+	ParallelFor(NumBullets, [this, World, DeltaTime, GravityZ](int32 Index)
+	{
+		const FLightweightProjectileType& Type = Types[TypeHandles[Index]];
+
+		const FVector Velocity = Velocities[Index] + FVector(0.0f, 0.0f, GravityZ * Type.GravityScale * DeltaTime);
+		const FVector Start = Positions[Index];
+		const FVector End = Start + Velocity * DeltaTime;
+
+		FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(LightweightBullet), false);
+		QueryParams.bReturnPhysicalMaterial = true;
+		QueryParams.AddIgnoredActor(DamageCausers[Index].Get());
+		QueryParams.AddIgnoredActor(IgnoredActors[Index].Get());
+
+		FHitResult& Hit = HitResults[Index];
+		const bool bHit = World->SweepSingleByChannel(Hit, Start, End, FQuat::Identity, Type.CollisionChannel, FCollisionShape::MakeSphere(Type.CollisionRadius), QueryParams, Type.ResponseParams);
+
+		bHitThisFrame[Index] = bHit;
+		Positions[Index] = bHit ? Hit.Location : End;
+		Velocities[Index] = Velocity;
+		LifeTimes[Index] -= DeltaTime;
+	});
+}
+
+void UBulletSimulationSubsystem::ApplyHits()
+{
+	SCOPE_CYCLE_COUNTER(STAT_TopDown_BulletHits);
+
+	UWorld* World = GetWorld();
+
+	//damage can fire new bullets, they are appended after the simulated ones
+	const int32 NumSimulated = bHitThisFrame.Num();
+	for (int32 i = 0; i < NumSimulated; i++)
+	{
+		if (!bHitThisFrame[i])
+			continue;
+
+		TOPDOWN_ALLOC_SCOPE(BulletHit);
+
+		const FHitResult& Hit = HitResults[i];
+		const FLightweightProjectileType& Type = Types[TypeHandles[i]];
+
+		if (Hit.GetActor() && Hit.PhysMaterial.IsValid() && Type.ImpactTable.IsValid())
+		{
+			AProjectileDefault::SpawnHitEffects(World, *Type.ImpactTable, Hit);
+		}
+		UGameplayStatics::ApplyDamage(Hit.GetActor(), Type.Damage, Instigators[i].Get(), DamageCausers[i].Get(), NULL);
+
+		LifeTimes[i] = 0.0f;
+	}
+}
+
+void UBulletSimulationSubsystem::RemoveDeadBullets()
+{
+	for (int32 i = Positions.Num() - 1; i >= 0; i--)
+	{
+		if (LifeTimes[i] > 0.0f)
+			continue;
+
+		ReleaseType(TypeHandles[i]);
+
+		Positions.RemoveAtSwap(i, 1, false);
+		Velocities.RemoveAtSwap(i, 1, false);
+		LifeTimes.RemoveAtSwap(i, 1, false);
+		TypeHandles.RemoveAtSwap(i, 1, false);
+		DamageCausers.RemoveAtSwap(i, 1, false);
+		Instigators.RemoveAtSwap(i, 1, false);
+		IgnoredActors.RemoveAtSwap(i, 1, false);
+
+		DEC_DWORD_STAT(STAT_TopDown_LightweightBullets);
+	}
+}
+
+void UBulletSimulationSubsystem::UpdateInstancedMeshes()
+{
+	if (MeshBatches.Num() == 0)
+		return;
+
+	for (FLightweightProjectileMeshBatch& Batch : MeshBatches)
+	{
+		Batch.InstanceTransforms.Reset();
+	}
+
+	for (int32 i = 0; i < Positions.Num(); i++)
+	{
+		const FLightweightProjectileType& Type = Types[TypeHandles[i]];
+		if (Type.MeshBatch == INDEX_NONE)
+			continue;
+
+		MeshBatches[Type.MeshBatch].InstanceTransforms.Add(Type.MeshRelativeTransform * FTransform(Velocities[i].Rotation(), Positions[i]));
+	}
+
+	//instances only grow, geometrically and in one call, the ones not needed this frame are scaled to zero
+	const FTransform HiddenTransform(FQuat::Identity, FVector::ZeroVector, FVector::ZeroVector);
+
+	for (FLightweightProjectileMeshBatch& Batch : MeshBatches)
+	{
+		UInstancedStaticMeshComponent* InstancedMesh = Batch.InstancedMesh;
+		if (!InstancedMesh)
+			continue;
+
+		const int32 NumVisible = Batch.InstanceTransforms.Num();
+		const int32 NumInstances = InstancedMesh->GetInstanceCount();
+
+		if (NumVisible > NumInstances)
+		{
+			TArray<FTransform> NewInstances;
+			NewInstances.Init(HiddenTransform, FMath::Max(NumVisible, NumInstances * 2) - NumInstances);
+			InstancedMesh->AddInstances(NewInstances, false, true);
+		}
+
+		if (NumVisible > 0)
+			InstancedMesh->BatchUpdateInstancesTransforms(0, Batch.InstanceTransforms, true, true, true);
+
+		//visible last frame only
+		if (Batch.NumVisible > NumVisible)
+			InstancedMesh->BatchUpdateInstancesTransform(NumVisible, Batch.NumVisible - NumVisible, HiddenTransform, true, true, true);
+
+		Batch.NumVisible = NumVisible;
+	}
+}
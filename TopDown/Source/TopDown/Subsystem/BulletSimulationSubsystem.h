@@ -0,0 +1,109 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "FuncLibrary/MyTypes.h"
+#include "BulletSimulationSubsystem.generated.h"
+
+class UInstancedStaticMeshComponent;
+
+//Everything a lightweight bullet needs from its projectile class, resolved once on register
+USTRUCT()
+struct FLightweightProjectileType
+{
+	GENERATED_BODY()
+
+	//FWeaponDefinition::Name of the weapons firing it, survives a rebuilt registry
+	UPROPERTY()
+	FName DefinitionName;
+	float LifeTime = 0.0f;
+	float Damage = 0.0f;
+	//weapons registered to the type and its bullets in flight, the impact table and the assets it keeps
+	//resident are released with the last of them
+	int32 NumUsers = 0;
+	TSharedPtr<const FSurfaceImpactTable> ImpactTable;
+
+	FTransform MeshRelativeTransform = FTransform::Identity;
+	float GravityScale = 1.0f;
+	float CollisionRadius = 16.0f;
+	TEnumAsByte<ECollisionChannel> CollisionChannel = ECC_WorldDynamic;
+	FCollisionResponseParams ResponseParams;
+
+	//index in MeshBatches, INDEX_NONE if bullets are not rendered
+	int32 MeshBatch = INDEX_NONE;
+};
+
+//One instanced mesh for all bullets sharing a static mesh
+USTRUCT()
+struct FLightweightProjectileMeshBatch
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	UStaticMesh* Mesh = nullptr;
+	UPROPERTY()
+	UInstancedStaticMeshComponent* InstancedMesh = nullptr;
+
+	//rebuilt every frame, the first instances of InstancedMesh
+	TArray<FTransform> InstanceTransforms;
+	//instances shown last frame, the rest of the component is scaled to zero
+	int32 NumVisible = 0;
+};
+
+//Data-only bullets: structure of arrays advanced in a ParallelFor with one sweep per bullet,
+//hits reuse AProjectileDefault::SpawnHitEffects and ApplyDamage
+UCLASS()
+class UBulletSimulationSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	//INDEX_NONE if the projectile can't be simulated without its actor, values of Info are copied.
+	//Weapons of one definition share the type
+	int32 RegisterProjectileType(FName DefinitionName, const FProjectileInfo& Info, TSharedPtr<const FSurfaceImpactTable> ImpactTable);
+	//once per successful RegisterProjectileType, the handle stays valid for a later register of the same definition
+	void UnregisterProjectileType(int32 TypeHandle);
+	void AddBullet(int32 TypeHandle, const FVector& Location, const FVector& Velocity, AActor* DamageCauser, AController* InstigatorController);
+
+	//true if shots of this projectile should go through the subsystem
+	static bool ShouldUseLightweightSimulation(const FProjectileInfo& Info);
+
+	int32 GetNumBullets() const { return Positions.Num(); }
+
+protected:
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+	void SimulateBullets(float DeltaTime);
+	void ApplyHits();
+	void RemoveDeadBullets();
+	void UpdateInstancedMeshes();
+	int32 FindOrAddMeshBatch(UStaticMesh* Mesh);
+	void ReleaseType(int32 TypeHandle);
+
+	UPROPERTY()
+	TArray<FLightweightProjectileType> Types;
+	UPROPERTY()
+	TArray<FLightweightProjectileMeshBatch> MeshBatches;
+
+	UPROPERTY()
+	AActor* InstancedMeshHost = nullptr;
+
+	//bullets
+	TArray<FVector> Positions;
+	TArray<FVector> Velocities;
+	TArray<float> LifeTimes;
+	TArray<int32> TypeHandles;
+	TArray<TWeakObjectPtr<AActor>> DamageCausers;
+	TArray<TWeakObjectPtr<AController>> Instigators;
+	TArray<TWeakObjectPtr<AActor>> IgnoredActors;
+
+	//per frame results of SimulateBullets, same index as bullets
+	TArray<uint8> bHitThisFrame;
+	TArray<FHitResult> HitResults;
+};
@@ -0,0 +1,490 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CombatBenchmarkSubsystem.h"
+#include "Dom/JsonObject.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "GameFramework/GameModeBase.h"
+#include "GameFramework/PlayerStart.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformMisc.h"
+#include "Misc/App.h"
+#include "Misc/CommandLine.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+#include "ProfilingDebugging/MiscTrace.h"
+#include "RenderCore.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+#include "TopDown/TopDown.h"
+#include "TopDown/Character/TopDownCharacter.h"
+#include "TopDown/FuncLibrary/TopDownAllocCounter.h"
+#include "TopDown/Game/TopDownGameInstance.h"
+#include "TopDown/ProjectileDefault_Grenade.h"
+#include "TopDown/WeaponDefault.h"
+
+CSV_DEFINE_CATEGORY(TopDownBenchmark, true);
+
+static TAutoConsoleVariable<float> CVarBenchmarkWarmupTime(
+	TEXT("TopDown.Benchmark.WarmupTime"),
+	3.0f,
+	TEXT("Seconds every step of the benchmark fires before recording, weapon assets stream in and pools fill up meanwhile"));
+
+static TAutoConsoleVariable<float> CVarBenchmarkMeasureTime(
+	TEXT("TopDown.Benchmark.MeasureTime"),
+	10.0f,
+	TEXT("Seconds recorded by every step of the benchmark"));
+
+static TAutoConsoleVariable<float> CVarBenchmarkSpacing(
+	TEXT("TopDown.Benchmark.Spacing"),
+	250.0f,
+	TEXT("Distance between the benchmark characters on the ring around the player start"));
+
+static TAutoConsoleVariable<float> CVarBenchmarkAllocsPerShotBudget(
+	TEXT("TopDown.Benchmark.AllocsPerShotBudget"),
+	10.0f,
+	TEXT("Allocations per shot allowed while the benchmark records (firing, hits, impact effects and explosions), exceeding it fails the sweep. Negative - no budget"));
+
+//TOPDOWN_ALLOC_SCOPE sites of everything a shot costs, none of them runs inside another. Fire only counts the shots
+static const TCHAR* const ShotAllocSites[] = { TEXT("FireBatch"), TEXT("BulletCollisionSphereHit"), TEXT("HitScanImpact"), TEXT("BulletHit"), TEXT("GrenadeExplose") };
+
+static FAutoConsoleCommandWithWorldAndArgs RunBenchmarkCommand(
+	TEXT("TopDown.Benchmark.Run"),
+	TEXT("Sweep the combat benchmark over the character counts, e.g. TopDown.Benchmark.Run 1 10 50 200"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		if (UCombatBenchmarkSubsystem* Benchmark = World ? World->GetSubsystem<UCombatBenchmarkSubsystem>() : nullptr)
+		{
+			const TArray<int32> Counts = UCombatBenchmarkSubsystem::ParseCounts(Args.Num() > 0 ? FString::Join(Args, TEXT(" ")) : FString(TEXT("1,10,50,200")));
+			if (!Benchmark->StartSweep(Counts, false))
+				UE_LOG(LogTopDown, Warning, TEXT("UCombatBenchmarkSubsystem::StartSweep - already running or no character count"));
+		}
+	}));
+
+static FAutoConsoleCommandWithWorld StopBenchmarkCommand(
+	TEXT("TopDown.Benchmark.Stop"),
+	TEXT("Abort the running combat benchmark without writing a summary"),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* World)
+	{
+		if (UCombatBenchmarkSubsystem* Benchmark = World ? World->GetSubsystem<UCombatBenchmarkSubsystem>() : nullptr)
+		{
+			Benchmark->StopSweep();
+		}
+	}));
+
+//Values is sorted
+static float GetPercentile(const TArray<float>& Values, float Percentile)
+{
+	if (Values.Num() == 0)
+		return 0.0f;
+
+	return Values[FMath::Clamp(FMath::FloorToInt(Values.Num() * Percentile), 0, Values.Num() - 1)];
+}
+
+static float GetAverage(const TArray<float>& Values)
+{
+	if (Values.Num() == 0)
+		return 0.0f;
+
+	double Sum = 0.0;
+	for (float Value : Values)
+	{
+		Sum += Value;
+	}
+	return float(Sum / Values.Num());
+}
+
+bool UCombatBenchmarkSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void UCombatBenchmarkSubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+	Super::OnWorldBeginPlay(InWorld);
+
+	FString CountsText;
+	if (FParse::Value(FCommandLine::Get(), TEXT("TopDownBenchmark="), CountsText, false))
+	{
+		const bool bExit = FParse::Param(FCommandLine::Get(), TEXT("TopDownBenchmarkExit"));
+		if (!StartSweep(ParseCounts(CountsText), bExit) && bExit)
+		{
+			UE_LOG(LogTopDown, Error, TEXT("UCombatBenchmarkSubsystem::OnWorldBeginPlay - no character count in -TopDownBenchmark=%s"), *CountsText);
+			FPlatformMisc::RequestExitWithStatus(false, 1);
+		}
+	}
+}
+
+void UCombatBenchmarkSubsystem::Deinitialize()
+{
+	StopSweep();
+
+	Super::Deinitialize();
+}
+
+TStatId UCombatBenchmarkSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UCombatBenchmarkSubsystem, STATGROUP_TopDown);
+}
+
+TArray<int32> UCombatBenchmarkSubsystem::ParseCounts(const FString& Text)
+{
+	TArray<FString> Parts;
+	Text.Replace(TEXT(","), TEXT(" ")).ParseIntoArrayWS(Parts);
+
+	TArray<int32> Result;
+	for (const FString& Part : Parts)
+	{
+		const int32 Count = FCString::Atoi(*Part);
+		if (Count > 0)
+			Result.Add(Count);
+	}
+	return Result;
+}
+
+bool UCombatBenchmarkSubsystem::StartSweep(const TArray<int32>& InCounts, bool bInExitWhenDone)
+{
+	if (IsRunning() || InCounts.Num() == 0)
+		return false;
+
+	GatherWeaponGroups();
+	if (WeaponGroups.Num() == 0)
+		UE_LOG(LogTopDown, Warning, TEXT("UCombatBenchmarkSubsystem::StartSweep - no weapon definitions, characters won't fire"));
+
+	//ring around the first player start, the map origin without one
+	Center = FVector::ZeroVector;
+	for (TActorIterator<APlayerStart> It(GetWorld()); It; ++It)
+	{
+		Center = It->GetActorLocation();
+		break;
+	}
+
+#if TOPDOWN_ALLOC_COUNTING
+	//the counting allocator only goes in at startup, -TopDownBenchmark= does that
+	if (!TopDownAllocCounter::IsInstalled() && CVarBenchmarkAllocsPerShotBudget.GetValueOnGameThread() >= 0.0f)
+		UE_LOG(LogTopDown, Warning, TEXT("UCombatBenchmarkSubsystem::StartSweep - allocation counting is off, start with -TopDownAllocCounting to check the budget"));
+#endif
+	bAllocBudgetExceeded = false;
+
+	Counts = InCounts;
+	bExitWhenDone = bInExitWhenDone;
+	StepIndex = 0;
+	StepResults.Reset();
+	LastSummary.Reset();
+	SweepStartTime = FDateTime::Now();
+
+	UE_LOG(LogTopDown, Log, TEXT("UCombatBenchmarkSubsystem::StartSweep - %d steps"), Counts.Num());
+
+	StartStep();
+	return true;
+}
+
+void UCombatBenchmarkSubsystem::StopSweep()
+{
+	if (!IsRunning())
+		return;
+
+#if CSV_PROFILER
+	if (Phase == ECombatBenchmarkPhase::Measure && FCsvProfiler::Get()->IsCapturing())
+		FCsvProfiler::Get()->EndCapture();
+#endif
+
+	DestroyCharacters();
+	Phase = ECombatBenchmarkPhase::Idle;
+	StepIndex = INDEX_NONE;
+}
+
+void UCombatBenchmarkSubsystem::StartStep()
+{
+	const int32 Count = Counts[StepIndex];
+
+	UE_LOG(LogTopDown, Log, TEXT("UCombatBenchmarkSubsystem::StartStep - %d characters"), Count);
+	TRACE_BOOKMARK(TEXT("TopDownBenchmark %d"), Count);
+
+	SpawnCharacters(Count);
+
+	FrameTimes.Reset();
+	GameThreadTimes.Reset();
+	MaxActors = 0;
+	MaxUsedPhysical = 0;
+
+	Phase = ECombatBenchmarkPhase::Warmup;
+	PhaseTime = 0.0f;
+}
+
+void UCombatBenchmarkSubsystem::Tick(float DeltaTime)
+{
+	if (!IsRunning())
+		return;
+
+	//wall clock, time dilation must not stretch the steps
+	const float FrameTime = FApp::GetDeltaTime();
+	PhaseTime += FrameTime;
+
+	KeepFiring();
+
+	if (Phase == ECombatBenchmarkPhase::Warmup)
+	{
+		if (PhaseTime < CVarBenchmarkWarmupTime.GetValueOnGameThread())
+			return;
+
+#if CSV_PROFILER
+		if (!FCsvProfiler::Get()->IsCapturing())
+			FCsvProfiler::Get()->BeginCapture(-1, FString(), FString::Printf(TEXT("TopDownBenchmark_%d_%s.csv"), Counts[StepIndex], *SweepStartTime.ToString()));
+		CSV_METADATA(TEXT("TopDownBenchmarkCharacters"), *FString::FromInt(Counts[StepIndex]));
+#endif
+#if TOPDOWN_ALLOC_COUNTING
+		//steady state only, pools are filled during the warmup
+		TopDownAllocCounter::ResetTotals();
+#endif
+
+		Phase = ECombatBenchmarkPhase::Measure;
+		PhaseTime = 0.0f;
+		return;
+	}
+
+	RecordFrame(FrameTime);
+
+	if (PhaseTime >= CVarBenchmarkMeasureTime.GetValueOnGameThread())
+		FinishStep();
+}
+
+void UCombatBenchmarkSubsystem::RecordFrame(float FrameTime)
+{
+	const int32 NumActors = GetWorld()->GetActorCount();
+	const uint64 UsedPhysical = FPlatformMemory::GetStats().UsedPhysical;
+
+	FrameTimes.Add(FrameTime * 1000.0f);
+	GameThreadTimes.Add(FPlatformTime::ToMilliseconds(GGameThreadTime));
+	MaxActors = FMath::Max(MaxActors, NumActors);
+	MaxUsedPhysical = FMath::Max(MaxUsedPhysical, UsedPhysical);
+
+	CSV_CUSTOM_STAT(TopDownBenchmark, Characters, Characters.Num(), ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(TopDownBenchmark, Actors, NumActors, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(TopDownBenchmark, UsedPhysicalMB, float(UsedPhysical / (1024.0 * 1024.0)), ECsvCustomStatOp::Set);
+}
+
+void UCombatBenchmarkSubsystem::FinishStep()
+{
+	FString CsvFile;
+#if CSV_PROFILER
+	if (FCsvProfiler::Get()->IsCapturing())
+	{
+		CsvFile = FString::Printf(TEXT("TopDownBenchmark_%d_%s.csv"), Counts[StepIndex], *SweepStartTime.ToString());
+		FCsvProfiler::Get()->EndCapture();
+	}
+#endif
+
+	int32 NumArmed = 0;
+	for (ATopDownCharacter* Character : Characters)
+	{
+		if (Character && Character->GetCurrentWeapon())
+			NumArmed++;
+	}
+
+	FrameTimes.Sort();
+	GameThreadTimes.Sort();
+
+	TSharedRef<FJsonObject> Step = MakeShared<FJsonObject>();
+	Step->SetNumberField(TEXT("characters"), Counts[StepIndex]);
+	Step->SetNumberField(TEXT("armed_characters"), NumArmed);
+	Step->SetNumberField(TEXT("frames"), FrameTimes.Num());
+	Step->SetNumberField(TEXT("frame_ms_avg"), GetAverage(FrameTimes));
+	Step->SetNumberField(TEXT("frame_ms_p50"), GetPercentile(FrameTimes, 0.5f));
+	Step->SetNumberField(TEXT("frame_ms_p95"), GetPercentile(FrameTimes, 0.95f));
+	Step->SetNumberField(TEXT("frame_ms_max"), FrameTimes.Num() > 0 ? FrameTimes.Last() : 0.0f);
+	Step->SetNumberField(TEXT("game_thread_ms_avg"), GetAverage(GameThreadTimes));
+	Step->SetNumberField(TEXT("game_thread_ms_p95"), GetPercentile(GameThreadTimes, 0.95f));
+	Step->SetNumberField(TEXT("game_thread_ms_max"), GameThreadTimes.Num() > 0 ? GameThreadTimes.Last() : 0.0f);
+	Step->SetNumberField(TEXT("actors_max"), MaxActors);
+	Step->SetNumberField(TEXT("used_physical_mb_max"), MaxUsedPhysical / (1024.0 * 1024.0));
+	Step->SetStringField(TEXT("csv"), CsvFile);
+
+#if TOPDOWN_ALLOC_COUNTING
+	if (TopDownAllocCounter::IsInstalled())
+	{
+		const FTopDownAllocSite* FireSite = TopDownAllocCounter::FindSite(TEXT("Fire"));
+		const uint64 NumShots = FireSite ? FireSite->GetCalls() : 0;
+
+		uint64 ShotAllocs = 0;
+		for (const TCHAR* SiteName : ShotAllocSites)
+		{
+			if (const FTopDownAllocSite* Site = TopDownAllocCounter::FindSite(SiteName))
+				ShotAllocs += Site->GetAllocs();
+		}
+		const double AllocsPerShot = NumShots > 0 ? double(ShotAllocs) / NumShots : 0.0;
+		const float Budget = CVarBenchmarkAllocsPerShotBudget.GetValueOnGameThread();
+		const bool bOverBudget = Budget >= 0.0f && AllocsPerShot > Budget;
+
+		Step->SetNumberField(TEXT("shots"), NumShots);
+		Step->SetNumberField(TEXT("allocs_per_shot"), AllocsPerShot);
+		Step->SetNumberField(TEXT("fire_allocs_per_shot"), NumShots > 0 ? double(FireSite->GetAllocs()) / NumShots : 0.0);
+		Step->SetBoolField(TEXT("alloc_budget_exceeded"), bOverBudget);
+
+		if (bOverBudget)
+		{
+			UE_LOG(LogTopDown, Error, TEXT("UCombatBenchmarkSubsystem::FinishStep - %d characters: %.2f allocations per shot, budget %.2f"), Counts[StepIndex], AllocsPerShot, Budget);
+			bAllocBudgetExceeded = true;
+		}
+	}
+#endif
+	StepResults.Add(MakeShared<FJsonValueObject>(Step));
+
+	UE_LOG(LogTopDown, Log, TEXT("UCombatBenchmarkSubsystem::FinishStep - %d characters: frame %.2f ms avg / %.2f ms p95, game thread %.2f ms avg, %d actors"),
+		Counts[StepIndex], GetAverage(FrameTimes), GetPercentile(FrameTimes, 0.95f), GetAverage(GameThreadTimes), MaxActors);
+
+	DestroyCharacters();
+
+	if (++StepIndex < Counts.Num())
+	{
+		StartStep();
+		return;
+	}
+
+	FinishSweep();
+}
+
+void UCombatBenchmarkSubsystem::FinishSweep()
+{
+	Phase = ECombatBenchmarkPhase::Idle;
+	StepIndex = INDEX_NONE;
+
+	TSharedRef<FJsonObject> Summary = MakeShared<FJsonObject>();
+	Summary->SetStringField(TEXT("map"), GetWorld()->GetMapName());
+	Summary->SetStringField(TEXT("build_configuration"), LexToString(FApp::GetBuildConfiguration()));
+	Summary->SetStringField(TEXT("start_time"), SweepStartTime.ToIso8601());
+	Summary->SetNumberField(TEXT("warmup_time"), CVarBenchmarkWarmupTime.GetValueOnGameThread());
+	Summary->SetNumberField(TEXT("measure_time"), CVarBenchmarkMeasureTime.GetValueOnGameThread());
+	Summary->SetNumberField(TEXT("allocs_per_shot_budget"), CVarBenchmarkAllocsPerShotBudget.GetValueOnGameThread());
+#if TOPDOWN_ALLOC_COUNTING
+	Summary->SetBoolField(TEXT("alloc_counting"), TopDownAllocCounter::IsInstalled());
+#else
+	Summary->SetBoolField(TEXT("alloc_counting"), false);
+#endif
+	Summary->SetBoolField(TEXT("alloc_budget_exceeded"), bAllocBudgetExceeded);
+	Summary->SetArrayField(TEXT("steps"), StepResults);
+
+	FString Json;
+	TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Json);
+	FJsonSerializer::Serialize(Summary, Writer);
+
+	const FString FileName = FPaths::Combine(FPaths::ProfilingDir(), TEXT("TopDownBenchmark"), FString::Printf(TEXT("Summary_%s.json"), *SweepStartTime.ToString()));
+	const bool bSaved = FFileHelper::SaveStringToFile(Json, *FileName);
+	if (bSaved)
+		UE_LOG(LogTopDown, Log, TEXT("UCombatBenchmarkSubsystem::FinishSweep - summary written to %s"), *FileName);
+	else
+		UE_LOG(LogTopDown, Error, TEXT("UCombatBenchmarkSubsystem::FinishSweep - failed to write %s"), *FileName);
+
+	StepResults.Reset();
+	LastSummary = Summary;
+
+	//1 - no summary, 2 - over the allocation budget
+	if (bExitWhenDone)
+		FPlatformMisc::RequestExitWithStatus(false, !bSaved ? 1 : bAllocBudgetExceeded ? 2 : 0);
+}
+
+void UCombatBenchmarkSubsystem::GatherWeaponGroups()
+{
+	WeaponGroups.Reset();
+
+	UTopDownGameInstance* GameInstance = Cast<UTopDownGameInstance>(GetWorld()->GetGameInstance());
+	UWeaponRegistry* Registry = GameInstance ? GameInstance->GetWeaponRegistry() : nullptr;
+	if (!Registry)
+		return;
+
+	TArray<FName> Projectiles;
+	TArray<FName> HitScans;
+	TArray<FName> Grenades;
+
+	FWeaponHandle Handle;
+	for (Handle.Index = 0; Handle.Index < Registry->Num(); Handle.Index++)
+	{
+		const FWeaponDefinition& Definition = Registry->GetDefinition(Handle);
+		const TSubclassOf<AProjectileDefault> Projectile = Definition.Info.ProjectileSetting.Projectile;
+
+		if (!Projectile)
+			HitScans.Add(Definition.Name);
+		else if (Projectile->IsChildOf(AProjectileDefault_Grenade::StaticClass()))
+			Grenades.Add(Definition.Name);
+		else
+			Projectiles.Add(Definition.Name);
+	}
+
+	for (TArray<FName>* Group : { &Projectiles, &HitScans, &Grenades })
+	{
+		if (Group->Num() > 0)
+			WeaponGroups.Add(MoveTemp(*Group));
+	}
+}
+
+FName UCombatBenchmarkSubsystem::GetWeaponName(int32 CharacterIndex) const
+{
+	if (WeaponGroups.Num() == 0)
+		return NAME_None;
+
+	//groups in turn, then the weapons of a group in turn
+	const TArray<FName>& Group = WeaponGroups[CharacterIndex % WeaponGroups.Num()];
+	return Group[(CharacterIndex / WeaponGroups.Num()) % Group.Num()];
+}
+
+void UCombatBenchmarkSubsystem::SpawnCharacters(int32 Count)
+{
+	UWorld* World = GetWorld();
+
+	//blueprint of the game mode carries the meshes and the weapon socket
+	TSubclassOf<ATopDownCharacter> CharacterClass = ATopDownCharacter::StaticClass();
+	const AGameModeBase* GameMode = World->GetAuthGameMode();
+	if (GameMode && GameMode->DefaultPawnClass && GameMode->DefaultPawnClass->IsChildOf(ATopDownCharacter::StaticClass()))
+		CharacterClass = GameMode->DefaultPawnClass.Get();
+
+	//facing the center, everyone shoots across the ring
+	const float Radius = FMath::Max(500.0f, CVarBenchmarkSpacing.GetValueOnGameThread() * Count / (2.0f * PI));
+
+	Characters.Reserve(Count);
+	for (int32 i = 0; i < Count; i++)
+	{
+		const float Angle = 2.0f * PI * i / Count;
+		const FVector Location = Center + FVector(FMath::Cos(Angle), FMath::Sin(Angle), 0.0f) * Radius;
+		const FTransform Transform((Center - Location).Rotation(), Location);
+
+		ATopDownCharacter* Character = World->SpawnActorDeferred<ATopDownCharacter>(CharacterClass, Transform, nullptr, nullptr, ESpawnActorCollisionHandlingMethod::AlwaysSpawn);
+		if (!Character)
+			continue;
+
+		Character->InitWeaponName = GetWeaponName(i);
+		Character->FinishSpawning(Transform);
+		Characters.Add(Character);
+	}
+}
+
+void UCombatBenchmarkSubsystem::DestroyCharacters()
+{
+	for (ATopDownCharacter* Character : Characters)
+	{
+		if (!IsValid(Character))
+			continue;
+
+		if (AWeaponDefault* Weapon = Character->GetCurrentWeapon())
+			Weapon->Destroy();
+		Character->Destroy();
+	}
+	Characters.Reset();
+}
+
+void UCombatBenchmarkSubsystem::KeepFiring()
+{
+	for (ATopDownCharacter* Character : Characters)
+	{
+		AWeaponDefault* Weapon = IsValid(Character) ? Character->GetCurrentWeapon() : nullptr;
+		if (!Weapon)
+			continue;
+
+		//no cursor without a viewport, aim at the center of the ring
+		Weapon->ShootEndLocation = Center;
+
+		if (!Weapon->WeaponFiring && !Weapon->WeaponReloading)
+			Character->AttackCharEvent(true);
+	}
+}
@@ -0,0 +1,88 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "CombatBenchmarkSubsystem.generated.h"
+
+class ATopDownCharacter;
+class FJsonObject;
+class FJsonValue;
+
+enum class ECombatBenchmarkPhase : uint8
+{
+	Idle,
+	//weapons are streaming in and the pools filling up, nothing is recorded
+	Warmup,
+	Measure
+};
+
+//Headless combat stress test. For every character count of the sweep it spawns that many armed characters firing
+//continuously (projectile, hit-scan and grenade weapons of the registry in turn), records the frames with the CSV profiler
+//and writes the summary of the sweep to Saved/Profiling/TopDownBenchmark/.
+//UnrealEditor TopDown.uproject /Game/TopDownMap -game -nullrhi -unattended -nosound -TopDownBenchmark=1,10,50,200 -TopDownBenchmarkExit
+//The sweep fails (exit code 2) if steady state fire, hits and impacts allocate more per shot than TopDown.Benchmark.AllocsPerShotBudget (-dpcvars=)
+UCLASS()
+class UCombatBenchmarkSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	//false if a sweep is already running or there is nothing to spawn
+	bool StartSweep(const TArray<int32>& InCounts, bool bInExitWhenDone);
+	void StopSweep();
+	bool IsRunning() const { return Phase != ECombatBenchmarkPhase::Idle; }
+	//summary of the last finished sweep as written to the json file, null while a sweep runs
+	TSharedPtr<FJsonObject> GetLastSummary() const { return LastSummary; }
+
+	//"1,10,50,200" or "1 10 50 200"
+	static TArray<int32> ParseCounts(const FString& Text);
+
+protected:
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+	void StartStep();
+	void FinishStep();
+	void FinishSweep();
+
+	void SpawnCharacters(int32 Count);
+	void DestroyCharacters();
+	//reloads and the character itself release the trigger
+	void KeepFiring();
+	void RecordFrame(float FrameTime);
+
+	//weapon names of the registry split into projectile, hit-scan and grenade weapons, empty groups are left out
+	void GatherWeaponGroups();
+	FName GetWeaponName(int32 CharacterIndex) const;
+
+	ECombatBenchmarkPhase Phase = ECombatBenchmarkPhase::Idle;
+	TArray<int32> Counts;
+	int32 StepIndex = INDEX_NONE;
+	float PhaseTime = 0.0f;
+	bool bExitWhenDone = false;
+
+	FVector Center = FVector::ZeroVector;
+	TArray<TArray<FName>> WeaponGroups;
+
+	UPROPERTY()
+	TArray<ATopDownCharacter*> Characters;
+
+	//frames of the current step, milliseconds
+	TArray<float> FrameTimes;
+	TArray<float> GameThreadTimes;
+	int32 MaxActors = 0;
+	uint64 MaxUsedPhysical = 0;
+
+	//TopDown.Benchmark.AllocsPerShotBudget was exceeded by a step
+	bool bAllocBudgetExceeded = false;
+
+	TArray<TSharedPtr<FJsonValue>> StepResults;
+	FDateTime SweepStartTime;
+	TSharedPtr<FJsonObject> LastSummary;
+};
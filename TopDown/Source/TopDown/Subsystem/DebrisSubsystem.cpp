@@ -0,0 +1,255 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DebrisSubsystem.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "TopDown/TopDown.h"
+#include "TopDown/FuncLibrary/MyTypes.h"
+#include "TopDownFXSubsystem.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Debris Simulated"), STAT_TopDown_DebrisSimulated, STATGROUP_TopDown);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Debris Settled"), STAT_TopDown_DebrisSettled, STATGROUP_TopDown);
+
+static TAutoConsoleVariable<int32> CVarDebrisMaxSimulated(
+	TEXT("TopDown.Debris.MaxSimulated"),
+	8,
+	TEXT("Debris bodies simulating at once, the oldest one is settled where it is above it"));
+
+static TAutoConsoleVariable<int32> CVarDebrisBudget(
+	TEXT("TopDown.Debris.Budget"),
+	64,
+	TEXT("Settled debris kept in the world, the oldest one is removed above it"));
+
+static TAutoConsoleVariable<float> CVarDebrisMaxSimulationTime(
+	TEXT("TopDown.Debris.MaxSimulationTime"),
+	4.0f,
+	TEXT("Seconds a debris body may simulate before it is settled anyway"));
+
+static FAutoConsoleCommandWithWorld DumpDebrisCommand(
+	TEXT("TopDown.Debris.Dump"),
+	TEXT("Log simulated and settled debris counts"),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* World)
+	{
+		if (UDebrisSubsystem* Debris = World ? World->GetSubsystem<UDebrisSubsystem>() : nullptr)
+		{
+			Debris->DumpStats();
+		}
+	}));
+
+//below this speed a body counts as resting
+static constexpr float DebrisSleepSpeed = 5.0f;
+//a fresh body is never settled before it had time to fall
+static constexpr float DebrisMinSimulationTime = 0.5f;
+static constexpr float DebrisGroundTraceDistance = 500.0f;
+
+bool UDebrisSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	//debris is cosmetic
+	return !IsRunningDedicatedServer() && Super::ShouldCreateSubsystem(Outer);
+}
+
+bool UDebrisSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void UDebrisSubsystem::Deinitialize()
+{
+	DEC_DWORD_STAT_BY(STAT_TopDown_DebrisSimulated, Simulated.Num());
+	DEC_DWORD_STAT_BY(STAT_TopDown_DebrisSettled, SettledOrder.Num());
+
+	Simulated.Empty();
+	FreeComponents.Empty();
+	SettledBatches.Empty();
+	SettledOrder.Empty();
+	ComponentHost = nullptr;
+
+	Super::Deinitialize();
+}
+
+TStatId UDebrisSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UDebrisSubsystem, STATGROUP_TopDown);
+}
+
+void UDebrisSubsystem::SpawnDebris(UStaticMesh* Mesh, const FTransform& Transform, const FVector& Impulse, const AActor* IgnoredActor, FName CollisionProfile)
+{
+	LLM_SCOPE_BYTAG(TopDown_Debris);
+
+	if (!Mesh)
+		return;
+
+	const UTopDownFXSubsystem* FX = GetWorld()->GetSubsystem<UTopDownFXSubsystem>();
+	if (FX && !FX->IsInViewRange(Transform.GetLocation()))
+	{
+		//nobody sees it fall
+		FTransform GroundTransform;
+		if (FindGroundTransform(Transform, IgnoredActor, GroundTransform))
+			AddSettledInstance(Mesh, GroundTransform);
+		return;
+	}
+
+	//the oldest body stops where it is to make room
+	const int32 MaxSimulated = FMath::Max(CVarDebrisMaxSimulated.GetValueOnGameThread(), 1);
+	while (Simulated.Num() >= MaxSimulated)
+	{
+		SettleDebris(0);
+	}
+
+	UStaticMeshComponent* Component = AcquireSimulatedComponent();
+	if (!Component)
+		return;
+
+	Component->SetStaticMesh(Mesh);
+	Component->SetWorldTransform(Transform);
+	Component->SetCollisionProfileName(CollisionProfile);
+	Component->SetVisibility(true);
+	Component->SetSimulatePhysics(true);
+	Component->AddImpulse(Impulse);
+
+	FSimulatedDebris& Debris = Simulated.AddDefaulted_GetRef();
+	Debris.Component = Component;
+	INC_DWORD_STAT(STAT_TopDown_DebrisSimulated);
+}
+
+void UDebrisSubsystem::Tick(float DeltaTime)
+{
+	const float MaxSimulationTime = CVarDebrisMaxSimulationTime.GetValueOnGameThread();
+
+	for (int32 i = 0; i < Simulated.Num(); i++)
+	{
+		FSimulatedDebris& Debris = Simulated[i];
+		Debris.SimulationTime += DeltaTime;
+
+		UStaticMeshComponent* Component = Debris.Component;
+		const bool bResting = !IsValid(Component) || !Component->RigidBodyIsAwake()
+			|| (Debris.SimulationTime > DebrisMinSimulationTime && Component->GetPhysicsLinearVelocity().SizeSquared() < FMath::Square(DebrisSleepSpeed));
+
+		if (bResting || Debris.SimulationTime > MaxSimulationTime)
+			SettleDebris(i--);
+	}
+
+	ApplyBudget();
+}
+
+UStaticMeshComponent* UDebrisSubsystem::AcquireSimulatedComponent()
+{
+	while (FreeComponents.Num() > 0)
+	{
+		UStaticMeshComponent* Component = FreeComponents.Pop(false);
+		if (IsValid(Component))
+			return Component;
+	}
+
+	if (!ComponentHost)
+		ComponentHost = UMyTypes::SpawnInstancedMeshHost(GetWorld(), TEXT("Debris"));
+
+	if (!ComponentHost)
+		return nullptr;
+
+	UStaticMeshComponent* Component = NewObject<UStaticMeshComponent>(ComponentHost);
+	Component->SetMobility(EComponentMobility::Movable);
+	Component->SetCanEverAffectNavigation(false);
+	Component->SetUsingAbsoluteLocation(true);
+	Component->SetUsingAbsoluteRotation(true);
+	Component->SetUsingAbsoluteScale(true);
+	Component->SetupAttachment(ComponentHost->GetRootComponent());
+	Component->RegisterComponent();
+
+	return Component;
+}
+
+void UDebrisSubsystem::SettleDebris(int32 Index)
+{
+	UStaticMeshComponent* Component = Simulated[Index].Component;
+	Simulated.RemoveAt(Index, 1, false);
+	DEC_DWORD_STAT(STAT_TopDown_DebrisSimulated);
+
+	if (!IsValid(Component))
+		return;
+
+	Component->PutRigidBodyToSleep();
+	AddSettledInstance(Component->GetStaticMesh(), Component->GetComponentTransform());
+
+	Component->SetSimulatePhysics(false);
+	Component->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	Component->SetVisibility(false);
+	Component->SetStaticMesh(nullptr);
+	FreeComponents.Add(Component);
+}
+
+void UDebrisSubsystem::AddSettledInstance(UStaticMesh* Mesh, const FTransform& Transform)
+{
+	LLM_SCOPE_BYTAG(TopDown_Debris);
+
+	if (!Mesh)
+		return;
+
+	int32 BatchIndex = SettledBatches.IndexOfByPredicate([Mesh](const FSettledDebrisBatch& Batch) { return Batch.Mesh == Mesh; });
+	if (BatchIndex == INDEX_NONE)
+	{
+		if (!ComponentHost)
+			ComponentHost = UMyTypes::SpawnInstancedMeshHost(GetWorld(), TEXT("Debris"));
+
+		//settled debris is only seen, nothing collides with it
+		UInstancedStaticMeshComponent* InstancedMesh = UMyTypes::AddInstancedMeshComponent(ComponentHost, Mesh);
+		if (!InstancedMesh)
+			return;
+
+		FSettledDebrisBatch& Batch = SettledBatches.AddDefaulted_GetRef();
+		Batch.Mesh = Mesh;
+		Batch.InstancedMesh = InstancedMesh;
+		BatchIndex = SettledBatches.Num() - 1;
+	}
+
+	SettledBatches[BatchIndex].InstancedMesh->AddInstance(Transform, true);
+	SettledOrder.Add(BatchIndex);
+	INC_DWORD_STAT(STAT_TopDown_DebrisSettled);
+}
+
+void UDebrisSubsystem::ApplyBudget()
+{
+	const int32 Budget = FMath::Max(CVarDebrisBudget.GetValueOnGameThread(), 0);
+	const int32 NumToRemove = SettledOrder.Num() - Budget;
+	if (NumToRemove <= 0)
+		return;
+
+	for (int32 i = 0; i < NumToRemove; i++)
+	{
+		//instanced static meshes keep the order on remove, instance 0 is the oldest of the batch
+		UInstancedStaticMeshComponent* InstancedMesh = SettledBatches[SettledOrder[i]].InstancedMesh;
+		if (InstancedMesh && InstancedMesh->GetInstanceCount() > 0)
+			InstancedMesh->RemoveInstance(0);
+	}
+
+	SettledOrder.RemoveAt(0, NumToRemove, false);
+	DEC_DWORD_STAT_BY(STAT_TopDown_DebrisSettled, NumToRemove);
+}
+
+bool UDebrisSubsystem::FindGroundTransform(const FTransform& Transform, const AActor* IgnoredActor, FTransform& OutTransform) const
+{
+	const FVector Start = Transform.GetLocation();
+
+	FHitResult Hit;
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(DebrisGround), false, IgnoredActor);
+	if (!GetWorld()->LineTraceSingleByChannel(Hit, Start, Start - FVector(0.0f, 0.0f, DebrisGroundTraceDistance), ECC_Visibility, QueryParams))
+		return false;
+
+	//keeps the heading, lies flat on the ground
+	const FRotator Rotation(0.0f, Transform.Rotator().Yaw, 0.0f);
+	OutTransform = FTransform(FRotationMatrix::MakeFromZX(Hit.ImpactNormal, Rotation.Vector()).Rotator(), Hit.ImpactPoint, Transform.GetScale3D());
+	return true;
+}
+
+void UDebrisSubsystem::DumpStats() const
+{
+	for (const FSettledDebrisBatch& Batch : SettledBatches)
+	{
+		UE_LOG(LogTopDown, Display, TEXT("%s: %d settled"), *GetNameSafe(Batch.Mesh), Batch.InstancedMesh ? Batch.InstancedMesh->GetInstanceCount() : 0);
+	}
+	UE_LOG(LogTopDown, Display, TEXT("debris: simulated %d (free components %d), settled %d"), Simulated.Num(), FreeComponents.Num(), SettledOrder.Num());
+}
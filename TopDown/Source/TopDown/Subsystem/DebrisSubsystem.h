@@ -0,0 +1,77 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "DebrisSubsystem.generated.h"
+
+class UInstancedStaticMeshComponent;
+class UStaticMesh;
+class UStaticMeshComponent;
+
+USTRUCT()
+struct FSimulatedDebris
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	UStaticMeshComponent* Component = nullptr;
+
+	float SimulationTime = 0.0f;
+};
+
+//Settled debris of one mesh, instances are kept oldest first
+USTRUCT()
+struct FSettledDebrisBatch
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	UStaticMesh* Mesh = nullptr;
+	UPROPERTY()
+	UInstancedStaticMeshComponent* InstancedMesh = nullptr;
+};
+
+//Owns dropped magazines and other parts weapons throw away.
+//A few bodies simulate at once, settled bodies are put to sleep and become instances of a static mesh,
+//the oldest settled debris is removed above the budget. Not created on a dedicated server
+UCLASS()
+class UDebrisSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	//drops out of view range skip simulation and land straight on the ground below, IgnoredActor is skipped looking for it
+	void SpawnDebris(UStaticMesh* Mesh, const FTransform& Transform, const FVector& Impulse, const AActor* IgnoredActor = nullptr, FName CollisionProfile = TEXT("Pawn"));
+
+	int32 GetNumSimulated() const { return Simulated.Num(); }
+	int32 GetNumSettled() const { return SettledOrder.Num(); }
+	void DumpStats() const;
+
+protected:
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+	UStaticMeshComponent* AcquireSimulatedComponent();
+	void SettleDebris(int32 Index);
+	void AddSettledInstance(UStaticMesh* Mesh, const FTransform& Transform);
+	void ApplyBudget();
+	bool FindGroundTransform(const FTransform& Transform, const AActor* IgnoredActor, FTransform& OutTransform) const;
+
+	UPROPERTY()
+	TArray<FSimulatedDebris> Simulated;
+	UPROPERTY()
+	TArray<UStaticMeshComponent*> FreeComponents;
+	UPROPERTY()
+	TArray<FSettledDebrisBatch> SettledBatches;
+	UPROPERTY()
+	AActor* ComponentHost = nullptr;
+
+	//index in SettledBatches per settled instance, oldest first, the batch's instance 0 is the oldest of it
+	TArray<int32> SettledOrder;
+};
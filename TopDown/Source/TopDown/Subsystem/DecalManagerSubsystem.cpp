@@ -0,0 +1,320 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DecalManagerSubsystem.h"
+#include "Components/DecalComponent.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Materials/MaterialInterface.h"
+#include "TopDown/TopDown.h"
+#include "TopDown/FuncLibrary/MyTypes.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Decals Active"), STAT_TopDown_DecalsActive, STATGROUP_TopDown);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Decals Recycled"), STAT_TopDown_DecalsRecycled, STATGROUP_TopDown);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Decals Merged"), STAT_TopDown_DecalsMerged, STATGROUP_TopDown);
+TRACE_DECLARE_INT_COUNTER(TopDown_Decals, TEXT("TopDown/Decals"));
+
+static TAutoConsoleVariable<int32> CVarDecalBudget(
+	TEXT("TopDown.Decals.Budget"),
+	256,
+	TEXT("Hit decals alive at once, the oldest one is recycled above it. Set per sg.EffectsQuality in DefaultScalability.ini"),
+	ECVF_Scalability);
+
+static TAutoConsoleVariable<int32> CVarDecalMaxPerSurface(
+	TEXT("TopDown.Decals.MaxPerSurface"),
+	128,
+	TEXT("Hit decals alive at once on one surface type, the oldest one of the surface is recycled above it"));
+
+static TAutoConsoleVariable<float> CVarDecalMergeDistance(
+	TEXT("TopDown.Decals.MergeDistance"),
+	8.0f,
+	TEXT("A hit this close to a live decal of the same material refreshes it instead of placing a new one, 0 - no merging"));
+
+static TAutoConsoleVariable<float> CVarDecalLifeTime(
+	TEXT("TopDown.Decals.LifeTime"),
+	10.0f,
+	TEXT("Seconds a hit decal stays, 0 - until it is recycled"));
+
+static TAutoConsoleVariable<float> CVarDecalFadeDuration(
+	TEXT("TopDown.Decals.FadeDuration"),
+	1.0f,
+	TEXT("Seconds at the end of the life time the decal fades out, the material multiplies its opacity by the alpha of Decal Color"));
+
+static FAutoConsoleCommandWithWorld DumpDecalsCommand(
+	TEXT("TopDown.Decals.Dump"),
+	TEXT("Log active decals per surface type and recycle/merge counts"),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* World)
+	{
+		if (UDecalManagerSubsystem* DecalManager = World ? World->GetSubsystem<UDecalManagerSubsystem>() : nullptr)
+		{
+			DecalManager->DumpStats();
+		}
+	}));
+
+bool UDecalManagerSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	//decals are never seen on a dedicated server
+	return !IsRunningDedicatedServer() && Super::ShouldCreateSubsystem(Outer);
+}
+
+bool UDecalManagerSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void UDecalManagerSubsystem::Deinitialize()
+{
+	DEC_DWORD_STAT_BY(STAT_TopDown_DecalsActive, NumActive);
+
+	Decals.Empty();
+	FreeSlots.Empty();
+	ComponentHost = nullptr;
+	NumActive = 0;
+
+	Super::Deinitialize();
+}
+
+TStatId UDecalManagerSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UDecalManagerSubsystem, STATGROUP_TopDown);
+}
+
+void UDecalManagerSubsystem::Tick(float DeltaTime)
+{
+	ApplyBudget(FMath::Max(CVarDecalBudget.GetValueOnGameThread(), 0));
+	ExpireDecals();
+
+	TRACE_COUNTER_SET(TopDown_Decals, NumActive);
+}
+
+bool UDecalManagerSubsystem::AddDecal(UMaterialInterface* Material, EPhysicalSurface Surface, const FHitResult& Hit)
+{
+	LLM_SCOPE_BYTAG(TopDown_Decals);
+
+	if (!Material)
+		return false;
+
+	if (Surface >= SurfaceType_Max)
+		Surface = SurfaceType_Default;
+
+	const double Now = GetWorld()->GetTimeSeconds();
+
+	int32 Slot = FindMergeSlot(Material, Hit.ImpactPoint);
+	if (Slot != INDEX_NONE)
+	{
+		//same hole hit again, only its life time starts over
+		FManagedDecal& Decal = Decals[Slot];
+		Decal.SpawnTime = Now;
+		SetOpacity(Decal, 1.0f);
+
+		NumMerged++;
+		INC_DWORD_STAT(STAT_TopDown_DecalsMerged);
+		return false;
+	}
+
+	Slot = AcquireSlot(Surface, FMath::Max(CVarDecalBudget.GetValueOnGameThread(), 0));
+	if (Slot == INDEX_NONE)
+		return false;
+
+	FManagedDecal& Decal = Decals[Slot];
+	UDecalComponent* Component = Decal.Component;
+
+	//moving bodies carry their decals, everything else stays under the host
+	USceneComponent* AttachTo = Hit.GetComponent();
+	if (!AttachTo || AttachTo->Mobility != EComponentMobility::Movable)
+		AttachTo = ComponentHost->GetRootComponent();
+
+	Component->AttachToComponent(AttachTo, FAttachmentTransformRules::KeepWorldTransform);
+	Component->SetWorldLocationAndRotation(Hit.ImpactPoint, Hit.ImpactNormal.Rotation());
+	Component->SetDecalMaterial(Material);
+	SetOpacity(Decal, 1.0f);
+	Component->SetVisibility(true);
+
+	Decal.Material = Material;
+	Decal.Location = Hit.ImpactPoint;
+	Decal.SpawnTime = Now;
+	Decal.Surface = Surface;
+	Decal.bActive = true;
+
+	NumPerSurface[Surface]++;
+	NumActive++;
+	INC_DWORD_STAT(STAT_TopDown_DecalsActive);
+
+	return true;
+}
+
+int32 UDecalManagerSubsystem::FindMergeSlot(const UMaterialInterface* Material, const FVector& Location) const
+{
+	const float MergeDistance = CVarDecalMergeDistance.GetValueOnGameThread();
+	if (MergeDistance <= 0.0f)
+		return INDEX_NONE;
+
+	//linear, the budget is a few hundred slots
+	const float MergeDistanceSquared = FMath::Square(MergeDistance);
+	for (int32 i = 0; i < Decals.Num(); i++)
+	{
+		const FManagedDecal& Decal = Decals[i];
+		if (Decal.bActive && Decal.Material == Material && FVector::DistSquared(Decal.Location, Location) <= MergeDistanceSquared)
+			return i;
+	}
+
+	return INDEX_NONE;
+}
+
+int32 UDecalManagerSubsystem::FindOldestSlot(EPhysicalSurface Surface) const
+{
+	int32 Result = INDEX_NONE;
+	for (int32 i = 0; i < Decals.Num(); i++)
+	{
+		const FManagedDecal& Decal = Decals[i];
+		if (Decal.bActive && Decal.Surface == Surface && (Result == INDEX_NONE || Decal.SpawnTime < Decals[Result].SpawnTime))
+			Result = i;
+	}
+
+	return Result;
+}
+
+int32 UDecalManagerSubsystem::AcquireSlot(EPhysicalSurface Surface, int32 Budget)
+{
+	if (Budget <= 0)
+		return INDEX_NONE;
+
+	int32 Slot = INDEX_NONE;
+	if (NumPerSurface[Surface] >= FMath::Max(CVarDecalMaxPerSurface.GetValueOnGameThread(), 1))
+	{
+		Slot = FindOldestSlot(Surface);
+	}
+	else if (FreeSlots.Num() > 0)
+	{
+		Slot = FreeSlots.Pop(false);
+	}
+	else if (Decals.Num() < Budget)
+	{
+		UDecalComponent* Component = CreateDecalComponent();
+		if (!Component)
+			return INDEX_NONE;
+
+		Slot = Decals.AddDefaulted();
+		Decals[Slot].Component = Component;
+	}
+	else
+	{
+		//budget used up, the cursor walks the slots in the order they were filled
+		Slot = RingCursor;
+		RingCursor = (RingCursor + 1) % Decals.Num();
+	}
+
+	if (Decals[Slot].bActive)
+	{
+		ReleaseSlot(Slot);
+		FreeSlots.RemoveSingleSwap(Slot, false);
+
+		NumRecycled++;
+		INC_DWORD_STAT(STAT_TopDown_DecalsRecycled);
+	}
+
+	if (!IsValid(Decals[Slot].Component))
+		Decals[Slot].Component = CreateDecalComponent();
+
+	return Decals[Slot].Component ? Slot : INDEX_NONE;
+}
+
+void UDecalManagerSubsystem::ReleaseSlot(int32 Slot)
+{
+	FManagedDecal& Decal = Decals[Slot];
+	if (!Decal.bActive)
+		return;
+
+	if (IsValid(Decal.Component))
+		Decal.Component->SetVisibility(false);
+
+	Decal.bActive = false;
+	Decal.Material = nullptr;
+	NumPerSurface[Decal.Surface]--;
+	NumActive--;
+	DEC_DWORD_STAT(STAT_TopDown_DecalsActive);
+
+	FreeSlots.Add(Slot);
+}
+
+void UDecalManagerSubsystem::ExpireDecals()
+{
+	const float LifeTime = CVarDecalLifeTime.GetValueOnGameThread();
+	if (LifeTime <= 0.0f || NumActive == 0)
+		return;
+
+	const double Now = GetWorld()->GetTimeSeconds();
+	const float FadeDuration = FMath::Clamp(CVarDecalFadeDuration.GetValueOnGameThread(), 0.0f, LifeTime);
+
+	for (int32 i = 0; i < Decals.Num(); i++)
+	{
+		FManagedDecal& Decal = Decals[i];
+		if (!Decal.bActive)
+			continue;
+
+		const double TimeLeft = Decal.SpawnTime + LifeTime - Now;
+
+		//the component can be destroyed with the level it was attached to
+		if (TimeLeft <= 0.0 || !IsValid(Decal.Component))
+			ReleaseSlot(i);
+		else if (TimeLeft < FadeDuration)
+			SetOpacity(Decal, float(TimeLeft / FadeDuration));
+	}
+}
+
+void UDecalManagerSubsystem::SetOpacity(FManagedDecal& Decal, float Opacity)
+{
+	//a new color recreates the render proxy, steps below what can be seen are skipped
+	if (FMath::Abs(Decal.Opacity - Opacity) < 1.0f / 64.0f && (Opacity < 1.0f || Decal.Opacity == 1.0f))
+		return;
+
+	Decal.Opacity = Opacity;
+	if (IsValid(Decal.Component))
+		Decal.Component->SetDecalColor(FLinearColor(1.0f, 1.0f, 1.0f, Opacity));
+}
+
+void UDecalManagerSubsystem::ApplyBudget(int32 Budget)
+{
+	if (Decals.Num() <= Budget)
+		return;
+
+	//scalability lowered the budget, drop the slots above it
+	for (int32 i = Decals.Num() - 1; i >= Budget; i--)
+	{
+		ReleaseSlot(i);
+		if (IsValid(Decals[i].Component))
+			Decals[i].Component->DestroyComponent();
+	}
+
+	Decals.SetNum(Budget);
+	FreeSlots.RemoveAll([Budget](int32 Slot) { return Slot >= Budget; });
+	RingCursor = Budget > 0 ? RingCursor % Budget : 0;
+}
+
+UDecalComponent* UDecalManagerSubsystem::CreateDecalComponent()
+{
+	if (!ComponentHost)
+		ComponentHost = UMyTypes::SpawnInstancedMeshHost(GetWorld(), TEXT("Decals"));
+
+	if (!ComponentHost)
+		return nullptr;
+
+	UDecalComponent* Component = NewObject<UDecalComponent>(ComponentHost);
+	Component->DecalSize = FVector(20.0f);
+	Component->SetUsingAbsoluteScale(true);
+	Component->SetVisibility(false);
+	Component->SetupAttachment(ComponentHost->GetRootComponent());
+	Component->RegisterComponent();
+
+	return Component;
+}
+
+void UDecalManagerSubsystem::DumpStats() const
+{
+	for (int32 Surface = 0; Surface < SurfaceType_Max; Surface++)
+	{
+		if (NumPerSurface[Surface] > 0)
+			UE_LOG(LogTopDown, Display, TEXT("surface %d: %d decals"), Surface, NumPerSurface[Surface]);
+	}
+	UE_LOG(LogTopDown, Display, TEXT("decals: active %d, slots %d, recycled %lld, merged %lld"), NumActive, Decals.Num(), NumRecycled, NumMerged);
+}
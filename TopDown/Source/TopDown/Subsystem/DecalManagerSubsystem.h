@@ -0,0 +1,80 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Chaos/ChaosEngineInterface.h"
+#include "DecalManagerSubsystem.generated.h"
+
+class UDecalComponent;
+class UMaterialInterface;
+
+USTRUCT()
+struct FManagedDecal
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	UDecalComponent* Component = nullptr;
+	UPROPERTY()
+	UMaterialInterface* Material = nullptr;
+
+	FVector Location = FVector::ZeroVector;
+	double SpawnTime = 0.0;
+	//alpha of the decal color last pushed to the component
+	float Opacity = 1.0f;
+	TEnumAsByte<EPhysicalSurface> Surface = SurfaceType_Default;
+	bool bActive = false;
+};
+
+//Hit decals from a fixed budget of reused components (TopDown.Decals.Budget, per scalability level).
+//Slots are recycled oldest first, a hit close to a live decal of the same material refreshes it instead, each surface type has its own cap.
+//Decals fade through the alpha of their decal color (Decal Color node of the material) and are hidden on expiry, components are never destroyed by a lifespan.
+//Not created on a dedicated server
+UCLASS()
+class UDecalManagerSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	//false if the decal merged into an existing one or couldn't be placed
+	bool AddDecal(UMaterialInterface* Material, EPhysicalSurface Surface, const FHitResult& Hit);
+
+	int32 GetNumActive() const { return NumActive; }
+	int64 GetNumRecycled() const { return NumRecycled; }
+	int64 GetNumMerged() const { return NumMerged; }
+	void DumpStats() const;
+
+protected:
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+	int32 FindMergeSlot(const UMaterialInterface* Material, const FVector& Location) const;
+	int32 FindOldestSlot(EPhysicalSurface Surface) const;
+	int32 AcquireSlot(EPhysicalSurface Surface, int32 Budget);
+	void ReleaseSlot(int32 Slot);
+	//fades decals at the end of their life time and releases the expired ones
+	void ExpireDecals();
+	void SetOpacity(FManagedDecal& Decal, float Opacity);
+	void ApplyBudget(int32 Budget);
+	UDecalComponent* CreateDecalComponent();
+
+	UPROPERTY()
+	TArray<FManagedDecal> Decals;
+	UPROPERTY()
+	AActor* ComponentHost = nullptr;
+
+	TArray<int32> FreeSlots;
+	//next slot to recycle once the budget is used up
+	int32 RingCursor = 0;
+	int32 NumActive = 0;
+	int32 NumPerSurface[SurfaceType_Max] = {};
+
+	int64 NumRecycled = 0;
+	int64 NumMerged = 0;
+};
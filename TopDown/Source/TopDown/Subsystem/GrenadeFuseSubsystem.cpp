@@ -0,0 +1,111 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GrenadeFuseSubsystem.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "TopDown/TopDown.h"
+#include "TopDown/ProjectileDefault_Grenade.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Grenades Armed"), STAT_TopDown_GrenadesArmed, STATGROUP_TopDown);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Grenades Detonated"), STAT_TopDown_GrenadesDetonated, STATGROUP_TopDown);
+
+static TAutoConsoleVariable<int32> CVarGrenadeMaxDetonationsPerFrame(
+	TEXT("TopDown.Grenade.MaxDetonationsPerFrame"),
+	256,
+	TEXT("Grenades going off in one frame, the rest wait for the next frame"));
+
+bool UGrenadeFuseSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void UGrenadeFuseSubsystem::Deinitialize()
+{
+	DEC_DWORD_STAT_BY(STAT_TopDown_GrenadesArmed, Fuses.Num());
+
+	Fuses.Empty();
+
+	Super::Deinitialize();
+}
+
+TStatId UGrenadeFuseSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UGrenadeFuseSubsystem, STATGROUP_TopDown);
+}
+
+bool UGrenadeFuseSubsystem::IsFuseCurrent(const FGrenadeFuse& Fuse) const
+{
+	const AProjectileDefault_Grenade* Grenade = Fuse.Grenade.Get();
+	return Grenade && Grenade->FuseId == Fuse.FuseId;
+}
+
+uint32 UGrenadeFuseSubsystem::ScheduleFuse(AProjectileDefault_Grenade* Grenade, float Delay)
+{
+	if (!Grenade)
+		return 0;
+
+	//0 means not armed
+	if (++LastFuseId == 0)
+		++LastFuseId;
+
+	FGrenadeFuse Fuse;
+	Fuse.DetonationTime = GetWorld()->GetTimeSeconds() + FMath::Max(Delay, 0.0f);
+	Fuse.Grenade = Grenade;
+	Fuse.FuseId = LastFuseId;
+
+	Grenade->FuseId = LastFuseId;
+	Fuses.HeapPush(Fuse);
+	INC_DWORD_STAT(STAT_TopDown_GrenadesArmed);
+
+	return LastFuseId;
+}
+
+int32 UGrenadeFuseSubsystem::TriggerSympathetic(const FVector& Origin, float Radius, float Delay)
+{
+	if (Radius <= 0.0f || Fuses.Num() == 0)
+		return 0;
+
+	const double DetonationTime = GetWorld()->GetTimeSeconds() + FMath::Max(Delay, 0.0f);
+
+	int32 NumTriggered = 0;
+	for (FGrenadeFuse& Fuse : Fuses)
+	{
+		if (Fuse.DetonationTime <= DetonationTime || !IsFuseCurrent(Fuse))
+			continue;
+
+		if (FVector::DistSquared(Fuse.Grenade->GetActorLocation(), Origin) > FMath::Square(Radius))
+			continue;
+
+		Fuse.DetonationTime = DetonationTime;
+		NumTriggered++;
+	}
+
+	//only ever shortened, cheaper to rebuild once than to sift every entry
+	if (NumTriggered > 0)
+		Fuses.Heapify();
+
+	return NumTriggered;
+}
+
+void UGrenadeFuseSubsystem::Tick(float DeltaTime)
+{
+	const double Now = GetWorld()->GetTimeSeconds();
+	int32 DetonationsLeft = FMath::Max(CVarGrenadeMaxDetonationsPerFrame.GetValueOnGameThread(), 1);
+
+	//explosions may push fuses due now, they are popped by this same loop
+	while (Fuses.Num() > 0 && Fuses.HeapTop().DetonationTime <= Now && DetonationsLeft > 0)
+	{
+		FGrenadeFuse Fuse;
+		Fuses.HeapPop(Fuse, false);
+		DEC_DWORD_STAT(STAT_TopDown_GrenadesArmed);
+
+		if (!IsFuseCurrent(Fuse))
+			continue;
+
+		DetonationsLeft--;
+		INC_DWORD_STAT(STAT_TopDown_GrenadesDetonated);
+
+		Fuse.Grenade->Explose();
+	}
+}
@@ -0,0 +1,47 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "GrenadeFuseSubsystem.generated.h"
+
+class AProjectileDefault_Grenade;
+
+struct FGrenadeFuse
+{
+	double DetonationTime = 0.0;
+	TWeakObjectPtr<AProjectileDefault_Grenade> Grenade;
+	//must match the grenade's FuseId, a pooled grenade reused since is left alone
+	uint32 FuseId = 0;
+
+	bool operator<(const FGrenadeFuse& Other) const { return DetonationTime < Other.DetonationTime; }
+};
+
+//Detonation times of armed grenades in one min-heap, grenades don't tick.
+//Due fuses go off in one loop, a detonation that arms or shortens other fuses is handled by the same loop instead of recursion
+UCLASS()
+class UGrenadeFuseSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	//sets Grenade->FuseId, 0 - nothing was scheduled
+	uint32 ScheduleFuse(AProjectileDefault_Grenade* Grenade, float Delay);
+	//armed grenades within Radius go off after Delay unless they would sooner, returns how many were shortened
+	int32 TriggerSympathetic(const FVector& Origin, float Radius, float Delay);
+
+	int32 GetNumArmed() const { return Fuses.Num(); }
+
+protected:
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+	bool IsFuseCurrent(const FGrenadeFuse& Fuse) const;
+
+	TArray<FGrenadeFuse> Fuses;
+	uint32 LastFuseId = 0;
+};
@@ -0,0 +1,144 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HitScanSubsystem.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Kismet/GameplayStatics.h"
+#include "PhysicalMaterials/PhysicalMaterial.h"
+#include "TopDown/TopDown.h"
+#include "TopDown/FuncLibrary/TopDownAllocCounter.h"
+#include "TopDown/FuncLibrary/TopDownDebugDraw.h"
+#include "TopDown/ProjectileDefault.h"
+#include "TopDown/WeaponDefault.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("HitScan Traces"), STAT_TopDown_HitScanTraces, STATGROUP_TopDown);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("HitScan Traces In Flight"), STAT_TopDown_HitScanTracesInFlight, STATGROUP_TopDown);
+
+static TAutoConsoleVariable<int32> CVarHitScanSynchronous(
+	TEXT("TopDown.HitScan.Synchronous"),
+	0,
+	TEXT("1 - trace hit-scan shots immediately on the game thread (debug), 0 - batch them as async traces"));
+
+bool UHitScanSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void UHitScanSubsystem::Deinitialize()
+{
+	DEC_DWORD_STAT_BY(STAT_TopDown_HitScanTracesInFlight, InFlightRequests.Num());
+
+	PendingRequests.Empty();
+	InFlightRequests.Empty();
+
+	Super::Deinitialize();
+}
+
+TStatId UHitScanSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UHitScanSubsystem, STATGROUP_TopDown);
+}
+
+void UHitScanSubsystem::RequestTrace(const FVector& Start, const FVector& End, AWeaponDefault* Weapon)
+{
+	const FWeaponInfo* WeaponSetting = Weapon ? Weapon->GetWeaponSetting() : nullptr;
+	if (!WeaponSetting)
+		return;
+
+	INC_DWORD_STAT(STAT_TopDown_HitScanTraces);
+
+	FHitScanRequest Request;
+	Request.Start = Start;
+	Request.End = End;
+	Request.Weapon = Weapon;
+	Request.InstigatorController = Weapon->GetInstigatorController();
+	Request.Damage = WeaponSetting->WeaponDamage;
+	Request.ImpactTable = Weapon->HitScanImpactTable;
+
+	if (CVarHitScanSynchronous.GetValueOnGameThread() > 0)
+	{
+		FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(HitScan), false);
+		QueryParams.bReturnPhysicalMaterial = true;
+
+		FHitResult HitResult;
+		const bool bHit = GetWorld()->LineTraceSingleByChannel(HitResult, Start, End, ECC_PhysicsBody, QueryParams);
+		ApplyHitScanResult(Request, bHit ? &HitResult : nullptr);
+		return;
+	}
+
+	PendingRequests.Add(Request);
+}
+
+void UHitScanSubsystem::Tick(float DeltaTime)
+{
+	CollectFinishedTraces();
+	SubmitPendingTraces();
+}
+
+void UHitScanSubsystem::SubmitPendingTraces()
+{
+	if (PendingRequests.Num() == 0)
+		return;
+
+	UWorld* World = GetWorld();
+
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(HitScan), false);
+	QueryParams.bReturnPhysicalMaterial = true;
+
+	for (FHitScanRequest& Request : PendingRequests)
+	{
+		Request.TraceHandle = World->AsyncLineTraceByChannel(EAsyncTraceType::Single, Request.Start, Request.End, ECC_PhysicsBody, QueryParams);
+	}
+
+	INC_DWORD_STAT_BY(STAT_TopDown_HitScanTracesInFlight, PendingRequests.Num());
+
+	InFlightRequests.Append(PendingRequests);
+	PendingRequests.Reset();
+}
+
+void UHitScanSubsystem::CollectFinishedTraces()
+{
+	if (InFlightRequests.Num() == 0)
+		return;
+
+	UWorld* World = GetWorld();
+
+	FTraceDatum TraceData;
+	for (int32 i = 0; i < InFlightRequests.Num(); i++)
+	{
+		const FHitScanRequest& Request = InFlightRequests[i];
+
+		if (World->QueryTraceData(Request.TraceHandle, TraceData))
+		{
+			ApplyHitScanResult(Request, TraceData.OutHits.Num() > 0 && TraceData.OutHits[0].bBlockingHit ? &TraceData.OutHits[0] : nullptr);
+		}
+		else if (World->IsTraceHandleValid(Request.TraceHandle, false))
+		{
+			//not finished yet
+			continue;
+		}
+
+		InFlightRequests.RemoveAtSwap(i--, 1, false);
+		DEC_DWORD_STAT(STAT_TopDown_HitScanTracesInFlight);
+	}
+}
+
+void UHitScanSubsystem::ApplyHitScanResult(const FHitScanRequest& Request, const FHitResult* HitResult)
+{
+	TOPDOWN_ALLOC_SCOPE(HitScanImpact);
+
+	AWeaponDefault* Weapon = Request.Weapon.Get();
+
+	if (!HitResult)
+		return;
+
+	if (Request.ImpactTable.IsValid() && HitResult->GetActor() && HitResult->PhysMaterial.IsValid())
+	{
+		AProjectileDefault::SpawnHitEffects(GetWorld(), *Request.ImpactTable, *HitResult);
+	}
+
+	UGameplayStatics::ApplyDamage(HitResult->GetActor(), Request.Damage, Request.InstigatorController.Get(), Weapon, NULL);
+
+	TOPDOWN_DEBUG_LINE(Weapons, GetWorld(), Request.Start, Request.End, FColor::Yellow, 5.f, 0.5f);
+}
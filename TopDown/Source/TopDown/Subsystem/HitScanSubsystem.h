@@ -0,0 +1,50 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "WorldCollision.h"
+#include "HitScanSubsystem.generated.h"
+
+class AWeaponDefault;
+struct FSurfaceImpactTable;
+
+struct FHitScanRequest
+{
+	FVector Start = FVector::ZeroVector;
+	FVector End = FVector::ZeroVector;
+	TWeakObjectPtr<AWeaponDefault> Weapon;
+	TWeakObjectPtr<AController> InstigatorController;
+	float Damage = 0.0f;
+	TSharedPtr<const FSurfaceImpactTable> ImpactTable;
+
+	FTraceHandle TraceHandle;
+};
+
+//Collects hit-scan traces of a frame and submits them as async traces at the end of it,
+//decals and damage are applied when the results come back next frame
+UCLASS()
+class UHitScanSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	void RequestTrace(const FVector& Start, const FVector& End, AWeaponDefault* Weapon);
+
+protected:
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+	void SubmitPendingTraces();
+	void CollectFinishedTraces();
+	void ApplyHitScanResult(const FHitScanRequest& Request, const FHitResult* HitResult);
+
+	//requested this frame
+	TArray<FHitScanRequest> PendingRequests;
+	//submitted, waiting for the trace results
+	TArray<FHitScanRequest> InFlightRequests;
+};
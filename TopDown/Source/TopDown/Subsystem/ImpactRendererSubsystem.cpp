@@ -0,0 +1,154 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ImpactRendererSubsystem.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/App.h"
+#include "NiagaraComponent.h"
+#include "NiagaraDataInterfaceArrayFunctionLibrary.h"
+#include "NiagaraSystem.h"
+#include "TopDown/TopDown.h"
+#include "TopDown/FuncLibrary/MyTypes.h"
+#include "TopDownFXSubsystem.h"
+
+DECLARE_CYCLE_STAT(TEXT("Impact Batches Flush"), STAT_TopDown_ImpactBatchesFlush, STATGROUP_TopDown);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Batched Impacts"), STAT_TopDown_BatchedImpacts, STATGROUP_TopDown);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Batched Impacts Culled"), STAT_TopDown_BatchedImpactsCulled, STATGROUP_TopDown);
+
+static TAutoConsoleVariable<int32> CVarImpactRendererMaxPerFrame(
+	TEXT("TopDown.ImpactRenderer.MaxPerFrame"),
+	1024,
+	TEXT("Impacts one batched system receives per frame, the rest are dropped"));
+
+static const FName ImpactPositionsName(TEXT("User.ImpactPositions"));
+static const FName ImpactNormalsName(TEXT("User.ImpactNormals"));
+static const FName ImpactCountName(TEXT("User.ImpactCount"));
+
+static FAutoConsoleCommandWithWorld DumpImpactRendererCommand(
+	TEXT("TopDown.ImpactRenderer.Dump"),
+	TEXT("Log gathered/culled/flushed batched impact counts"),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* World)
+	{
+		if (UImpactRendererSubsystem* ImpactRenderer = World ? World->GetSubsystem<UImpactRendererSubsystem>() : nullptr)
+		{
+			UE_LOG(LogTopDown, Display, TEXT("Batched impacts: gathered %lld, culled %lld, flushed %lld, pending %d"), ImpactRenderer->GetNumGathered(), ImpactRenderer->GetNumCulled(), ImpactRenderer->GetNumFlushed(), ImpactRenderer->GetNumPending());
+		}
+	}));
+
+bool UImpactRendererSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void UImpactRendererSubsystem::Deinitialize()
+{
+	Batches.Empty();
+	ComponentHost = nullptr;
+
+	Super::Deinitialize();
+}
+
+TStatId UImpactRendererSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UImpactRendererSubsystem, STATGROUP_TopDown);
+}
+
+bool UImpactRendererSubsystem::AddImpact(UNiagaraSystem* System, const FVector& Position, const FVector& Normal)
+{
+	LLM_SCOPE_BYTAG(TopDown_FX);
+
+	if (!System)
+		return false;
+
+	//same view distance as single effects
+	const UTopDownFXSubsystem* FX = GetWorld()->GetSubsystem<UTopDownFXSubsystem>();
+	FImpactBatch* Batch = Batches.FindByPredicate([System](const FImpactBatch& Item) { return Item.System == System; });
+	const int32 MaxPerFrame = CVarImpactRendererMaxPerFrame.GetValueOnGameThread();
+
+	if ((FX && !FX->IsInViewRange(Position)) || (Batch && Batch->Positions.Num() >= MaxPerFrame))
+	{
+		NumCulled++;
+		INC_DWORD_STAT(STAT_TopDown_BatchedImpactsCulled);
+		return false;
+	}
+
+	if (!Batch)
+	{
+		Batch = &Batches.AddDefaulted_GetRef();
+		Batch->System = System;
+	}
+
+	Batch->Positions.Add(Position);
+	Batch->Normals.Add(Normal);
+
+	NumGathered++;
+	INC_DWORD_STAT(STAT_TopDown_BatchedImpacts);
+	return true;
+}
+
+int32 UImpactRendererSubsystem::GetNumPending() const
+{
+	int32 Result = 0;
+	for (const FImpactBatch& Batch : Batches)
+		Result += Batch.Positions.Num();
+	return Result;
+}
+
+void UImpactRendererSubsystem::Tick(float DeltaTime)
+{
+	FlushBatches();
+}
+
+void UImpactRendererSubsystem::FlushBatches()
+{
+	LLM_SCOPE_BYTAG(TopDown_FX);
+
+	SCOPE_CYCLE_COUNTER(STAT_TopDown_ImpactBatchesFlush);
+
+	//headless runs gather and cull the same way, only the hand over to Niagara is skipped
+	const bool bCanRender = FApp::CanEverRender();
+
+	for (FImpactBatch& Batch : Batches)
+	{
+		const int32 NumImpacts = Batch.Positions.Num();
+
+		if (bCanRender && (NumImpacts > 0 || Batch.Component))
+		{
+			if (!Batch.Component)
+				Batch.Component = CreateBatchComponent(Batch.System);
+
+			if (Batch.Component)
+			{
+				//an empty frame clears the arrays so last frame's impacts don't spawn again
+				UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayVector(Batch.Component, ImpactPositionsName, Batch.Positions);
+				UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayVector(Batch.Component, ImpactNormalsName, Batch.Normals);
+				Batch.Component->SetVariableInt(ImpactCountName, NumImpacts);
+			}
+		}
+
+		NumFlushed += NumImpacts;
+		Batch.Positions.Reset();
+		Batch.Normals.Reset();
+	}
+}
+
+UNiagaraComponent* UImpactRendererSubsystem::CreateBatchComponent(UNiagaraSystem* System)
+{
+	if (!ComponentHost)
+		ComponentHost = UMyTypes::SpawnInstancedMeshHost(GetWorld(), TEXT("ImpactRenderer"));
+
+	if (!ComponentHost || !System)
+		return nullptr;
+
+	UNiagaraComponent* Component = NewObject<UNiagaraComponent>(ComponentHost);
+	Component->SetAutoDestroy(false);
+	Component->SetAsset(System);
+	Component->SetupAttachment(ComponentHost->GetRootComponent());
+	//particles are spawned in world space from the arrays, the component itself never moves
+	Component->SetUsingAbsoluteLocation(true);
+	Component->RegisterComponent();
+	Component->Activate(true);
+
+	return Component;
+}
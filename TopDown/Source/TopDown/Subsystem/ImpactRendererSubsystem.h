@@ -0,0 +1,63 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "ImpactRendererSubsystem.generated.h"
+
+class UNiagaraSystem;
+class UNiagaraComponent;
+
+//Impacts of one frame drawn by one Niagara system
+USTRUCT()
+struct FImpactBatch
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	UNiagaraSystem* System = nullptr;
+	//long-lived, nullptr when nothing can be rendered (-nullrhi, dedicated server)
+	UPROPERTY()
+	UNiagaraComponent* Component = nullptr;
+
+	TArray<FVector> Positions;
+	TArray<FVector> Normals;
+};
+
+//Gathers impacts of a frame per Niagara system and hands them over as arrays once per frame.
+//The system reads User.ImpactPositions and User.ImpactNormals (array data interfaces) and User.ImpactCount
+UCLASS()
+class UImpactRendererSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	//false if the impact is culled
+	bool AddImpact(UNiagaraSystem* System, const FVector& Position, const FVector& Normal);
+
+	//counters since the world started, gathering works without rendering
+	int64 GetNumGathered() const { return NumGathered; }
+	int64 GetNumCulled() const { return NumCulled; }
+	int64 GetNumFlushed() const { return NumFlushed; }
+	int32 GetNumPending() const;
+
+protected:
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+	void FlushBatches();
+	UNiagaraComponent* CreateBatchComponent(UNiagaraSystem* System);
+
+	UPROPERTY()
+	TArray<FImpactBatch> Batches;
+	UPROPERTY()
+	AActor* ComponentHost = nullptr;
+
+	int64 NumGathered = 0;
+	int64 NumCulled = 0;
+	int64 NumFlushed = 0;
+};
@@ -0,0 +1,158 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ProjectilePoolSubsystem.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "TopDown/TopDown.h"
+#include "TopDown/ProjectileDefault.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Pooled Projectiles Active"), STAT_TopDown_PooledProjectilesActive, STATGROUP_TopDown);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Pooled Projectiles Free"), STAT_TopDown_PooledProjectilesFree, STATGROUP_TopDown);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Pooled Projectiles Spawned"), STAT_TopDown_PooledProjectilesSpawned, STATGROUP_TopDown);
+TRACE_DECLARE_INT_COUNTER(TopDown_ProjectileActors, TEXT("TopDown/ProjectileActors"));
+
+static FAutoConsoleCommandWithWorld CVarDumpProjectilePool(
+	TEXT("TopDown.ProjectilePool.Dump"),
+	TEXT("Log free/active/spawned projectile counts per projectile class"),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* World)
+	{
+		if (UProjectilePoolSubsystem* Pool = World ? World->GetSubsystem<UProjectilePoolSubsystem>() : nullptr)
+		{
+			Pool->DumpPoolStats();
+		}
+	}));
+
+bool UProjectilePoolSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void UProjectilePoolSubsystem::Deinitialize()
+{
+	for (const TPair<UClass*, FProjectilePool>& Pair : Pools)
+	{
+		DEC_DWORD_STAT_BY(STAT_TopDown_PooledProjectilesActive, Pair.Value.Active);
+		DEC_DWORD_STAT_BY(STAT_TopDown_PooledProjectilesFree, Pair.Value.Free.Num());
+	}
+	Pools.Empty();
+
+	Super::Deinitialize();
+}
+
+AProjectileDefault* UProjectilePoolSubsystem::AcquireProjectile(TSubclassOf<AProjectileDefault> ProjectileClass, const FTransform& SpawnTransform, AActor* NewOwner, APawn* NewInstigator)
+{
+	if (!ProjectileClass)
+		return nullptr;
+
+	FProjectilePool& Pool = Pools.FindOrAdd(ProjectileClass.Get());
+
+	AProjectileDefault* Projectile = nullptr;
+	while (!Projectile && Pool.Free.Num() > 0)
+	{
+		Projectile = Pool.Free.Pop(false);
+		DEC_DWORD_STAT(STAT_TopDown_PooledProjectilesFree);
+
+		//actor could be destroyed from outside (level unload etc.)
+		if (!IsValid(Projectile))
+			Projectile = nullptr;
+	}
+
+	if (!Projectile)
+	{
+		Projectile = SpawnPooledProjectile(ProjectileClass.Get());
+		if (!Projectile)
+			return nullptr;
+	}
+
+	Pool.Active++;
+	INC_DWORD_STAT(STAT_TopDown_PooledProjectilesActive);
+	TRACE_COUNTER_INCREMENT(TopDown_ProjectileActors);
+
+	Projectile->SetOwner(NewOwner);
+	Projectile->SetInstigator(NewInstigator);
+	Projectile->SetActorLocationAndRotation(SpawnTransform.GetLocation(), SpawnTransform.GetRotation(), false, nullptr, ETeleportType::ResetPhysics);
+	Projectile->OnAcquiredFromPool();
+
+	return Projectile;
+}
+
+void UProjectilePoolSubsystem::ReleaseProjectile(AProjectileDefault* Projectile)
+{
+	if (!IsValid(Projectile) || Projectile->bInPool)
+		return;
+
+	Projectile->OnReleasedToPool();
+
+	FProjectilePool& Pool = Pools.FindOrAdd(Projectile->GetClass());
+	//projectiles spawned outside of the pool are adopted here
+	if (Pool.Active > 0)
+	{
+		Pool.Active--;
+		DEC_DWORD_STAT(STAT_TopDown_PooledProjectilesActive);
+		TRACE_COUNTER_DECREMENT(TopDown_ProjectileActors);
+	}
+
+	Pool.Free.Add(Projectile);
+	INC_DWORD_STAT(STAT_TopDown_PooledProjectilesFree);
+}
+
+void UProjectilePoolSubsystem::PrewarmPool(TSubclassOf<AProjectileDefault> ProjectileClass, int32 Count)
+{
+	if (!ProjectileClass)
+		return;
+
+	FProjectilePool& Pool = Pools.FindOrAdd(ProjectileClass.Get());
+	while (Pool.Free.Num() + Pool.Active < Count)
+	{
+		AProjectileDefault* Projectile = SpawnPooledProjectile(ProjectileClass.Get());
+		if (!Projectile)
+			break;
+
+		Projectile->OnReleasedToPool();
+		Pool.Free.Add(Projectile);
+		INC_DWORD_STAT(STAT_TopDown_PooledProjectilesFree);
+	}
+}
+
+FProjectilePoolStats UProjectilePoolSubsystem::GetPoolStats(TSubclassOf<AProjectileDefault> ProjectileClass) const
+{
+	FProjectilePoolStats Stats;
+	if (const FProjectilePool* Pool = Pools.Find(ProjectileClass.Get()))
+	{
+		Stats.Free = Pool->Free.Num();
+		Stats.Active = Pool->Active;
+		Stats.Spawned = Pool->Spawned;
+	}
+	return Stats;
+}
+
+void UProjectilePoolSubsystem::DumpPoolStats() const
+{
+	for (const TPair<UClass*, FProjectilePool>& Pair : Pools)
+	{
+		UE_LOG(LogTopDown, Log, TEXT("UProjectilePoolSubsystem - %s: Free = %d. Active = %d. Spawned = %d"), *GetNameSafe(Pair.Key), Pair.Value.Free.Num(), Pair.Value.Active, Pair.Value.Spawned);
+	}
+}
+
+AProjectileDefault* UProjectilePoolSubsystem::SpawnPooledProjectile(UClass* ProjectileClass)
+{
+	LLM_SCOPE_BYTAG(TopDown_Projectiles);
+
+	UWorld* World = GetWorld();
+	if (!World)
+		return nullptr;
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	SpawnParams.ObjectFlags |= RF_Transient;
+
+	AProjectileDefault* Projectile = World->SpawnActor<AProjectileDefault>(ProjectileClass, FTransform::Identity, SpawnParams);
+	if (Projectile)
+	{
+		Pools.FindOrAdd(ProjectileClass).Spawned++;
+		INC_DWORD_STAT(STAT_TopDown_PooledProjectilesSpawned);
+	}
+
+	return Projectile;
+}
@@ -0,0 +1,67 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "ProjectilePoolSubsystem.generated.h"
+
+class AProjectileDefault;
+
+USTRUCT()
+struct FProjectilePool
+{
+	GENERATED_BODY()
+
+	//inactive projectiles ready to be reused
+	UPROPERTY()
+	TArray<AProjectileDefault*> Free;
+
+	//projectiles currently flying
+	int32 Active = 0;
+	//projectiles ever spawned for this class
+	int32 Spawned = 0;
+};
+
+USTRUCT(BlueprintType)
+struct FProjectilePoolStats
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category = "ProjectilePool")
+	int32 Free = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "ProjectilePool")
+	int32 Active = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "ProjectilePool")
+	int32 Spawned = 0;
+};
+
+//Recycles AProjectileDefault (and child) actors instead of spawning a new one per shot
+UCLASS()
+class UProjectilePoolSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Deinitialize() override;
+
+	//returns a projectile placed at SpawnTransform, movement is started by InitProjectile
+	AProjectileDefault* AcquireProjectile(TSubclassOf<AProjectileDefault> ProjectileClass, const FTransform& SpawnTransform, AActor* NewOwner, APawn* NewInstigator);
+	void ReleaseProjectile(AProjectileDefault* Projectile);
+
+	//spawn inactive projectiles up to Count so the first shots don't pay for actor construction
+	void PrewarmPool(TSubclassOf<AProjectileDefault> ProjectileClass, int32 Count);
+
+	UFUNCTION(BlueprintCallable, Category = "ProjectilePool")
+	FProjectilePoolStats GetPoolStats(TSubclassOf<AProjectileDefault> ProjectileClass) const;
+
+	void DumpPoolStats() const;
+
+protected:
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+	AProjectileDefault* SpawnPooledProjectile(UClass* ProjectileClass);
+
+	UPROPERTY()
+	TMap<UClass*, FProjectilePool> Pools;
+};
@@ -0,0 +1,310 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "RadialDamageSubsystem.h"
+#include "Components/PrimitiveComponent.h"
+#include "Engine/DamageEvents.h"
+#include "Engine/OverlapResult.h"
+#include "Engine/World.h"
+#include "GameFramework/Controller.h"
+#include "GameFramework/DamageType.h"
+#include "HAL/IConsoleManager.h"
+#include "TopDown/TopDown.h"
+
+DECLARE_CYCLE_STAT(TEXT("Radial Damage Resolve"), STAT_TopDown_RadialDamageResolve, STATGROUP_TopDown);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Explosions"), STAT_TopDown_Explosions, STATGROUP_TopDown);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Explosion LOS Traces"), STAT_TopDown_ExplosionTraces, STATGROUP_TopDown);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Damageable Actors"), STAT_TopDown_Damageables, STATGROUP_TopDown);
+
+static TAutoConsoleVariable<float> CVarRadialDamageCellSize(
+	TEXT("TopDown.RadialDamage.CellSize"),
+	500.0f,
+	TEXT("Grid cell size of damageable actors, about the typical explosion radius"));
+
+static TAutoConsoleVariable<int32> CVarRadialDamageSynchronous(
+	TEXT("TopDown.RadialDamage.Synchronous"),
+	0,
+	TEXT("1 - trace line of sight on the game thread and damage in the same frame (debug), 0 - batch them as async traces"));
+
+static TAutoConsoleVariable<int32> CVarRadialDamageOverlapFallback(
+	TEXT("TopDown.RadialDamage.OverlapFallback"),
+	1,
+	TEXT("1 - also damage actors that never registered with the subsystem, one async overlap of dynamic objects per explosion, 0 - registered actors only"));
+
+bool URadialDamageSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void URadialDamageSubsystem::Deinitialize()
+{
+	DEC_DWORD_STAT_BY(STAT_TopDown_Damageables, Damageables.Num());
+
+	Damageables.Empty();
+	DamageableLocations.Empty();
+	DamageableSet.Empty();
+	Cells.Empty();
+	PendingExplosions.Empty();
+	InFlightRequests.Empty();
+	InFlightOverlaps.Empty();
+
+	Super::Deinitialize();
+}
+
+TStatId URadialDamageSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(URadialDamageSubsystem, STATGROUP_TopDown);
+}
+
+void URadialDamageSubsystem::RegisterDamageable(AActor* Actor)
+{
+	if (!Actor || Damageables.Contains(Actor))
+		return;
+
+	Damageables.Add(Actor);
+	INC_DWORD_STAT(STAT_TopDown_Damageables);
+}
+
+void URadialDamageSubsystem::UnregisterDamageable(AActor* Actor)
+{
+	if (Damageables.RemoveSingleSwap(Actor, false) > 0)
+		DEC_DWORD_STAT(STAT_TopDown_Damageables);
+}
+
+void URadialDamageSubsystem::AddExplosion(const FVector& Origin, const FRadialDamageParams& Params, TSubclassOf<UDamageType> DamageTypeClass, AActor* DamageCauser, AController* InstigatorController)
+{
+	INC_DWORD_STAT(STAT_TopDown_Explosions);
+
+	FRadialDamageRequest& Explosion = PendingExplosions.AddDefaulted_GetRef();
+	Explosion.Origin = Origin;
+	Explosion.Params = Params;
+	Explosion.DamageTypeClass = DamageTypeClass ? DamageTypeClass : TSubclassOf<UDamageType>(UDamageType::StaticClass());
+	Explosion.DamageCauser = DamageCauser;
+	Explosion.InstigatorController = InstigatorController;
+}
+
+void URadialDamageSubsystem::Tick(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_TopDown_RadialDamageResolve);
+
+	CollectFinishedTraces();
+	//after the traces, the line of sight of what they found is traced next frame
+	CollectFinishedOverlaps();
+	ResolvePendingExplosions();
+}
+
+FIntPoint URadialDamageSubsystem::GetCell(const FVector& Location) const
+{
+	return FIntPoint(FMath::FloorToInt(Location.X / CellSize), FMath::FloorToInt(Location.Y / CellSize));
+}
+
+void URadialDamageSubsystem::RebuildGrid()
+{
+	CellSize = FMath::Max(CVarRadialDamageCellSize.GetValueOnGameThread(), 50.0f);
+
+	//cells of every place an actor ever stood would pile up, the map keeps its memory
+	Cells.Reset();
+
+	DamageableLocations.Reset(Damageables.Num());
+	DamageableSet.Reset();
+
+	for (int32 i = 0; i < Damageables.Num(); i++)
+	{
+		const AActor* Actor = Damageables[i].Get();
+		if (!IsValid(Actor))
+		{
+			Damageables.RemoveAtSwap(i--, 1, false);
+			DEC_DWORD_STAT(STAT_TopDown_Damageables);
+			continue;
+		}
+
+		DamageableLocations.Add(Actor->GetActorLocation());
+		DamageableSet.Add(Actor);
+		Cells.FindOrAdd(GetCell(DamageableLocations.Last())).Add(i);
+	}
+}
+
+void URadialDamageSubsystem::ResolvePendingExplosions()
+{
+	if (PendingExplosions.Num() == 0)
+		return;
+
+	//actors move, the grid is only valid for this frame
+	RebuildGrid();
+
+	UWorld* World = GetWorld();
+	const bool bSynchronous = CVarRadialDamageSynchronous.GetValueOnGameThread() > 0;
+	const bool bOverlapFallback = CVarRadialDamageOverlapFallback.GetValueOnGameThread() > 0;
+
+	for (const FRadialDamageRequest& Explosion : PendingExplosions)
+	{
+		const float OuterRadius = Explosion.Params.OuterRadius;
+		const FIntPoint MinCell = GetCell(Explosion.Origin - FVector(OuterRadius));
+		const FIntPoint MaxCell = GetCell(Explosion.Origin + FVector(OuterRadius));
+
+		FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(ExplosionLineOfSight), false, Explosion.DamageCauser.Get());
+
+		for (int32 X = MinCell.X; X <= MaxCell.X; X++)
+		{
+			for (int32 Y = MinCell.Y; Y <= MaxCell.Y; Y++)
+			{
+				const TArray<int32, TInlineAllocator<4>>* Cell = Cells.Find(FIntPoint(X, Y));
+				if (!Cell)
+					continue;
+
+				for (const int32 Index : *Cell)
+				{
+					const FVector& TargetLocation = DamageableLocations[Index];
+					if (FVector::DistSquared(TargetLocation, Explosion.Origin) > FMath::Square(OuterRadius))
+						continue;
+
+					AActor* Target = Damageables[Index].Get();
+					if (!Target || Target == Explosion.DamageCauser.Get())
+						continue;
+
+					RequestLineOfSight(Explosion, Target, TargetLocation, QueryParams, bSynchronous);
+				}
+			}
+		}
+
+		if (!bOverlapFallback)
+			continue;
+
+		const FCollisionObjectQueryParams ObjectParams(FCollisionObjectQueryParams::InitType::AllDynamicObjects);
+		const FCollisionShape Sphere = FCollisionShape::MakeSphere(OuterRadius);
+
+		if (bSynchronous)
+		{
+			TArray<FOverlapResult> Overlaps;
+			World->OverlapMultiByObjectType(Overlaps, Explosion.Origin, FQuat::Identity, ObjectParams, Sphere, QueryParams);
+			RequestUnregistered(Explosion, Overlaps, QueryParams, true);
+			continue;
+		}
+
+		FRadialDamageRequest& Overlap = InFlightOverlaps.Add_GetRef(Explosion);
+		Overlap.TraceHandle = World->AsyncOverlapByObjectType(Explosion.Origin, FQuat::Identity, ObjectParams, Sphere, QueryParams);
+	}
+
+	PendingExplosions.Reset();
+}
+
+void URadialDamageSubsystem::CollectFinishedOverlaps()
+{
+	if (InFlightOverlaps.Num() == 0)
+		return;
+
+	UWorld* World = GetWorld();
+
+	FOverlapDatum OverlapData;
+	for (int32 i = 0; i < InFlightOverlaps.Num(); i++)
+	{
+		const FRadialDamageRequest& Explosion = InFlightOverlaps[i];
+
+		if (World->QueryOverlapData(Explosion.TraceHandle, OverlapData))
+		{
+			FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(ExplosionLineOfSight), false, Explosion.DamageCauser.Get());
+			RequestUnregistered(Explosion, OverlapData.OutOverlaps, QueryParams, false);
+		}
+		else if (World->IsTraceHandleValid(Explosion.TraceHandle, true))
+		{
+			//not finished yet
+			continue;
+		}
+
+		InFlightOverlaps.RemoveAtSwap(i--, 1, false);
+	}
+}
+
+void URadialDamageSubsystem::RequestUnregistered(const FRadialDamageRequest& Explosion, TArrayView<const FOverlapResult> Overlaps, const FCollisionQueryParams& QueryParams, bool bSynchronous)
+{
+	//one request per actor, aimed at the first of its components like ApplyRadialDamageWithFalloff
+	TArray<const AActor*, TInlineAllocator<16>> Targets;
+	for (const FOverlapResult& Overlap : Overlaps)
+	{
+		AActor* Target = Overlap.GetActor();
+		UPrimitiveComponent* Component = Overlap.GetComponent();
+		if (!Target || !Component || DamageableSet.Contains(Target) || Targets.Contains(Target))
+			continue;
+
+		Targets.Add(Target);
+		RequestLineOfSight(Explosion, Target, Component->Bounds.Origin, QueryParams, bSynchronous);
+	}
+}
+
+void URadialDamageSubsystem::RequestLineOfSight(const FRadialDamageRequest& Explosion, AActor* Target, const FVector& TargetLocation, const FCollisionQueryParams& QueryParams, bool bSynchronous)
+{
+	INC_DWORD_STAT(STAT_TopDown_ExplosionTraces);
+
+	UWorld* World = GetWorld();
+
+	FRadialDamageRequest Request = Explosion;
+	Request.Target = Target;
+
+	if (bSynchronous)
+	{
+		FHitResult Hit;
+		const bool bBlocked = World->LineTraceSingleByChannel(Hit, Explosion.Origin, TargetLocation, ECC_Visibility, QueryParams);
+		ApplyRadialDamage(Request, bBlocked ? &Hit : nullptr);
+		return;
+	}
+
+	Request.TraceHandle = World->AsyncLineTraceByChannel(EAsyncTraceType::Single, Explosion.Origin, TargetLocation, ECC_Visibility, QueryParams);
+	InFlightRequests.Add(MoveTemp(Request));
+}
+
+void URadialDamageSubsystem::CollectFinishedTraces()
+{
+	if (InFlightRequests.Num() == 0)
+		return;
+
+	UWorld* World = GetWorld();
+
+	FTraceDatum TraceData;
+	for (int32 i = 0; i < InFlightRequests.Num(); i++)
+	{
+		const FRadialDamageRequest& Request = InFlightRequests[i];
+
+		if (World->QueryTraceData(Request.TraceHandle, TraceData))
+		{
+			ApplyRadialDamage(Request, TraceData.OutHits.Num() > 0 && TraceData.OutHits[0].bBlockingHit ? &TraceData.OutHits[0] : nullptr);
+		}
+		else if (World->IsTraceHandleValid(Request.TraceHandle, false))
+		{
+			//not finished yet
+			continue;
+		}
+
+		InFlightRequests.RemoveAtSwap(i--, 1, false);
+	}
+}
+
+void URadialDamageSubsystem::ApplyRadialDamage(const FRadialDamageRequest& Request, const FHitResult* BlockingHit)
+{
+	AActor* Target = Request.Target.Get();
+	if (!Target || !Target->CanBeDamaged())
+		return;
+
+	//something else is in between
+	if (BlockingHit && BlockingHit->GetActor() != Target)
+		return;
+
+	FHitResult TargetHit;
+	if (BlockingHit)
+	{
+		TargetHit = *BlockingHit;
+	}
+	else
+	{
+		TargetHit = FHitResult(Target, nullptr, Target->GetActorLocation(), (Request.Origin - Target->GetActorLocation()).GetSafeNormal());
+	}
+
+	//same event ApplyRadialDamageWithFalloff sends, the target scales the damage by distance itself
+	FRadialDamageEvent DamageEvent;
+	DamageEvent.DamageTypeClass = Request.DamageTypeClass;
+	DamageEvent.Origin = Request.Origin;
+	DamageEvent.Params = Request.Params;
+	DamageEvent.ComponentHits.Add(TargetHit);
+
+	NumDamageEvents++;
+	Target->TakeDamage(Request.Params.BaseDamage, DamageEvent, Request.InstigatorController.Get(), Request.DamageCauser.Get());
+}
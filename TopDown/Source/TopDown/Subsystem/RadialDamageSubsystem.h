@@ -0,0 +1,85 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineTypes.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "WorldCollision.h"
+#include "RadialDamageSubsystem.generated.h"
+
+class UDamageType;
+struct FOverlapResult;
+
+//One explosion and one actor in its outer radius, damaged once the line of sight trace is back
+struct FRadialDamageRequest
+{
+	FVector Origin = FVector::ZeroVector;
+	FRadialDamageParams Params;
+	TSubclassOf<UDamageType> DamageTypeClass;
+	TWeakObjectPtr<AActor> DamageCauser;
+	TWeakObjectPtr<AController> InstigatorController;
+	TWeakObjectPtr<AActor> Target;
+
+	FTraceHandle TraceHandle;
+};
+
+//Radial damage for explosions without a physics overlap per explosion.
+//Damageable actors are bucketed in a uniform 2D grid rebuilt once per frame with explosions,
+//all explosions of a frame are resolved in one pass and their line of sight traces go out as one async batch.
+//Actors that never registered are still found by an overlap of dynamic objects per explosion (TopDown.RadialDamage.OverlapFallback),
+//the overlaps go out async with the traces and their line of sight is traced the frame after
+UCLASS()
+class URadialDamageSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	//destroyed actors drop out on their own
+	UFUNCTION(BlueprintCallable, Category = "RadialDamage")
+	void RegisterDamageable(AActor* Actor);
+	UFUNCTION(BlueprintCallable, Category = "RadialDamage")
+	void UnregisterDamageable(AActor* Actor);
+
+	//resolved with the other explosions of the frame, damage is applied when the traces are back (next frame)
+	void AddExplosion(const FVector& Origin, const FRadialDamageParams& Params, TSubclassOf<UDamageType> DamageTypeClass, AActor* DamageCauser, AController* InstigatorController);
+
+	int32 GetNumDamageables() const { return Damageables.Num(); }
+	int32 GetNumPendingExplosions() const { return PendingExplosions.Num(); }
+	int32 GetNumGridCells() const { return Cells.Num(); }
+	//TakeDamage calls since the world started
+	uint32 GetNumDamageEvents() const { return NumDamageEvents; }
+
+protected:
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+	void RebuildGrid();
+	void ResolvePendingExplosions();
+	//dynamic objects in the outer radius that are not in the grid
+	void RequestUnregistered(const FRadialDamageRequest& Explosion, TArrayView<const FOverlapResult> Overlaps, const FCollisionQueryParams& QueryParams, bool bSynchronous);
+	void CollectFinishedOverlaps();
+	void RequestLineOfSight(const FRadialDamageRequest& Explosion, AActor* Target, const FVector& TargetLocation, const FCollisionQueryParams& QueryParams, bool bSynchronous);
+	void CollectFinishedTraces();
+	void ApplyRadialDamage(const FRadialDamageRequest& Request, const FHitResult* BlockingHit);
+
+	FIntPoint GetCell(const FVector& Location) const;
+
+	TArray<TWeakObjectPtr<AActor>> Damageables;
+	//same index as Damageables, filled by RebuildGrid
+	TArray<FVector> DamageableLocations;
+	//same actors as Damageables, for the overlap fallback
+	TSet<const AActor*> DamageableSet;
+	TMap<FIntPoint, TArray<int32, TInlineAllocator<4>>> Cells;
+	float CellSize = 500.0f;
+
+	TArray<FRadialDamageRequest> PendingExplosions;
+	TArray<FRadialDamageRequest> InFlightRequests;
+	//explosions waiting for the overlap of unregistered actors, TraceHandle is the overlap
+	TArray<FRadialDamageRequest> InFlightOverlaps;
+
+	uint32 NumDamageEvents = 0;
+};
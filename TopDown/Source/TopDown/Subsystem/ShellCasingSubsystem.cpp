@@ -0,0 +1,230 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ShellCasingSubsystem.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "TopDown/TopDown.h"
+#include "TopDown/FuncLibrary/MyTypes.h"
+#include "TopDownFXSubsystem.h"
+
+DECLARE_CYCLE_STAT(TEXT("Shell Casings Update"), STAT_TopDown_ShellCasingsUpdate, STATGROUP_TopDown);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Shell Casings"), STAT_TopDown_ShellCasings, STATGROUP_TopDown);
+TRACE_DECLARE_INT_COUNTER(TopDown_ShellCasings, TEXT("TopDown/ShellCasings"));
+
+static TAutoConsoleVariable<int32> CVarShellCasingsMaxPerMesh(
+	TEXT("TopDown.ShellCasings.MaxPerMesh"),
+	128,
+	TEXT("Ring buffer size per casing mesh, the oldest casing is reused above it. Read when the first casing of a mesh is ejected"));
+
+static TAutoConsoleVariable<float> CVarShellCasingsLifeTime(
+	TEXT("TopDown.ShellCasings.LifeTime"),
+	5.0f,
+	TEXT("Seconds a casing stays on the ground, 0 - until its slot is reused"));
+
+//bounce response of the ground plane
+static constexpr float CasingRestitution = 0.3f;
+static constexpr float CasingFriction = 0.6f;
+//vertical speed under which a bounce ends the flight
+static constexpr float CasingRestSpeed = 30.0f;
+//ground is looked for this far below the ejection point
+static constexpr float CasingGroundTraceDistance = 500.0f;
+
+bool UShellCasingSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	//casings are cosmetic
+	return !IsRunningDedicatedServer() && Super::ShouldCreateSubsystem(Outer);
+}
+
+bool UShellCasingSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void UShellCasingSubsystem::Deinitialize()
+{
+	DEC_DWORD_STAT_BY(STAT_TopDown_ShellCasings, GetNumAlive());
+
+	Batches.Empty();
+	InstancedMeshHost = nullptr;
+
+	Super::Deinitialize();
+}
+
+TStatId UShellCasingSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UShellCasingSubsystem, STATGROUP_TopDown);
+}
+
+int32 UShellCasingSubsystem::GetNumAlive() const
+{
+	int32 Result = 0;
+	for (const FShellCasingBatch& Batch : Batches)
+		Result += Batch.NumAlive;
+	return Result;
+}
+
+FShellCasingBatch* UShellCasingSubsystem::FindOrAddBatch(UStaticMesh* Mesh)
+{
+	LLM_SCOPE_BYTAG(TopDown_ShellCasings);
+
+	FShellCasingBatch* Found = Batches.FindByPredicate([Mesh](const FShellCasingBatch& Batch) { return Batch.Mesh == Mesh; });
+	if (Found)
+		return Found;
+
+	if (!InstancedMeshHost)
+		InstancedMeshHost = UMyTypes::SpawnInstancedMeshHost(GetWorld(), TEXT("ShellCasings"));
+
+	UInstancedStaticMeshComponent* InstancedMesh = UMyTypes::AddInstancedMeshComponent(InstancedMeshHost, Mesh);
+	if (!InstancedMesh)
+		return nullptr;
+
+	InstancedMesh->SetCastShadow(false);
+
+	const int32 Capacity = FMath::Max(CVarShellCasingsMaxPerMesh.GetValueOnGameThread(), 1);
+
+	FShellCasingBatch& Batch = Batches.AddDefaulted_GetRef();
+	Batch.Mesh = Mesh;
+	Batch.InstancedMesh = InstancedMesh;
+	Batch.Positions.SetNumZeroed(Capacity);
+	Batch.Velocities.SetNumZeroed(Capacity);
+	Batch.Rotations.SetNumZeroed(Capacity);
+	Batch.Spins.SetNumZeroed(Capacity);
+	Batch.GroundHeights.SetNumZeroed(Capacity);
+	Batch.Ages.Init(-1.0f, Capacity);
+	Batch.bResting.SetNumZeroed(Capacity);
+	Batch.InstanceTransforms.Init(FTransform(FQuat::Identity, FVector::ZeroVector, FVector::ZeroVector), Capacity);
+
+	//every slot is an instance for the whole game, free ones are scaled to zero
+	InstancedMesh->AddInstances(Batch.InstanceTransforms, false, true);
+
+	return &Batch;
+}
+
+void UShellCasingSubsystem::EjectCasing(UStaticMesh* Mesh, const FTransform& Transform, const FVector& Velocity, const AActor* IgnoredActor)
+{
+	LLM_SCOPE_BYTAG(TopDown_ShellCasings);
+
+	if (!Mesh)
+		return;
+
+	const FVector Location = Transform.GetLocation();
+
+	const UTopDownFXSubsystem* FX = GetWorld()->GetSubsystem<UTopDownFXSubsystem>();
+	if (FX && !FX->IsInViewRange(Location))
+		return;
+
+	FShellCasingBatch* Batch = FindOrAddBatch(Mesh);
+	if (!Batch)
+		return;
+
+	//one trace per casing, the flight itself never touches collision
+	float GroundHeight = Location.Z - CasingGroundTraceDistance;
+	FHitResult GroundHit;
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(ShellCasingGround), false, IgnoredActor);
+	if (GetWorld()->LineTraceSingleByChannel(GroundHit, Location, Location - FVector(0.0f, 0.0f, CasingGroundTraceDistance), ECC_Visibility, QueryParams))
+		GroundHeight = GroundHit.ImpactPoint.Z;
+
+	const int32 Slot = Batch->NextSlot;
+	Batch->NextSlot = (Batch->NextSlot + 1) % Batch->Ages.Num();
+
+	if (Batch->Ages[Slot] < 0.0f)
+	{
+		Batch->NumAlive++;
+		INC_DWORD_STAT(STAT_TopDown_ShellCasings);
+	}
+
+	Batch->Positions[Slot] = Location;
+	Batch->Velocities[Slot] = Velocity;
+	Batch->Rotations[Slot] = Transform.Rotator();
+	Batch->Spins[Slot] = FRotator(FMath::FRandRange(-720.0f, 720.0f), FMath::FRandRange(-360.0f, 360.0f), FMath::FRandRange(-720.0f, 720.0f));
+	Batch->GroundHeights[Slot] = GroundHeight;
+	Batch->Ages[Slot] = 0.0f;
+	Batch->bResting[Slot] = 0;
+}
+
+void UShellCasingSubsystem::Tick(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_TopDown_ShellCasingsUpdate);
+
+	const float LifeTime = CVarShellCasingsLifeTime.GetValueOnGameThread();
+
+	for (FShellCasingBatch& Batch : Batches)
+	{
+		if (Batch.NumAlive > 0 && SimulateBatch(Batch, DeltaTime, LifeTime))
+			UpdateInstancedMesh(Batch);
+	}
+
+	TRACE_COUNTER_SET(TopDown_ShellCasings, GetNumAlive());
+}
+
+bool UShellCasingSubsystem::SimulateBatch(FShellCasingBatch& Batch, float DeltaTime, float LifeTime)
+{
+	const float GravityZ = GetWorld()->GetGravityZ();
+	bool bChanged = false;
+
+	for (int32 i = 0; i < Batch.Ages.Num(); i++)
+	{
+		if (Batch.Ages[i] < 0.0f)
+			continue;
+
+		Batch.Ages[i] += DeltaTime;
+
+		if (LifeTime > 0.0f && Batch.Ages[i] > LifeTime)
+		{
+			Batch.Ages[i] = -1.0f;
+			Batch.NumAlive--;
+			DEC_DWORD_STAT(STAT_TopDown_ShellCasings);
+			bChanged = true;
+			continue;
+		}
+
+		if (Batch.bResting[i])
+			continue;
+
+		FVector& Velocity = Batch.Velocities[i];
+		FVector& Position = Batch.Positions[i];
+
+		Velocity.Z += GravityZ * DeltaTime;
+		Position += Velocity * DeltaTime;
+		Batch.Rotations[i] += Batch.Spins[i] * DeltaTime;
+
+		if (Position.Z <= Batch.GroundHeights[i] && Velocity.Z < 0.0f)
+		{
+			Position.Z = Batch.GroundHeights[i];
+			Velocity.Z = -Velocity.Z * CasingRestitution;
+			Velocity.X *= CasingFriction;
+			Velocity.Y *= CasingFriction;
+			Batch.Spins[i] *= CasingFriction;
+
+			if (Velocity.Z < CasingRestSpeed)
+			{
+				//lies on its side
+				Batch.bResting[i] = 1;
+				Batch.Rotations[i].Pitch = 0.0f;
+				Batch.Rotations[i].Roll = 90.0f;
+			}
+		}
+
+		bChanged = true;
+	}
+
+	return bChanged;
+}
+
+void UShellCasingSubsystem::UpdateInstancedMesh(FShellCasingBatch& Batch)
+{
+	if (!Batch.InstancedMesh)
+		return;
+
+	for (int32 i = 0; i < Batch.Ages.Num(); i++)
+	{
+		Batch.InstanceTransforms[i] = Batch.Ages[i] < 0.0f
+			? FTransform(FQuat::Identity, Batch.Positions[i], FVector::ZeroVector)
+			: FTransform(Batch.Rotations[i], Batch.Positions[i]);
+	}
+
+	Batch.InstancedMesh->BatchUpdateInstancesTransforms(0, Batch.InstanceTransforms, true, true, true);
+}
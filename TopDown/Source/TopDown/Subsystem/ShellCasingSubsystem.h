@@ -0,0 +1,70 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "ShellCasingSubsystem.generated.h"
+
+class UInstancedStaticMeshComponent;
+class UStaticMesh;
+
+//Ring buffer of casings sharing a static mesh, slot i is instance i of InstancedMesh
+USTRUCT()
+struct FShellCasingBatch
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	UStaticMesh* Mesh = nullptr;
+	UPROPERTY()
+	UInstancedStaticMeshComponent* InstancedMesh = nullptr;
+
+	TArray<FVector> Positions;
+	TArray<FVector> Velocities;
+	TArray<FRotator> Rotations;
+	TArray<FRotator> Spins;
+	TArray<float> GroundHeights;
+	//negative - free slot
+	TArray<float> Ages;
+	TArray<uint8> bResting;
+
+	//next slot to write, overwrites the oldest casing when the ring is full
+	int32 NextSlot = 0;
+	int32 NumAlive = 0;
+
+	TArray<FTransform> InstanceTransforms;
+};
+
+//Ejected shell casings without actors or physics bodies: ballistic arcs integrated for all casings in one pass,
+//a bounce on the ground height found at ejection, rendered by one instanced mesh per casing mesh.
+//Not created on a dedicated server
+UCLASS()
+class UShellCasingSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	//IgnoredActor - shooter standing over the ejection point, skipped when looking for the ground
+	void EjectCasing(UStaticMesh* Mesh, const FTransform& Transform, const FVector& Velocity, const AActor* IgnoredActor = nullptr);
+
+	int32 GetNumAlive() const;
+
+protected:
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+	FShellCasingBatch* FindOrAddBatch(UStaticMesh* Mesh);
+	//true if an instance changed
+	bool SimulateBatch(FShellCasingBatch& Batch, float DeltaTime, float LifeTime);
+	void UpdateInstancedMesh(FShellCasingBatch& Batch);
+
+	UPROPERTY()
+	TArray<FShellCasingBatch> Batches;
+	UPROPERTY()
+	AActor* InstancedMeshHost = nullptr;
+};
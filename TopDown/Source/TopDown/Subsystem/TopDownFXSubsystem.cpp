@@ -0,0 +1,297 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TopDownFXSubsystem.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+#include "NiagaraComponent.h"
+#include "NiagaraSystem.h"
+#include "Particles/ParticleSystem.h"
+#include "Particles/ParticleSystemComponent.h"
+#include "TopDown/TopDown.h"
+#include "TopDown/FuncLibrary/MyTypes.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("FX Active"), STAT_TopDown_FXActive, STATGROUP_TopDown);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("FX Pooled"), STAT_TopDown_FXPooled, STATGROUP_TopDown);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("FX Components Created"), STAT_TopDown_FXCreated, STATGROUP_TopDown);
+DECLARE_DWORD_COUNTER_STAT(TEXT("FX Culled"), STAT_TopDown_FXCulled, STATGROUP_TopDown);
+
+static TAutoConsoleVariable<float> CVarFXCullDistance(
+	TEXT("TopDown.FX.CullDistance"),
+	6000.0f,
+	TEXT("Effects farther than this from every local player view are not spawned, 0 - no distance culling"));
+
+static TAutoConsoleVariable<int32> CVarFXMaxInstancesPerSystem(
+	TEXT("TopDown.FX.MaxInstancesPerSystem"),
+	32,
+	TEXT("Playing instances of one effect, the oldest one is restarted at the new location above it"));
+
+static FAutoConsoleCommandWithWorld DumpFXCommand(
+	TEXT("TopDown.FX.Dump"),
+	TEXT("Log active/pooled/created component counts per effect"),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* World)
+	{
+		if (UTopDownFXSubsystem* FX = World ? World->GetSubsystem<UTopDownFXSubsystem>() : nullptr)
+		{
+			FX->DumpStats();
+		}
+	}));
+
+bool UTopDownFXSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void UTopDownFXSubsystem::Deinitialize()
+{
+	DEC_DWORD_STAT_BY(STAT_TopDown_FXActive, GetNumActive());
+	DEC_DWORD_STAT_BY(STAT_TopDown_FXPooled, GetNumPooled());
+	DEC_DWORD_STAT_BY(STAT_TopDown_FXCreated, GetNumCreated());
+
+	Pools.Empty();
+	ComponentHost = nullptr;
+
+	Super::Deinitialize();
+}
+
+TStatId UTopDownFXSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UTopDownFXSubsystem, STATGROUP_TopDown);
+}
+
+void UTopDownFXSubsystem::Tick(float DeltaTime)
+{
+	ReleaseFinishedComponents();
+}
+
+void UTopDownFXSubsystem::UpdateViewLocations() const
+{
+	if (ViewLocationsFrame == GFrameCounter)
+		return;
+
+	ViewLocationsFrame = GFrameCounter;
+	ViewLocations.Reset();
+
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		APlayerController* PlayerController = It->Get();
+		if (!PlayerController || !PlayerController->IsLocalController())
+			continue;
+
+		FVector ViewLocation;
+		FRotator ViewRotation;
+		PlayerController->GetPlayerViewPoint(ViewLocation, ViewRotation);
+		ViewLocations.Add(ViewLocation);
+	}
+}
+
+bool UTopDownFXSubsystem::IsInViewRange(const FVector& Location) const
+{
+	UpdateViewLocations();
+
+	//nobody watches on a dedicated server
+	if (ViewLocations.Num() == 0)
+		return false;
+
+	const float CullDistance = CVarFXCullDistance.GetValueOnGameThread();
+	if (CullDistance <= 0.0f)
+		return true;
+
+	for (const FVector& ViewLocation : ViewLocations)
+	{
+		if (FVector::DistSquared(ViewLocation, Location) <= FMath::Square(CullDistance))
+			return true;
+	}
+
+	return false;
+}
+
+UNiagaraComponent* UTopDownFXSubsystem::SpawnNiagaraAtLocation(UNiagaraSystem* System, const FVector& Location, const FRotator& Rotation, const FVector& Scale)
+{
+	return Cast<UNiagaraComponent>(AcquireComponent(System, FTransform(Rotation, Location, Scale)));
+}
+
+UParticleSystemComponent* UTopDownFXSubsystem::SpawnCascadeAtLocation(UParticleSystem* Template, const FTransform& Transform)
+{
+	return Cast<UParticleSystemComponent>(AcquireComponent(Template, Transform));
+}
+
+UFXSystemComponent* UTopDownFXSubsystem::AcquireComponent(UFXSystemAsset* Asset, const FTransform& Transform)
+{
+	LLM_SCOPE_BYTAG(TopDown_FX);
+
+	if (!Asset)
+		return nullptr;
+
+	if (!IsInViewRange(Transform.GetLocation()))
+	{
+		INC_DWORD_STAT(STAT_TopDown_FXCulled);
+		return nullptr;
+	}
+
+	FFXComponentPool& Pool = Pools.FindOrAdd(Asset);
+
+	UFXSystemComponent* Component = nullptr;
+	const int32 MaxInstances = FMath::Max(CVarFXMaxInstancesPerSystem.GetValueOnGameThread(), 1);
+	if (Pool.Active.Num() >= MaxInstances)
+	{
+		//steal the oldest, it is restarted below
+		Component = Pool.Active[0];
+		Pool.Active.RemoveAt(0, 1, false);
+		DEC_DWORD_STAT(STAT_TopDown_FXActive);
+	}
+
+	while (!Component && Pool.Free.Num() > 0)
+	{
+		Component = Pool.Free.Pop(false);
+		DEC_DWORD_STAT(STAT_TopDown_FXPooled);
+
+		if (!IsValid(Component))
+			Component = nullptr;
+	}
+
+	if (!IsValid(Component))
+	{
+		Component = CreatePooledComponent(Asset);
+		if (!Component)
+			return nullptr;
+
+		Pool.Created++;
+		INC_DWORD_STAT(STAT_TopDown_FXCreated);
+	}
+
+	Component->SetWorldTransform(Transform);
+	Component->Activate(true);
+
+	Pool.Active.Add(Component);
+	INC_DWORD_STAT(STAT_TopDown_FXActive);
+
+	return Component;
+}
+
+UFXSystemComponent* UTopDownFXSubsystem::CreatePooledComponent(UFXSystemAsset* Asset)
+{
+	if (!ComponentHost)
+		ComponentHost = UMyTypes::SpawnInstancedMeshHost(GetWorld(), TEXT("PooledFX"));
+
+	if (!ComponentHost)
+		return nullptr;
+
+	UFXSystemComponent* Component = nullptr;
+	if (UNiagaraSystem* System = Cast<UNiagaraSystem>(Asset))
+	{
+		UNiagaraComponent* NiagaraComponent = NewObject<UNiagaraComponent>(ComponentHost);
+		NiagaraComponent->SetAutoDestroy(false);
+		NiagaraComponent->SetAsset(System);
+		Component = NiagaraComponent;
+	}
+	else if (UParticleSystem* Template = Cast<UParticleSystem>(Asset))
+	{
+		UParticleSystemComponent* ParticleComponent = NewObject<UParticleSystemComponent>(ComponentHost);
+		ParticleComponent->bAutoDestroy = false;
+		ParticleComponent->SetTemplate(Template);
+		Component = ParticleComponent;
+	}
+
+	if (!Component)
+		return nullptr;
+
+	Component->bAutoActivate = false;
+	Component->SetUsingAbsoluteLocation(true);
+	Component->SetUsingAbsoluteRotation(true);
+	Component->SetUsingAbsoluteScale(true);
+	Component->SetupAttachment(ComponentHost->GetRootComponent());
+	Component->RegisterComponent();
+
+	return Component;
+}
+
+void UTopDownFXSubsystem::ReleaseFinishedComponents()
+{
+	for (TPair<UFXSystemAsset*, FFXComponentPool>& Pair : Pools)
+	{
+		FFXComponentPool& Pool = Pair.Value;
+		for (int32 i = 0; i < Pool.Active.Num(); i++)
+		{
+			UFXSystemComponent* Component = Pool.Active[i];
+			if (IsValid(Component) && Component->IsActive())
+				continue;
+
+			//keep the oldest first order for stealing
+			Pool.Active.RemoveAt(i--, 1, false);
+			DEC_DWORD_STAT(STAT_TopDown_FXActive);
+
+			if (IsValid(Component))
+			{
+				Pool.Free.Add(Component);
+				INC_DWORD_STAT(STAT_TopDown_FXPooled);
+			}
+		}
+	}
+}
+
+UNiagaraComponent* UTopDownFXSubsystem::CreateMuzzleFlash(UNiagaraSystem* System, USceneComponent* AttachTo)
+{
+	LLM_SCOPE_BYTAG(TopDown_FX);
+
+	if (!System || !AttachTo || GetWorld()->GetNetMode() == NM_DedicatedServer)
+		return nullptr;
+
+	UNiagaraComponent* MuzzleFlash = NewObject<UNiagaraComponent>(AttachTo->GetOwner());
+	MuzzleFlash->SetAutoDestroy(false);
+	MuzzleFlash->bAutoActivate = false;
+	MuzzleFlash->SetAsset(System);
+	MuzzleFlash->SetupAttachment(AttachTo);
+	MuzzleFlash->RegisterComponent();
+
+	return MuzzleFlash;
+}
+
+void UTopDownFXSubsystem::TriggerBurst(UFXSystemComponent* Component)
+{
+	if (!Component)
+		return;
+
+	if (!IsInViewRange(Component->GetComponentLocation()))
+	{
+		INC_DWORD_STAT(STAT_TopDown_FXCulled);
+		return;
+	}
+
+	//restart, the burst emitters fire again
+	Component->Activate(true);
+}
+
+int32 UTopDownFXSubsystem::GetNumActive() const
+{
+	int32 Result = 0;
+	for (const TPair<UFXSystemAsset*, FFXComponentPool>& Pair : Pools)
+		Result += Pair.Value.Active.Num();
+	return Result;
+}
+
+int32 UTopDownFXSubsystem::GetNumPooled() const
+{
+	int32 Result = 0;
+	for (const TPair<UFXSystemAsset*, FFXComponentPool>& Pair : Pools)
+		Result += Pair.Value.Free.Num();
+	return Result;
+}
+
+int32 UTopDownFXSubsystem::GetNumCreated() const
+{
+	int32 Result = 0;
+	for (const TPair<UFXSystemAsset*, FFXComponentPool>& Pair : Pools)
+		Result += Pair.Value.Created;
+	return Result;
+}
+
+void UTopDownFXSubsystem::DumpStats() const
+{
+	for (const TPair<UFXSystemAsset*, FFXComponentPool>& Pair : Pools)
+	{
+		UE_LOG(LogTopDown, Display, TEXT("%s: active %d, pooled %d, created %d"), *GetNameSafe(Pair.Key), Pair.Value.Active.Num(), Pair.Value.Free.Num(), Pair.Value.Created);
+	}
+	UE_LOG(LogTopDown, Display, TEXT("total: active %d, pooled %d, created %d"), GetNumActive(), GetNumPooled(), GetNumCreated());
+}
@@ -0,0 +1,74 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "TopDownFXSubsystem.generated.h"
+
+class UFXSystemAsset;
+class UFXSystemComponent;
+class UNiagaraSystem;
+class UNiagaraComponent;
+class UParticleSystem;
+class UParticleSystemComponent;
+
+USTRUCT()
+struct FFXComponentPool
+{
+	GENERATED_BODY()
+
+	//finished components ready to be reused
+	UPROPERTY()
+	TArray<UFXSystemComponent*> Free;
+	//playing components, oldest first
+	UPROPERTY()
+	TArray<UFXSystemComponent*> Active;
+
+	//components ever created for this system
+	int32 Created = 0;
+};
+
+//Spawns Niagara and Cascade effects from reused components.
+//Effects out of view distance of every local player are skipped, a system over its instance cap restarts its oldest instance
+UCLASS()
+class UTopDownFXSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	UNiagaraComponent* SpawnNiagaraAtLocation(UNiagaraSystem* System, const FVector& Location, const FRotator& Rotation, const FVector& Scale = FVector(1.0f));
+	UParticleSystemComponent* SpawnCascadeAtLocation(UParticleSystem* Template, const FTransform& Transform);
+
+	//persistent component restarted by TriggerBurst on every shot instead of toggling visibility, nullptr on a dedicated server
+	UNiagaraComponent* CreateMuzzleFlash(UNiagaraSystem* System, USceneComponent* AttachTo);
+	void TriggerBurst(UFXSystemComponent* Component);
+
+	bool IsInViewRange(const FVector& Location) const;
+
+	int32 GetNumActive() const;
+	int32 GetNumPooled() const;
+	int32 GetNumCreated() const;
+	void DumpStats() const;
+
+protected:
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+	UFXSystemComponent* AcquireComponent(UFXSystemAsset* Asset, const FTransform& Transform);
+	UFXSystemComponent* CreatePooledComponent(UFXSystemAsset* Asset);
+	void ReleaseFinishedComponents();
+	void UpdateViewLocations() const;
+
+	UPROPERTY()
+	TMap<UFXSystemAsset*, FFXComponentPool> Pools;
+	UPROPERTY()
+	AActor* ComponentHost = nullptr;
+
+	//view points of the local players, refreshed once per frame
+	mutable TArray<FVector, TInlineAllocator<4>> ViewLocations;
+	mutable uint64 ViewLocationsFrame = MAX_uint64;
+};
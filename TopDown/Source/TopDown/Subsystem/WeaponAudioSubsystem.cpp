@@ -0,0 +1,294 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "WeaponAudioSubsystem.h"
+#include "Components/AudioComponent.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+#include "Sound/SoundBase.h"
+#include "TopDown/TopDown.h"
+#include "TopDown/FuncLibrary/MyTypes.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Audio Voices Active"), STAT_TopDown_AudioVoicesActive, STATGROUP_TopDown);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Audio Voices Pooled"), STAT_TopDown_AudioVoicesPooled, STATGROUP_TopDown);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Audio Culled"), STAT_TopDown_AudioCulled, STATGROUP_TopDown);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Audio Voices Stolen"), STAT_TopDown_AudioVoicesStolen, STATGROUP_TopDown);
+
+static TAutoConsoleVariable<float> CVarAudioCullDistance(
+	TEXT("TopDown.Audio.CullDistance"),
+	5000.0f,
+	TEXT("Sounds farther than this (or than their attenuation range) from every local listener are not started, 0 - attenuation range only"));
+
+static TAutoConsoleVariable<int32> CVarAudioMaxVoices(
+	TEXT("TopDown.Audio.MaxVoices"),
+	32,
+	TEXT("Weapon, hit and explosion sounds playing at once, a new sound replaces the oldest one of lower or equal priority above it"));
+
+static TAutoConsoleVariable<int32> CVarAudioMaxVoicesPerOwner(
+	TEXT("TopDown.Audio.MaxVoicesPerOwner"),
+	3,
+	TEXT("Sounds one weapon plays at once, its oldest sound is replaced above it"));
+
+static FAutoConsoleCommandWithWorld DumpAudioCommand(
+	TEXT("TopDown.Audio.Dump"),
+	TEXT("Log active/pooled/created weapon audio voices"),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* World)
+	{
+		if (UWeaponAudioSubsystem* Audio = World ? World->GetSubsystem<UWeaponAudioSubsystem>() : nullptr)
+		{
+			Audio->DumpStats();
+		}
+	}));
+
+bool UWeaponAudioSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	//nobody listens on a dedicated server
+	return !IsRunningDedicatedServer() && Super::ShouldCreateSubsystem(Outer);
+}
+
+bool UWeaponAudioSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void UWeaponAudioSubsystem::Deinitialize()
+{
+	DEC_DWORD_STAT_BY(STAT_TopDown_AudioVoicesActive, Voices.Num());
+	DEC_DWORD_STAT_BY(STAT_TopDown_AudioVoicesPooled, FreeComponents.Num());
+
+	Voices.Empty();
+	FreeComponents.Empty();
+	ComponentHost = nullptr;
+
+	Super::Deinitialize();
+}
+
+TStatId UWeaponAudioSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UWeaponAudioSubsystem, STATGROUP_TopDown);
+}
+
+void UWeaponAudioSubsystem::Tick(float DeltaTime)
+{
+	ReleaseFinishedVoices();
+}
+
+void UWeaponAudioSubsystem::UpdateListenerLocations() const
+{
+	if (ListenerLocationsFrame == GFrameCounter)
+		return;
+
+	ListenerLocationsFrame = GFrameCounter;
+	ListenerLocations.Reset();
+
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		APlayerController* PlayerController = It->Get();
+		if (!PlayerController || !PlayerController->IsLocalController())
+			continue;
+
+		FVector Location;
+		FVector FrontDir;
+		FVector RightDir;
+		PlayerController->GetAudioListenerPosition(Location, FrontDir, RightDir);
+		ListenerLocations.Add(Location);
+	}
+}
+
+bool UWeaponAudioSubsystem::IsInHearingRange(const USoundBase* Sound, const FVector& Location) const
+{
+	UpdateListenerLocations();
+
+	if (ListenerLocations.Num() == 0)
+		return false;
+
+	float CullDistance = Sound ? Sound->GetMaxDistance() : WORLD_MAX;
+	const float MaxCullDistance = CVarAudioCullDistance.GetValueOnGameThread();
+	if (MaxCullDistance > 0.0f)
+		CullDistance = FMath::Min(CullDistance, MaxCullDistance);
+
+	for (const FVector& ListenerLocation : ListenerLocations)
+	{
+		if (FVector::DistSquared(ListenerLocation, Location) <= FMath::Square(CullDistance))
+			return true;
+	}
+
+	return false;
+}
+
+bool UWeaponAudioSubsystem::FindVoiceToSteal(int32 Priority, const AActor* Owner, int32& OutVoiceIndex) const
+{
+	OutVoiceIndex = INDEX_NONE;
+
+	if (Owner)
+	{
+		int32 OwnerVoices = 0;
+		int32 OwnerOldest = INDEX_NONE;
+		for (int32 i = 0; i < Voices.Num(); i++)
+		{
+			if (Voices[i].Owner.Get() != Owner)
+				continue;
+
+			if (OwnerOldest == INDEX_NONE)
+				OwnerOldest = i;
+			OwnerVoices++;
+		}
+
+		//a weapon replaces its own sounds before it takes voices of others
+		if (OwnerVoices >= FMath::Max(CVarAudioMaxVoicesPerOwner.GetValueOnGameThread(), 1))
+		{
+			OutVoiceIndex = OwnerOldest;
+			return true;
+		}
+	}
+
+	if (Voices.Num() < FMath::Max(CVarAudioMaxVoices.GetValueOnGameThread(), 1))
+		return true;
+
+	//oldest voice of the lowest priority
+	for (int32 i = 0; i < Voices.Num(); i++)
+	{
+		if (OutVoiceIndex == INDEX_NONE || Voices[i].Priority < Voices[OutVoiceIndex].Priority)
+			OutVoiceIndex = i;
+	}
+
+	return Voices[OutVoiceIndex].Priority <= Priority;
+}
+
+bool UWeaponAudioSubsystem::PlaySoundAtLocation(USoundBase* Sound, const FVector& Location, int32 Priority, const AActor* Owner)
+{
+	if (!Sound)
+		return false;
+
+	int32 StealIndex = INDEX_NONE;
+	if (!IsInHearingRange(Sound, Location) || !FindVoiceToSteal(Priority, Owner, StealIndex))
+	{
+		INC_DWORD_STAT(STAT_TopDown_AudioCulled);
+		return false;
+	}
+
+	UAudioComponent* Component = nullptr;
+	if (StealIndex != INDEX_NONE)
+	{
+		Component = Voices[StealIndex].Component;
+		Voices.RemoveAt(StealIndex, 1, false);
+		DEC_DWORD_STAT(STAT_TopDown_AudioVoicesActive);
+		INC_DWORD_STAT(STAT_TopDown_AudioVoicesStolen);
+	}
+
+	while (!IsValid(Component) && FreeComponents.Num() > 0)
+	{
+		Component = FreeComponents.Pop(false);
+		DEC_DWORD_STAT(STAT_TopDown_AudioVoicesPooled);
+	}
+
+	if (!IsValid(Component))
+	{
+		Component = CreatePooledComponent();
+		if (!Component)
+			return false;
+	}
+
+	Component->Stop();
+	Component->SetSound(Sound);
+	Component->SetWorldLocation(Location);
+	Component->Play();
+
+	FWeaponAudioVoice& Voice = Voices.AddDefaulted_GetRef();
+	Voice.Component = Component;
+	Voice.Owner = Owner;
+	Voice.Priority = Priority;
+	INC_DWORD_STAT(STAT_TopDown_AudioVoicesActive);
+
+	return true;
+}
+
+UAudioComponent* UWeaponAudioSubsystem::CreatePooledComponent()
+{
+	if (!ComponentHost)
+		ComponentHost = UMyTypes::SpawnInstancedMeshHost(GetWorld(), TEXT("PooledAudio"));
+
+	if (!ComponentHost)
+		return nullptr;
+
+	UAudioComponent* Component = NewObject<UAudioComponent>(ComponentHost);
+	Component->bAutoActivate = false;
+	Component->bAutoDestroy = false;
+	Component->bStopWhenOwnerDestroyed = true;
+	Component->SetUsingAbsoluteLocation(true);
+	Component->SetupAttachment(ComponentHost->GetRootComponent());
+	Component->RegisterComponent();
+
+	NumCreated++;
+	return Component;
+}
+
+void UWeaponAudioSubsystem::ReleaseFinishedVoices()
+{
+	for (int32 i = 0; i < Voices.Num(); i++)
+	{
+		UAudioComponent* Component = Voices[i].Component;
+		if (IsValid(Component) && Component->IsPlaying())
+			continue;
+
+		//keep the oldest first order for stealing
+		Voices.RemoveAt(i--, 1, false);
+		DEC_DWORD_STAT(STAT_TopDown_AudioVoicesActive);
+
+		if (IsValid(Component))
+		{
+			FreeComponents.Add(Component);
+			INC_DWORD_STAT(STAT_TopDown_AudioVoicesPooled);
+		}
+	}
+}
+
+UAudioComponent* UWeaponAudioSubsystem::CreateFireLoop(USoundBase* Sound, USceneComponent* AttachTo)
+{
+	if (!Sound || !AttachTo)
+		return nullptr;
+
+	UAudioComponent* FireLoop = NewObject<UAudioComponent>(AttachTo->GetOwner());
+	FireLoop->bAutoActivate = false;
+	FireLoop->bAutoDestroy = false;
+	FireLoop->SetSound(Sound);
+	FireLoop->SetupAttachment(AttachTo);
+	FireLoop->RegisterComponent();
+
+	return FireLoop;
+}
+
+void UWeaponAudioSubsystem::SetFireLoopPlaying(UAudioComponent* Component, bool bPlaying)
+{
+	if (!Component)
+		return;
+
+	const EAudioComponentPlayState PlayState = Component->GetPlayState();
+	if (!bPlaying)
+	{
+		if (PlayState == EAudioComponentPlayState::Playing || PlayState == EAudioComponentPlayState::FadingIn)
+			Component->FadeOut(0.1f, 0.0f);
+		return;
+	}
+
+	if (PlayState == EAudioComponentPlayState::Playing || PlayState == EAudioComponentPlayState::FadingIn)
+		return;
+
+	if (!IsInHearingRange(Component->Sound, Component->GetComponentLocation()))
+	{
+		INC_DWORD_STAT(STAT_TopDown_AudioCulled);
+		return;
+	}
+
+	Component->FadeIn(0.05f);
+}
+
+void UWeaponAudioSubsystem::DumpStats() const
+{
+	UE_LOG(LogTopDown, Display, TEXT("weapon audio: active %d, pooled %d, created %d"), GetNumActive(), GetNumPooled(), GetNumCreated());
+	for (const FWeaponAudioVoice& Voice : Voices)
+	{
+		UE_LOG(LogTopDown, Display, TEXT("  %s: owner %s, priority %d"), *GetNameSafe(Voice.Component ? Voice.Component->Sound : nullptr), *GetNameSafe(Voice.Owner.Get()), Voice.Priority);
+	}
+}
@@ -0,0 +1,78 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "WeaponAudioSubsystem.generated.h"
+
+class UAudioComponent;
+class USoundBase;
+
+USTRUCT()
+struct FWeaponAudioVoice
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	UAudioComponent* Component = nullptr;
+	//weapon or projectile the voice belongs to, nullptr - only the global budget applies
+	TWeakObjectPtr<const AActor> Owner;
+	int32 Priority = 0;
+};
+
+//Plays weapon, hit and explosion sounds from reused audio components.
+//Sounds out of hearing range of every local listener are not started, a full budget steals the oldest voice of the owner or of lower priority.
+//Not created on a dedicated server, callers skip audio when GetSubsystem returns nullptr
+UCLASS()
+class UWeaponAudioSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	static constexpr int32 PriorityImpact = 0;
+	static constexpr int32 PriorityFire = 1;
+	static constexpr int32 PriorityExplosion = 2;
+
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	//false if the sound is culled
+	bool PlaySoundAtLocation(USoundBase* Sound, const FVector& Location, int32 Priority, const AActor* Owner = nullptr);
+
+	//persistent looped voice of a weapon faded in and out by SetFireLoopPlaying
+	UAudioComponent* CreateFireLoop(USoundBase* Sound, USceneComponent* AttachTo);
+	void SetFireLoopPlaying(UAudioComponent* Component, bool bPlaying);
+
+	bool IsInHearingRange(const USoundBase* Sound, const FVector& Location) const;
+
+	int32 GetNumActive() const { return Voices.Num(); }
+	int32 GetNumPooled() const { return FreeComponents.Num(); }
+	int32 GetNumCreated() const { return NumCreated; }
+	void DumpStats() const;
+
+protected:
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+	//false if every voice outranks the new sound, OutVoiceIndex - voice to restart or INDEX_NONE if the budget isn't full
+	bool FindVoiceToSteal(int32 Priority, const AActor* Owner, int32& OutVoiceIndex) const;
+	UAudioComponent* CreatePooledComponent();
+	void ReleaseFinishedVoices();
+	void UpdateListenerLocations() const;
+
+	//playing voices, oldest first
+	UPROPERTY()
+	TArray<FWeaponAudioVoice> Voices;
+	UPROPERTY()
+	TArray<UAudioComponent*> FreeComponents;
+	UPROPERTY()
+	AActor* ComponentHost = nullptr;
+
+	int32 NumCreated = 0;
+
+	//listener of the local players, refreshed once per frame
+	mutable TArray<FVector, TInlineAllocator<4>> ListenerLocations;
+	mutable uint64 ListenerLocationsFrame = MAX_uint64;
+};
@@ -0,0 +1,193 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "WeaponSimulationSubsystem.h"
+#include "Async/ParallelFor.h"
+#include "HAL/IConsoleManager.h"
+#include "TopDown/TopDown.h"
+#include "TopDown/WeaponDefault.h"
+
+DECLARE_CYCLE_STAT(TEXT("Weapon Simulation"), STAT_TopDown_WeaponSimulation, STATGROUP_TopDown);
+DECLARE_CYCLE_STAT(TEXT("Weapon Events"), STAT_TopDown_WeaponEvents, STATGROUP_TopDown);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Weapons Registered"), STAT_TopDown_WeaponsRegistered, STATGROUP_TopDown);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Weapons Active"), STAT_TopDown_WeaponsActive, STATGROUP_TopDown);
+TRACE_DECLARE_FLOAT_COUNTER(TopDown_ShotsPerSecond, TEXT("TopDown/ShotsPerSecond"));
+
+static TAutoConsoleVariable<int32> CVarMaxShotsPerTick(
+	TEXT("TopDown.Weapon.MaxShotsPerTick"),
+	16,
+	TEXT("Upper bound of shots one weapon fires in a single tick (at most 16), the rest is fired on the next ticks"));
+
+static TAutoConsoleVariable<int32> CVarWeaponSimulationParallelThreshold(
+	TEXT("TopDown.WeaponSimulation.ParallelThreshold"),
+	64,
+	TEXT("Weapon slots from which the update runs in a ParallelFor, 0 - always single threaded"));
+
+bool UWeaponSimulationSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void UWeaponSimulationSubsystem::Deinitialize()
+{
+	DEC_DWORD_STAT_BY(STAT_TopDown_WeaponsRegistered, Weapons.Num() - FreeSlots.Num());
+	DEC_DWORD_STAT_BY(STAT_TopDown_WeaponsActive, NumActive);
+
+	Weapons.Empty();
+	FreeSlots.Empty();
+	States.Empty();
+	ActiveSlots.Empty();
+	Events.Empty();
+	ShotCounts.Empty();
+	ShotAges.Empty();
+	NumActive = 0;
+
+	Super::Deinitialize();
+}
+
+TStatId UWeaponSimulationSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UWeaponSimulationSubsystem, STATGROUP_TopDown);
+}
+
+int32 UWeaponSimulationSubsystem::RegisterWeapon(AWeaponDefault* Weapon)
+{
+	int32 Slot = INDEX_NONE;
+	if (FreeSlots.Num() > 0)
+	{
+		Slot = FreeSlots.Pop(false);
+	}
+	else
+	{
+		Slot = Weapons.AddDefaulted();
+		States.AddDefaulted();
+		ActiveSlots.AddDefaulted();
+		Events.AddDefaulted();
+		ShotCounts.AddDefaulted();
+		ShotAges.AddDefaulted(MaxShotsPerTick);
+	}
+
+	Weapons[Slot] = Weapon;
+	States[Slot] = FWeaponStateCore();
+	ActiveSlots[Slot] = false;
+	Events[Slot] = EWeaponStateEvents::None;
+	ShotCounts[Slot] = 0;
+
+	INC_DWORD_STAT(STAT_TopDown_WeaponsRegistered);
+
+	return Slot;
+}
+
+void UWeaponSimulationSubsystem::UnregisterWeapon(int32 Slot)
+{
+	if (!Weapons.IsValidIndex(Slot) || !Weapons[Slot])
+		return;
+
+	SetActive(Slot, false);
+
+	Weapons[Slot] = nullptr;
+	Events[Slot] = EWeaponStateEvents::None;
+	FreeSlots.Add(Slot);
+
+	DEC_DWORD_STAT(STAT_TopDown_WeaponsRegistered);
+}
+
+void UWeaponSimulationSubsystem::SetActive(int32 Slot, bool bActive)
+{
+	if (!ActiveSlots.IsValidIndex(Slot) || ActiveSlots[Slot] == bActive)
+		return;
+
+	ActiveSlots[Slot] = bActive;
+
+	if (bActive)
+	{
+		NumActive++;
+		INC_DWORD_STAT(STAT_TopDown_WeaponsActive);
+	}
+	else
+	{
+		NumActive--;
+		DEC_DWORD_STAT(STAT_TopDown_WeaponsActive);
+	}
+}
+
+void UWeaponSimulationSubsystem::Tick(float DeltaTime)
+{
+	//averaged over a second, shots of one tick come in bursts
+	ShotsWindowTime += DeltaTime;
+	if (ShotsWindowTime >= 1.0f)
+	{
+		TRACE_COUNTER_SET(TopDown_ShotsPerSecond, ShotsInWindow / ShotsWindowTime);
+		ShotsInWindow = 0;
+		ShotsWindowTime = 0.0f;
+	}
+
+	if (NumActive == 0)
+		return;
+
+	{
+		SCOPE_CYCLE_COUNTER(STAT_TopDown_WeaponSimulation);
+
+		const int32 NumSlots = Weapons.Num();
+		const int32 MaxShots = FMath::Clamp(CVarMaxShotsPerTick.GetValueOnGameThread(), 1, MaxShotsPerTick);
+		const int32 ParallelThreshold = CVarWeaponSimulationParallelThreshold.GetValueOnGameThread();
+
+		const bool bSingleThread = ParallelThreshold <= 0 || NumSlots < ParallelThreshold;
+		ParallelFor(NumSlots, [this, DeltaTime, MaxShots](int32 Slot)
+		{
+			SimulateWeapon(Slot, DeltaTime, MaxShots);
+		}, bSingleThread);
+	}
+
+	DispatchEvents();
+}
+
+void UWeaponSimulationSubsystem::SimulateWeapon(int32 Slot, float DeltaTime, int32 MaxShots)
+{
+	Events[Slot] = EWeaponStateEvents::None;
+	ShotCounts[Slot] = 0;
+
+	if (!ActiveSlots[Slot])
+		return;
+
+	int32 NumShots = 0;
+	Events[Slot] = States[Slot].Tick(DeltaTime, MaxShots, &ShotAges[Slot * MaxShotsPerTick], NumShots);
+	ShotCounts[Slot] = (uint8)NumShots;
+}
+
+void UWeaponSimulationSubsystem::DispatchEvents()
+{
+	SCOPE_CYCLE_COUNTER(STAT_TopDown_WeaponEvents);
+
+	//callbacks can register or unregister weapons, only the slots simulated this tick are visited
+	const int32 NumSlots = Events.Num();
+	for (int32 Slot = 0; Slot < NumSlots; Slot++)
+	{
+		const EWeaponStateEvents SlotEvents = Events[Slot];
+		if (SlotEvents == EWeaponStateEvents::None)
+			continue;
+
+		Events[Slot] = EWeaponStateEvents::None;
+
+		AWeaponDefault* Weapon = Weapons[Slot];
+		if (!IsValid(Weapon))
+			continue;
+
+		if (EnumHasAnyFlags(SlotEvents, EWeaponStateEvents::ReloadFinished))
+			Weapon->FinishReload();
+
+		if (EnumHasAnyFlags(SlotEvents, EWeaponStateEvents::Shots))
+		{
+			//copied, a registration inside the callback can reallocate ShotAges
+			const TArray<float, TInlineAllocator<MaxShotsPerTick>> SlotShotAges(&ShotAges[Slot * MaxShotsPerTick], ShotCounts[Slot]);
+			ShotsInWindow += SlotShotAges.Num();
+			Weapon->OnSimulatedShots(SlotShotAges);
+		}
+
+		if (EnumHasAnyFlags(SlotEvents, EWeaponStateEvents::EffectEnded))
+			Weapon->OnSimulatedEffectEnded();
+
+		if (EnumHasAnyFlags(SlotEvents, EWeaponStateEvents::Settled))
+			Weapon->UpdateWeaponState();
+	}
+}
@@ -0,0 +1,58 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "TopDown/WeaponStateCore.h"
+#include "WeaponSimulationSubsystem.generated.h"
+
+class AWeaponDefault;
+
+//Fire, reload and dispersion state of all weapons, one FWeaponStateCore per weapon slot.
+//Updated in one pass (ParallelFor with many active weapons), weapons are called back only for events
+UCLASS()
+class UWeaponSimulationSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	static constexpr int32 MaxShotsPerTick = FWeaponStateCore::MaxShotsPerTick;
+
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	int32 RegisterWeapon(AWeaponDefault* Weapon);
+	void UnregisterWeapon(int32 Slot);
+
+	void SetActive(int32 Slot, bool bActive);
+
+	//nullptr for an invalid slot, don't keep it, a registration can move the states
+	FWeaponStateCore* GetWeaponState(int32 Slot) { return States.IsValidIndex(Slot) ? &States[Slot] : nullptr; }
+	const FWeaponStateCore* GetWeaponState(int32 Slot) const { return States.IsValidIndex(Slot) ? &States[Slot] : nullptr; }
+
+protected:
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+	void SimulateWeapon(int32 Slot, float DeltaTime, int32 MaxShots);
+	void DispatchEvents();
+
+	UPROPERTY()
+	TArray<AWeaponDefault*> Weapons;
+	TArray<int32> FreeSlots;
+
+	TArray<FWeaponStateCore> States;
+	TArray<bool> ActiveSlots;
+	TArray<EWeaponStateEvents> Events;
+
+	//MaxShotsPerTick ages per slot
+	TArray<uint8> ShotCounts;
+	TArray<float> ShotAges;
+
+	int32 NumActive = 0;
+
+	//TopDown/ShotsPerSecond trace counter
+	int32 ShotsInWindow = 0;
+	float ShotsWindowTime = 0.0f;
+};
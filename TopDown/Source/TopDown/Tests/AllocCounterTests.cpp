@@ -0,0 +1,57 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+#include "TopDown/FuncLibrary/TopDownAllocCounter.h"
+
+#if WITH_DEV_AUTOMATION_TESTS && TOPDOWN_ALLOC_COUNTING
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTopDownAllocCounterTest, "TopDown.Alloc.Counter",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+//a scope counts the mallocs and growing reallocs of its thread, frees don't count, needs -TopDownAllocCounting
+bool FTopDownAllocCounterTest::RunTest(const FString& Parameters)
+{
+	if (!TopDownAllocCounter::IsInstalled())
+	{
+		AddError(TEXT("Allocation counting is off, run the test with -TopDownAllocCounting"));
+		return false;
+	}
+
+	const FTopDownAllocSite* Site = nullptr;
+	uint64 AllocsBefore = 0;
+	uint64 CallsBefore = 0;
+
+	for (int32 Call = 0; Call < 2; Call++)
+	{
+		void* Blocks[3];
+		{
+			TOPDOWN_ALLOC_SCOPE(AllocCounterTest);
+
+			Blocks[0] = FMemory::Malloc(16);
+			Blocks[1] = FMemory::Malloc(256);
+			Blocks[2] = FMemory::Realloc(FMemory::Malloc(32), 4096);
+		}
+		for (void* Block : Blocks)
+			FMemory::Free(Block);
+
+		//registers on its first call
+		if (Call == 0)
+		{
+			Site = TopDownAllocCounter::FindSite(TEXT("AllocCounterTest"));
+			if (!TestNotNull(TEXT("Site registered"), Site))
+				return false;
+
+			AllocsBefore = Site->GetAllocs();
+			CallsBefore = Site->GetCalls();
+		}
+	}
+
+	TestEqual(TEXT("One call of the scope"), Site->GetCalls() - CallsBefore, uint64(1));
+	TestEqual(TEXT("Three mallocs and a realloc"), Site->GetAllocs() - AllocsBefore, uint64(4));
+
+	return true;
+}
+
+#endif //WITH_DEV_AUTOMATION_TESTS && TOPDOWN_ALLOC_COUNTING
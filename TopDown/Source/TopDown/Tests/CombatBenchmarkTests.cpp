@@ -0,0 +1,150 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+#include "Dom/JsonObject.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Tests/AutomationCommon.h"
+#include "TopDown/FuncLibrary/TopDownAllocCounter.h"
+#include "TopDown/Subsystem/CombatBenchmarkSubsystem.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+static UWorld* GetBenchmarkWorld()
+{
+	for (const FWorldContext& Context : GEngine->GetWorldContexts())
+	{
+		if ((Context.WorldType == EWorldType::Game || Context.WorldType == EWorldType::PIE) && Context.World())
+			return Context.World();
+	}
+	return nullptr;
+}
+
+static UCombatBenchmarkSubsystem* GetBenchmark()
+{
+	UWorld* World = GetBenchmarkWorld();
+	return World ? World->GetSubsystem<UCombatBenchmarkSubsystem>() : nullptr;
+}
+
+//loads the map, runs a sweep with a short measure time and hands its summary to CheckSummary
+static void AddSweepCommands(FAutomationTestBase* Test, const FString& MapName, const TArray<int32>& Counts, TFunction<void(const FJsonObject&)> CheckSummary)
+{
+	const double Timeout = 120.0;
+
+	IConsoleVariable* MeasureTimeVar = IConsoleManager::Get().FindConsoleVariable(TEXT("TopDown.Benchmark.MeasureTime"));
+	const float OldMeasureTime = MeasureTimeVar->GetFloat();
+
+	ADD_LATENT_AUTOMATION_COMMAND(FLoadGameMapCommand(MapName));
+	ADD_LATENT_AUTOMATION_COMMAND(FWaitForMapToLoadCommand());
+
+	ADD_LATENT_AUTOMATION_COMMAND(FFunctionLatentCommand([Test, Counts, MeasureTimeVar]()
+	{
+		UCombatBenchmarkSubsystem* Benchmark = GetBenchmark();
+		if (!Test->TestNotNull(TEXT("CombatBenchmarkSubsystem exists in the game world"), Benchmark))
+			return true;
+
+		MeasureTimeVar->Set(2.0f, ECVF_SetByCode);
+		Test->TestTrue(TEXT("Sweep starts"), Benchmark->StartSweep(Counts, false));
+		return true;
+	}));
+
+	ADD_LATENT_AUTOMATION_COMMAND(FFunctionLatentCommand([Test, Counts, Timeout, MeasureTimeVar, OldMeasureTime, CheckSummary, StartTime = FPlatformTime::Seconds()]()
+	{
+		UCombatBenchmarkSubsystem* Benchmark = GetBenchmark();
+		if (Benchmark && Benchmark->IsRunning())
+		{
+			if (FPlatformTime::Seconds() - StartTime < Timeout)
+				return false;
+
+			Test->AddError(FString::Printf(TEXT("Sweep still running after %.0f seconds"), Timeout));
+			Benchmark->StopSweep();
+		}
+
+		MeasureTimeVar->Set(OldMeasureTime, ECVF_SetByCode);
+
+		const TSharedPtr<FJsonObject> Summary = Benchmark ? Benchmark->GetLastSummary() : nullptr;
+		if (!Test->TestTrue(TEXT("Sweep wrote a summary"), Summary.IsValid()))
+			return true;
+
+		if (Test->TestEqual(TEXT("One summary entry per step"), Summary->GetArrayField(TEXT("steps")).Num(), Counts.Num()))
+			CheckSummary(*Summary);
+		return true;
+	}));
+}
+
+IMPLEMENT_COMPLEX_AUTOMATION_TEST(FTopDownCombatBenchmarkTest, "TopDown.Benchmark.ShortSweep",
+	EAutomationTestFlags::ClientContext | EAutomationTestFlags::ProductFilter)
+
+void FTopDownCombatBenchmarkTest::GetTests(TArray<FString>& OutBeautifiedNames, TArray<FString>& OutTestCommands) const
+{
+	OutBeautifiedNames.Add(TEXT("TopDownMap"));
+	OutTestCommands.Add(TEXT("/Game/TopDownMap"));
+}
+
+//Two short steps of the sweep on the map, every step has to record frames with all of its characters armed
+bool FTopDownCombatBenchmarkTest::RunTest(const FString& Parameters)
+{
+	const TArray<int32> Counts = { 1, 8 };
+
+	AddSweepCommands(this, Parameters, Counts, [this, Counts](const FJsonObject& Summary)
+	{
+		const TArray<TSharedPtr<FJsonValue>>& Steps = Summary.GetArrayField(TEXT("steps"));
+		for (int32 i = 0; i < Steps.Num(); i++)
+		{
+			const TSharedPtr<FJsonObject> Step = Steps[i]->AsObject();
+			const int32 Characters = int32(Step->GetNumberField(TEXT("characters")));
+
+			TestEqual(TEXT("Step character count"), Characters, Counts[i]);
+			TestEqual(FString::Printf(TEXT("All %d characters armed"), Characters), int32(Step->GetNumberField(TEXT("armed_characters"))), Characters);
+			TestTrue(FString::Printf(TEXT("%d characters: frames recorded"), Characters), Step->GetNumberField(TEXT("frames")) > 0.0);
+			TestTrue(FString::Printf(TEXT("%d characters: frame time measured"), Characters), Step->GetNumberField(TEXT("frame_ms_avg")) > 0.0);
+		}
+	});
+
+	return true;
+}
+
+IMPLEMENT_COMPLEX_AUTOMATION_TEST(FTopDownAllocsPerShotTest, "TopDown.Benchmark.AllocsPerShot",
+	EAutomationTestFlags::ClientContext | EAutomationTestFlags::ProductFilter)
+
+void FTopDownAllocsPerShotTest::GetTests(TArray<FString>& OutBeautifiedNames, TArray<FString>& OutTestCommands) const
+{
+	OutBeautifiedNames.Add(TEXT("TopDownMap"));
+	OutTestCommands.Add(TEXT("/Game/TopDownMap"));
+}
+
+//Steady state fire of a crowd stays inside TopDown.Benchmark.AllocsPerShotBudget, needs -TopDownAllocCounting
+bool FTopDownAllocsPerShotTest::RunTest(const FString& Parameters)
+{
+#if TOPDOWN_ALLOC_COUNTING
+	if (!TopDownAllocCounter::IsInstalled())
+	{
+		AddError(TEXT("Allocation counting is off, run the test with -TopDownAllocCounting"));
+		return false;
+	}
+
+	const float Budget = IConsoleManager::Get().FindConsoleVariable(TEXT("TopDown.Benchmark.AllocsPerShotBudget"))->GetFloat();
+	if (!TestTrue(TEXT("TopDown.Benchmark.AllocsPerShotBudget is set"), Budget >= 0.0f))
+		return false;
+
+	AddSweepCommands(this, Parameters, { 16 }, [this, Budget](const FJsonObject& Summary)
+	{
+		const TSharedPtr<FJsonObject> Step = Summary.GetArrayField(TEXT("steps"))[0]->AsObject();
+		const double AllocsPerShot = Step->GetNumberField(TEXT("allocs_per_shot"));
+
+		AddInfo(FString::Printf(TEXT("%.2f allocations per shot (%.2f in Fire), budget %.2f"), AllocsPerShot, Step->GetNumberField(TEXT("fire_allocs_per_shot")), Budget));
+		TestTrue(TEXT("Shots fired while recording"), Step->GetNumberField(TEXT("shots")) > 0.0);
+		TestTrue(FString::Printf(TEXT("%.2f allocations per shot within the budget of %.2f"), AllocsPerShot, Budget), AllocsPerShot <= Budget);
+		TestFalse(TEXT("Summary reports the budget kept"), Summary.GetBoolField(TEXT("alloc_budget_exceeded")));
+	});
+	return true;
+#else
+	AddWarning(TEXT("Allocation counting is compiled out of Shipping"));
+	return true;
+#endif
+}
+
+#endif //WITH_DEV_AUTOMATION_TESTS
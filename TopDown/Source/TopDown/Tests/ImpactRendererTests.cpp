@@ -0,0 +1,98 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/App.h"
+#include "NiagaraComponent.h"
+#include "NiagaraSystem.h"
+#include "UObject/UObjectIterator.h"
+#include "TopDown/Subsystem/ImpactRendererSubsystem.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTopDownImpactRendererTest, "TopDown.ImpactRenderer.GatherAndFlush",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::ClientContext | EAutomationTestFlags::ProductFilter)
+
+//impacts near the local view are gathered up to MaxPerFrame per system, the rest and the far ones are culled,
+//a tick hands every pending impact over. Headless runs never create a Niagara component
+bool FTopDownImpactRendererTest::RunTest(const FString& Parameters)
+{
+	const int32 MaxPerFrame = 8;
+	const int32 NumNear = 10;
+
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false);
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+	World->InitializeActorsForPlay(FURL());
+	World->BeginPlay();
+
+	IConsoleVariable* MaxPerFrameVar = IConsoleManager::Get().FindConsoleVariable(TEXT("TopDown.ImpactRenderer.MaxPerFrame"));
+	IConsoleVariable* CullDistanceVar = IConsoleManager::Get().FindConsoleVariable(TEXT("TopDown.FX.CullDistance"));
+	const int32 OldMaxPerFrame = MaxPerFrameVar->GetInt();
+	const float OldCullDistance = CullDistanceVar->GetFloat();
+	MaxPerFrameVar->Set(MaxPerFrame, ECVF_SetByCode);
+	CullDistanceVar->Set(6000.0f, ECVF_SetByCode);
+
+	//a standalone world without a local view culls every impact like a dedicated server
+	World->SpawnActor<APlayerController>(FVector::ZeroVector, FRotator::ZeroRotator);
+
+	UImpactRendererSubsystem* ImpactRenderer = World->GetSubsystem<UImpactRendererSubsystem>();
+	TestNotNull(TEXT("ImpactRendererSubsystem exists in a game world"), ImpactRenderer);
+
+	if (ImpactRenderer)
+	{
+		UNiagaraSystem* System = NewObject<UNiagaraSystem>(GetTransientPackage());
+
+		TestFalse(TEXT("Impact without a system is ignored"), ImpactRenderer->AddImpact(nullptr, FVector::ZeroVector, FVector::UpVector));
+
+		int32 NumAdded = 0;
+		for (int32 i = 0; i < NumNear; i++)
+		{
+			if (ImpactRenderer->AddImpact(System, FVector(i * 100.0f, 0.0f, 0.0f), FVector::UpVector))
+				NumAdded++;
+		}
+		TestEqual(TEXT("Impacts beyond MaxPerFrame are dropped"), NumAdded, MaxPerFrame);
+		TestFalse(TEXT("Impact out of view range is culled"), ImpactRenderer->AddImpact(System, FVector(100000.0f, 0.0f, 0.0f), FVector::UpVector));
+
+		TestEqual(TEXT("Gathered"), ImpactRenderer->GetNumGathered(), (int64)MaxPerFrame);
+		TestEqual(TEXT("Culled"), ImpactRenderer->GetNumCulled(), (int64)(NumNear - MaxPerFrame + 1));
+		TestEqual(TEXT("Pending before the flush"), ImpactRenderer->GetNumPending(), MaxPerFrame);
+		TestEqual(TEXT("Nothing flushed before the tick"), ImpactRenderer->GetNumFlushed(), (int64)0);
+
+		ImpactRenderer->Tick(0.016f);
+
+		TestEqual(TEXT("Flushed"), ImpactRenderer->GetNumFlushed(), (int64)MaxPerFrame);
+		TestEqual(TEXT("Pending after the flush"), ImpactRenderer->GetNumPending(), 0);
+
+		//the cap is per frame
+		TestTrue(TEXT("Next frame gathers again"), ImpactRenderer->AddImpact(System, FVector::ZeroVector, FVector::UpVector));
+		ImpactRenderer->Tick(0.016f);
+		TestEqual(TEXT("Flushed over two frames"), ImpactRenderer->GetNumFlushed(), (int64)(MaxPerFrame + 1));
+
+		if (!FApp::CanEverRender())
+		{
+			int32 NumComponents = 0;
+			for (TObjectIterator<UNiagaraComponent> It; It; ++It)
+			{
+				if (It->GetWorld() == World)
+					NumComponents++;
+			}
+			TestEqual(TEXT("No Niagara component without rendering"), NumComponents, 0);
+		}
+	}
+
+	MaxPerFrameVar->Set(OldMaxPerFrame, ECVF_SetByCode);
+	CullDistanceVar->Set(OldCullDistance, ECVF_SetByCode);
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+
+	return !HasAnyErrors();
+}
+
+#endif //WITH_DEV_AUTOMATION_TESTS
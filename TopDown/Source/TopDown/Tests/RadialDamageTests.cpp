@@ -0,0 +1,156 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+#include "Components/SphereComponent.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+#include "TopDown/Subsystem/RadialDamageSubsystem.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTopDownRadialDamageStressTest, "TopDown.RadialDamage.SimultaneousExplosions",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::ClientContext | EAutomationTestFlags::ProductFilter)
+
+//64 explosions in one frame over registered actors and unregistered collision only actors, every actor in range is damaged once
+//per explosion and the grid doesn't keep the cells of earlier frames
+bool FTopDownRadialDamageStressTest::RunTest(const FString& Parameters)
+{
+	const int32 NumExplosions = 64;
+	const float OuterRadius = 300.0f;
+	const float SphereRadius = 32.0f;
+	//the overlap of the unregistered spheres is allowed a little slack at the edge of the radius
+	const float OverlapTolerance = 5.0f;
+
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false);
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+	World->InitializeActorsForPlay(FURL());
+	World->BeginPlay();
+
+	IConsoleVariable* SynchronousVar = IConsoleManager::Get().FindConsoleVariable(TEXT("TopDown.RadialDamage.Synchronous"));
+	IConsoleVariable* FallbackVar = IConsoleManager::Get().FindConsoleVariable(TEXT("TopDown.RadialDamage.OverlapFallback"));
+	const int32 OldSynchronous = SynchronousVar->GetInt();
+	const int32 OldFallback = FallbackVar->GetInt();
+	//damage in the frame of the explosions
+	SynchronousVar->Set(1, ECVF_SetByCode);
+	FallbackVar->Set(1, ECVF_SetByCode);
+
+	URadialDamageSubsystem* RadialDamage = World->GetSubsystem<URadialDamageSubsystem>();
+	TestNotNull(TEXT("RadialDamageSubsystem exists in a game world"), RadialDamage);
+
+	TArray<AActor*> Registered;
+	TArray<AActor*> Unregistered;
+	if (RadialDamage)
+	{
+		//registered actors on a 150 grid, unregistered spheres in between
+		for (int32 X = 0; X < 10; X++)
+		{
+			for (int32 Y = 0; Y < 10; Y++)
+			{
+				AActor* Actor = World->SpawnActor<AActor>();
+				const bool bRegistered = (X + Y) % 3 != 0;
+				if (bRegistered)
+				{
+					USceneComponent* Root = NewObject<USceneComponent>(Actor);
+					Actor->SetRootComponent(Root);
+					Root->RegisterComponent();
+					RadialDamage->RegisterDamageable(Actor);
+					Registered.Add(Actor);
+				}
+				else
+				{
+					USphereComponent* Sphere = NewObject<USphereComponent>(Actor);
+					Sphere->InitSphereRadius(SphereRadius);
+					Sphere->SetCollisionEnabled(ECollisionEnabled::QueryOnly);
+					Sphere->SetCollisionObjectType(ECC_WorldDynamic);
+					Sphere->SetCollisionResponseToAllChannels(ECR_Overlap);
+					Actor->SetRootComponent(Sphere);
+					Sphere->RegisterComponent();
+					Unregistered.Add(Actor);
+				}
+				Actor->SetActorLocation(FVector(X * 150.0f, Y * 150.0f, 0.0f));
+			}
+		}
+
+		//physics picks up the new bodies
+		World->Tick(LEVELTICK_All, 0.016f);
+
+		FRandomStream Random(1234);
+		const FRadialDamageParams Params(10.0f, 2.0f, 100.0f, OuterRadius, 1.0f);
+
+		uint32 MinExpected = 0;
+		uint32 MaxExpected = 0;
+		TArray<FVector> Origins;
+		for (int32 i = 0; i < NumExplosions; i++)
+		{
+			const FVector Origin(Random.FRandRange(0.0f, 1350.0f), Random.FRandRange(0.0f, 1350.0f), 0.0f);
+			RadialDamage->AddExplosion(Origin, Params, nullptr, nullptr, nullptr);
+			Origins.Add(Origin);
+
+			for (const AActor* Actor : Registered)
+			{
+				if (FVector::Dist(Actor->GetActorLocation(), Origin) <= OuterRadius)
+				{
+					MinExpected++;
+					MaxExpected++;
+				}
+			}
+			for (const AActor* Actor : Unregistered)
+			{
+				const float Dist = FVector::Dist(Actor->GetActorLocation(), Origin);
+				if (Dist < OuterRadius + SphereRadius - OverlapTolerance)
+					MinExpected++;
+				if (Dist < OuterRadius + SphereRadius + OverlapTolerance)
+					MaxExpected++;
+			}
+		}
+
+		TestEqual(TEXT("All explosions are pending"), RadialDamage->GetNumPendingExplosions(), NumExplosions);
+
+		const uint32 StartEvents = RadialDamage->GetNumDamageEvents();
+		const double StartTime = FPlatformTime::Seconds();
+		RadialDamage->Tick(0.016f);
+		const double ResolveTime = FPlatformTime::Seconds() - StartTime;
+		const uint32 NumEvents = RadialDamage->GetNumDamageEvents() - StartEvents;
+
+		AddInfo(FString::Printf(TEXT("%d explosions, %u damage events, resolved in %.3f ms"), NumExplosions, NumEvents, ResolveTime * 1000.0));
+		TestEqual(TEXT("Explosions are resolved in one frame"), RadialDamage->GetNumPendingExplosions(), 0);
+		TestTrue(FString::Printf(TEXT("Damage events %u in [%u, %u]"), NumEvents, MinExpected, MaxExpected), NumEvents >= MinExpected && NumEvents <= MaxExpected);
+
+		//same explosions batched: overlaps and traces go out async, damage lands a frame or two later
+		SynchronousVar->Set(0, ECVF_SetByCode);
+		for (const FVector& Origin : Origins)
+			RadialDamage->AddExplosion(Origin, Params, nullptr, nullptr, nullptr);
+
+		const uint32 AsyncStartEvents = RadialDamage->GetNumDamageEvents();
+		for (int32 Frame = 0; Frame < 4; Frame++)
+		{
+			RadialDamage->Tick(0.016f);
+			World->Tick(LEVELTICK_All, 0.016f);
+		}
+		TestEqual(TEXT("Async damage events match the synchronous ones"), RadialDamage->GetNumDamageEvents() - AsyncStartEvents, NumEvents);
+		SynchronousVar->Set(1, ECVF_SetByCode);
+
+		//every registered actor moves far away, the cells they left are not kept
+		for (int32 i = 0; i < Registered.Num(); i++)
+			Registered[i]->SetActorLocation(FVector(100000.0f + i * 1000.0f, 0.0f, 0.0f));
+
+		RadialDamage->AddExplosion(FVector::ZeroVector, Params, nullptr, nullptr, nullptr);
+		RadialDamage->Tick(0.016f);
+		TestTrue(TEXT("Grid only holds the cells of this frame"), RadialDamage->GetNumGridCells() <= Registered.Num());
+	}
+
+	SynchronousVar->Set(OldSynchronous, ECVF_SetByCode);
+	FallbackVar->Set(OldFallback, ECVF_SetByCode);
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+
+	return !HasAnyErrors();
+}
+
+#endif //WITH_DEV_AUTOMATION_TESTS
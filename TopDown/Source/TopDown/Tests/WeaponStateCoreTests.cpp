@@ -0,0 +1,247 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+#include "TopDown/WeaponStateCore.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+static FWeaponInfo MakeTestWeaponInfo()
+{
+	FWeaponInfo Info;
+	Info.RateOfFire = 0.1f;
+	Info.ReloadTime = 1.5f;
+	Info.MaxRound = 30;
+	return Info;
+}
+
+//ticks with the trigger held the way AWeaponDefault does, returns the shots fired
+static int32 HoldTrigger(FWeaponStateCore& State, float Seconds, float DeltaTime, float* OutMaxShotAge = nullptr)
+{
+	float ShotAges[FWeaponStateCore::MaxShotsPerTick];
+	int32 NumFired = 0;
+
+	const int32 NumTicks = FMath::RoundToInt(Seconds / DeltaTime);
+	for (int32 TickIndex = 0; TickIndex < NumTicks; TickIndex++)
+	{
+		State.SetFiring(true);
+
+		int32 NumShots = 0;
+		const EWeaponStateEvents Events = State.Tick(DeltaTime, FWeaponStateCore::MaxShotsPerTick, ShotAges, NumShots);
+		if (!EnumHasAnyFlags(Events, EWeaponStateEvents::Shots))
+			continue;
+
+		for (int32 Shot = 0; Shot < NumShots; Shot++)
+		{
+			if (OutMaxShotAge)
+				*OutMaxShotAge = FMath::Max(*OutMaxShotAge, ShotAges[Shot]);
+		}
+		NumFired += State.ConsumeRounds(NumShots);
+	}
+	return NumFired;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTopDownWeaponStateCadenceTest, "TopDown.WeaponState.FireCadence",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+//rate of fire holds at any frame rate, shots are not saved up while the trigger is released
+bool FTopDownWeaponStateCadenceTest::RunTest(const FString& Parameters)
+{
+	const FWeaponInfo Info = MakeTestWeaponInfo();
+
+	for (const float FrameRate : { 30.0f, 60.0f, 144.0f })
+	{
+		FWeaponStateCore State;
+		State.Init(Info, 1000);
+		State.SetMovementState(Info.DispersionWeapon, EMovementState::Aim_State);
+
+		float MaxShotAge = 0.0f;
+		const int32 NumFired = HoldTrigger(State, 1.0f, 1.0f / FrameRate, &MaxShotAge);
+
+		//first shot on the first tick, then one every RateOfFire
+		TestTrue(FString::Printf(TEXT("%.0f fps: %d shots in one second"), FrameRate, NumFired), NumFired >= 10 && NumFired <= 11);
+		TestTrue(FString::Printf(TEXT("%.0f fps: shot ages inside the tick"), FrameRate), MaxShotAge <= 1.0f / FrameRate);
+	}
+
+	//a long hitch fires what was due, capped per tick
+	{
+		FWeaponStateCore State;
+		State.Init(Info, 1000);
+		TestEqual(TEXT("Shots of a 0.35 s tick"), HoldTrigger(State, 0.35f, 0.35f), 4);
+		TestEqual(TEXT("Shots of a 5 s tick"), HoldTrigger(State, 5.0f, 5.0f), FWeaponStateCore::MaxShotsPerTick);
+	}
+
+	//released for a second, pulled again: one shot right away and the cadence after it
+	{
+		FWeaponStateCore State;
+		State.Init(Info, 1000);
+		HoldTrigger(State, 0.05f, 0.05f);
+
+		float ShotAges[FWeaponStateCore::MaxShotsPerTick];
+		int32 NumShots = 0;
+		State.SetFiring(false);
+		for (int32 TickIndex = 0; TickIndex < 60; TickIndex++)
+			State.Tick(1.0f / 60.0f, FWeaponStateCore::MaxShotsPerTick, ShotAges, NumShots);
+
+		TestEqual(TEXT("Fire timer ran out while released"), State.FireTimer, 0.0f);
+		TestEqual(TEXT("One shot on the pull after a pause"), HoldTrigger(State, 1.0f / 60.0f, 1.0f / 60.0f), 1);
+	}
+
+	//sprinting releases the trigger
+	{
+		FWeaponStateCore State;
+		State.Init(Info, 1000);
+		State.SetMovementState(Info.DispersionWeapon, EMovementState::Sprint_State);
+		TestFalse(TEXT("Trigger can't be pulled while sprinting"), State.SetFiring(true));
+		TestEqual(TEXT("No shots while sprinting"), HoldTrigger(State, 1.0f, 1.0f / 60.0f), 0);
+	}
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTopDownWeaponStateReloadTest, "TopDown.WeaponState.Reload",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+//an empty magazine stops fire until the reload time passed and the magazine is refilled
+bool FTopDownWeaponStateReloadTest::RunTest(const FString& Parameters)
+{
+	const FWeaponInfo Info = MakeTestWeaponInfo();
+	const float DeltaTime = 1.0f / 60.0f;
+
+	FWeaponStateCore State;
+	State.Init(Info, 3);
+
+	TestEqual(TEXT("Shots limited by the magazine"), HoldTrigger(State, 1.0f, DeltaTime), 3);
+	TestTrue(TEXT("Empty magazine needs a reload"), State.NeedsReload());
+
+	State.StartReload(Info.ReloadTime);
+	TestFalse(TEXT("Reloading doesn't need another reload"), State.NeedsReload());
+	TestFalse(TEXT("Trigger can't be pulled while reloading"), State.SetFiring(true));
+
+	float ShotAges[FWeaponStateCore::MaxShotsPerTick];
+	int32 NumTicks = 0;
+	int32 NumShots = 0;
+	int32 TotalShots = 0;
+	EWeaponStateEvents Events = EWeaponStateEvents::None;
+	while (!EnumHasAnyFlags(Events, EWeaponStateEvents::ReloadFinished) && NumTicks < 1000)
+	{
+		Events = State.Tick(DeltaTime, FWeaponStateCore::MaxShotsPerTick, ShotAges, NumShots);
+		TotalShots += NumShots;
+		NumTicks++;
+	}
+
+	TestEqual(TEXT("No shots while reloading"), TotalShots, 0);
+	TestTrue(FString::Printf(TEXT("Reload finished after %d ticks"), NumTicks), FMath::Abs(NumTicks * DeltaTime - Info.ReloadTime) <= DeltaTime + KINDA_SMALL_NUMBER);
+
+	State.FinishReload(Info.MaxRound);
+	TestFalse(TEXT("Reload flag cleared"), State.IsReloading());
+	TestEqual(TEXT("Magazine refilled"), State.Round, Info.MaxRound);
+	TestTrue(TEXT("Fires again after the reload"), HoldTrigger(State, 0.5f, DeltaTime) > 0);
+
+	//zero reload time finishes on the next tick
+	State.StartReload(0.0f);
+	Events = State.Tick(DeltaTime, FWeaponStateCore::MaxShotsPerTick, ShotAges, NumShots);
+	TestTrue(TEXT("Instant reload finishes on the next tick"), EnumHasAnyFlags(Events, EWeaponStateEvents::ReloadFinished));
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTopDownWeaponStateDispersionTest, "TopDown.WeaponState.Dispersion",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+//recoil grows dispersion up to the bound of the movement state, released it decays to the lower bound
+bool FTopDownWeaponStateDispersionTest::RunTest(const FString& Parameters)
+{
+	const FWeaponInfo Info = MakeTestWeaponInfo();
+	const FWeaponDispersion& Bounds = Info.DispersionWeapon;
+	const float DeltaTime = 1.0f / 60.0f;
+
+	float ShotAges[FWeaponStateCore::MaxShotsPerTick];
+	int32 NumShots = 0;
+
+	FWeaponStateCore State;
+	State.Init(Info, 1000);
+	State.SetMovementState(Bounds, EMovementState::Aim_State);
+	TestEqual(TEXT("Aim lower bound"), State.DispersionMin, Bounds.Aim_StateDispersionAimMin);
+	TestEqual(TEXT("Aim upper bound"), State.DispersionMax, Bounds.Aim_StateDispersionAimMax);
+
+	//growth: every shot adds the recoil, clamped by the next tick
+	State.Dispersion = State.DispersionMin;
+	State.SetFiring(true);
+	for (int32 TickIndex = 0; TickIndex < 30; TickIndex++)
+	{
+		State.Tick(DeltaTime, FWeaponStateCore::MaxShotsPerTick, ShotAges, NumShots);
+		const int32 NumFired = State.ConsumeRounds(NumShots);
+		for (int32 Shot = 0; Shot < NumFired; Shot++)
+			State.AddRecoil();
+
+		if (TickIndex == 0)
+			TestEqual(TEXT("First shot adds the recoil"), State.Dispersion, Bounds.Aim_StateDispersionAimMin + Bounds.Aim_StateDispersionAimRecoil);
+		TestTrue(TEXT("Dispersion stays above the lower bound while firing"), State.Dispersion >= State.DispersionMin);
+	}
+	State.Tick(DeltaTime, FWeaponStateCore::MaxShotsPerTick, ShotAges, NumShots);
+	TestEqual(TEXT("Recoil clamps at the upper bound"), State.Dispersion, Bounds.Aim_StateDispersionAimMax);
+
+	//decay: released and reducing, one reduction step per tick down to the lower bound
+	State.SetFiring(false);
+	State.SetReduceDispersion(true);
+	int32 NumTicks = 0;
+	EWeaponStateEvents Events = EWeaponStateEvents::None;
+	float Previous = State.Dispersion;
+	while (!EnumHasAnyFlags(Events, EWeaponStateEvents::Settled) && NumTicks < 1000)
+	{
+		Events = State.Tick(DeltaTime, FWeaponStateCore::MaxShotsPerTick, ShotAges, NumShots);
+		TestTrue(TEXT("Reduction step"), State.Dispersion >= Previous - State.DispersionReduction - KINDA_SMALL_NUMBER && State.Dispersion <= Previous);
+		Previous = State.Dispersion;
+		NumTicks++;
+	}
+	TestEqual(TEXT("Decays to the lower bound"), State.Dispersion, Bounds.Aim_StateDispersionAimMin);
+	TestTrue(FString::Printf(TEXT("Settled after %d ticks"), NumTicks), NumTicks >= FMath::CeilToInt((Bounds.Aim_StateDispersionAimMax - Bounds.Aim_StateDispersionAimMin) / Bounds.Aim_StateDispersionReduction));
+
+	//a wider movement state raises the lower bound right away, sprinting keeps the bounds
+	State.SetMovementState(Bounds, EMovementState::Run_State);
+	State.Tick(DeltaTime, FWeaponStateCore::MaxShotsPerTick, ShotAges, NumShots);
+	TestEqual(TEXT("Run lower bound"), State.Dispersion, Bounds.Run_StateDispersionAimMin);
+	State.SetMovementState(Bounds, EMovementState::Sprint_State);
+	TestEqual(TEXT("Sprint keeps the bounds"), State.DispersionMin, Bounds.Run_StateDispersionAimMin);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTopDownWeaponStateRulesTest, "TopDown.WeaponState.Rules",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+//TopDown.WeaponState.Benchmark gives the same numbers on every run, a changed rule has to update them here
+bool FTopDownWeaponStateRulesTest::RunTest(const FString& Parameters)
+{
+	struct FExpected
+	{
+		int32 NumWeapons;
+		int32 NumTicks;
+		int64 NumShots;
+		int64 NumReloads;
+		double DispersionSum;
+	};
+
+	static const FExpected Expected[] =
+	{
+		{ 16, 1200, 1575, 48, 67.0 },
+		//defaults of the console command
+		{ 1000, 10000, 686200, 22400, 3500.0 },
+	};
+
+	for (const FExpected& Run : Expected)
+	{
+		const FWeaponStateBenchmarkResult Result = FWeaponStateCore::RunBenchmark(Run.NumWeapons, Run.NumTicks);
+		const FString What = FString::Printf(TEXT("%d weapons x %d ticks"), Run.NumWeapons, Run.NumTicks);
+
+		TestEqual(What + TEXT(": shots"), Result.NumShots, Run.NumShots);
+		TestEqual(What + TEXT(": reloads"), Result.NumReloads, Run.NumReloads);
+		TestEqual(What + TEXT(": dispersion sum"), Result.DispersionSum, Run.DispersionSum, 0.01);
+	}
+
+	return true;
+}
+
+#endif //WITH_DEV_AUTOMATION_TESTS
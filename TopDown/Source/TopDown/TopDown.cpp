@@ -2,8 +2,55 @@
 
 #include "TopDown.h"
 #include "Modules/ModuleManager.h"
+#include "HAL/LowLevelMemStats.h"
+#include "FuncLibrary/TopDownAllocCounter.h"
+#include "FuncLibrary/TopDownDebugDraw.h"
 
-IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, TopDown, "TopDown" );
+class FTopDownModule : public FDefaultGameModuleImpl
+{
+public:
+	virtual void StartupModule() override
+	{
+#if TOPDOWN_ALLOC_COUNTING
+		//no world or gameplay thread allocates through GMalloc yet
+		TopDownAllocCounter::InstallIfRequested();
+#endif
+	}
+
+	virtual void ShutdownModule() override
+	{
+#if TOPDOWN_DEBUG_DRAW
+		TopDownDebugDraw::Shutdown();
+#endif
+#if TOPDOWN_ALLOC_COUNTING
+		TopDownAllocCounter::Uninstall();
+#endif
+	}
+};
+
+IMPLEMENT_PRIMARY_GAME_MODULE( FTopDownModule, TopDown, "TopDown" );
 
 DEFINE_LOG_CATEGORY(LogTopDown)
+DEFINE_LOG_CATEGORY(LogTopDownVerbose)
+
+UE_TRACE_CHANNEL_DEFINE(TopDownChannel)
+
+DECLARE_LLM_MEMORY_STAT(TEXT("TopDown"), STAT_TopDownSummaryLLM, STATGROUP_LLM);
+DECLARE_LLM_MEMORY_STAT(TEXT("TopDown"), STAT_TopDownLLM, STATGROUP_LLMFULL);
+DECLARE_LLM_MEMORY_STAT(TEXT("TopDown/WeaponDefinitions"), STAT_TopDown_WeaponDefinitionsLLM, STATGROUP_LLMFULL);
+DECLARE_LLM_MEMORY_STAT(TEXT("TopDown/Weapons"), STAT_TopDown_WeaponsLLM, STATGROUP_LLMFULL);
+DECLARE_LLM_MEMORY_STAT(TEXT("TopDown/Projectiles"), STAT_TopDown_ProjectilesLLM, STATGROUP_LLMFULL);
+DECLARE_LLM_MEMORY_STAT(TEXT("TopDown/ShellCasings"), STAT_TopDown_ShellCasingsLLM, STATGROUP_LLMFULL);
+DECLARE_LLM_MEMORY_STAT(TEXT("TopDown/Debris"), STAT_TopDown_DebrisLLM, STATGROUP_LLMFULL);
+DECLARE_LLM_MEMORY_STAT(TEXT("TopDown/Decals"), STAT_TopDown_DecalsLLM, STATGROUP_LLMFULL);
+DECLARE_LLM_MEMORY_STAT(TEXT("TopDown/FX"), STAT_TopDown_FXLLM, STATGROUP_LLMFULL);
+
+LLM_DEFINE_TAG(TopDown, NAME_None, NAME_None, GET_STATFNAME(STAT_TopDownLLM), GET_STATFNAME(STAT_TopDownSummaryLLM));
+LLM_DEFINE_TAG(TopDown_WeaponDefinitions, NAME_None, TEXT("TopDown"), GET_STATFNAME(STAT_TopDown_WeaponDefinitionsLLM), GET_STATFNAME(STAT_TopDownSummaryLLM));
+LLM_DEFINE_TAG(TopDown_Weapons, NAME_None, TEXT("TopDown"), GET_STATFNAME(STAT_TopDown_WeaponsLLM), GET_STATFNAME(STAT_TopDownSummaryLLM));
+LLM_DEFINE_TAG(TopDown_Projectiles, NAME_None, TEXT("TopDown"), GET_STATFNAME(STAT_TopDown_ProjectilesLLM), GET_STATFNAME(STAT_TopDownSummaryLLM));
+LLM_DEFINE_TAG(TopDown_ShellCasings, NAME_None, TEXT("TopDown"), GET_STATFNAME(STAT_TopDown_ShellCasingsLLM), GET_STATFNAME(STAT_TopDownSummaryLLM));
+LLM_DEFINE_TAG(TopDown_Debris, NAME_None, TEXT("TopDown"), GET_STATFNAME(STAT_TopDown_DebrisLLM), GET_STATFNAME(STAT_TopDownSummaryLLM));
+LLM_DEFINE_TAG(TopDown_Decals, NAME_None, TEXT("TopDown"), GET_STATFNAME(STAT_TopDown_DecalsLLM), GET_STATFNAME(STAT_TopDownSummaryLLM));
+LLM_DEFINE_TAG(TopDown_FX, NAME_None, TEXT("TopDown"), GET_STATFNAME(STAT_TopDown_FXLLM), GET_STATFNAME(STAT_TopDownSummaryLLM));
  
\ No newline at end of file
@@ -3,5 +3,40 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "HAL/LowLevelMemTracker.h"
+#include "Trace/Trace.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "ProfilingDebugging/CountersTrace.h"
 
 DECLARE_LOG_CATEGORY_EXTERN(LogTopDown, Log, All);
+
+//per shot/projectile/input logs, Verbose only ("log LogTopDownVerbose Verbose") and compiled out of Shipping
+#if UE_BUILD_SHIPPING
+DECLARE_LOG_CATEGORY_EXTERN(LogTopDownVerbose, Log, Warning);
+#else
+DECLARE_LOG_CATEGORY_EXTERN(LogTopDownVerbose, Log, All);
+#endif
+
+DECLARE_STATS_GROUP(TEXT("TopDown"), STATGROUP_TopDown, STATCAT_Advanced);
+
+//gameplay memory in -llm captures and "stat LLMFULL", TopDown sums them up in "stat LLM"
+LLM_DECLARE_TAG(TopDown);
+//registry definitions and their impact tables
+LLM_DECLARE_TAG(TopDown_WeaponDefinitions);
+LLM_DECLARE_TAG(TopDown_Weapons);
+//projectile actors and lightweight bullets
+LLM_DECLARE_TAG(TopDown_Projectiles);
+LLM_DECLARE_TAG(TopDown_ShellCasings);
+//dropped magazines
+LLM_DECLARE_TAG(TopDown_Debris);
+LLM_DECLARE_TAG(TopDown_Decals);
+LLM_DECLARE_TAG(TopDown_FX);
+
+//gameplay hot paths in Unreal Insights, record with -trace=cpu,TopDown
+UE_TRACE_CHANNEL_EXTERN(TopDownChannel);
+
+//CPU scope on the TopDown trace channel and cycle counter in "stat TopDown"
+#define TOPDOWN_SCOPE(Name) \
+	TRACE_CPUPROFILER_EVENT_SCOPE_ON_CHANNEL_STR(#Name, TopDownChannel); \
+	DECLARE_SCOPE_CYCLE_COUNTER(TEXT(#Name), STAT_TopDown_Scope_##Name, STATGROUP_TopDown)
@@ -2,13 +2,30 @@
 
 
 #include "WeaponDefault.h"
+#include "TopDown.h"
+#include "WeaponStateCore.h"
 #include "Kismet/GameplayStatics.h"
+#include "Subsystem/ProjectilePoolSubsystem.h"
+#include "Subsystem/BulletSimulationSubsystem.h"
+#include "Subsystem/HitScanSubsystem.h"
+#include "Subsystem/WeaponSimulationSubsystem.h"
+#include "Subsystem/TopDownFXSubsystem.h"
+#include "Subsystem/WeaponAudioSubsystem.h"
+#include "Subsystem/ShellCasingSubsystem.h"
+#include "FuncLibrary/TopDownAllocCounter.h"
+#include "FuncLibrary/TopDownDebugDraw.h"
+#include "Components/AudioComponent.h"
+
+static TAutoConsoleVariable<int32> CVarProjectilePoolPrewarm(
+	TEXT("TopDown.ProjectilePool.PrewarmCount"),
+	16,
+	TEXT("Projectiles spawned into the pool for each weapon projectile class on WeaponInit"));
 
 // Sets default values
 AWeaponDefault::AWeaponDefault()
 {
-	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
-	PrimaryActorTick.bCanEverTick = true;
+	// Fire, reload and dispersion are updated in UWeaponSimulationSubsystem
+	PrimaryActorTick.bCanEverTick = false;
 
 	SceneComponent = CreateDefaultSubobject<USceneComponent>(TEXT("Scene"));
 	RootComponent = SceneComponent;
@@ -35,107 +52,109 @@ void AWeaponDefault::BeginPlay()
 {
 	Super::BeginPlay();
 
+	DispersionSeed = FMath::Rand();
+
+	//registered before WeaponInit, the character pushes dispersion of its movement state first
+	WeaponSimulation = GetWorld()->GetSubsystem<UWeaponSimulationSubsystem>();
+	if (WeaponSimulation)
+		WeaponSimulationSlot = WeaponSimulation->RegisterWeapon(this);
 }
 
-// Called every frame
-void AWeaponDefault::Tick(float DeltaTime)
+void AWeaponDefault::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
-	Super::Tick(DeltaTime);
+	if (WeaponSimulation)
+		WeaponSimulation->UnregisterWeapon(WeaponSimulationSlot);
 
-	FireTick(DeltaTime);
-	ReloadTick(DeltaTime);
-	DispersionTick(DeltaTime);
-}
+	WeaponSimulation = nullptr;
+	WeaponSimulationSlot = INDEX_NONE;
 
-void AWeaponDefault::FireTick(float DeltaTime)
-{
-	if (GetWeaponRound() > 0)
+	if (LightweightProjectileType != INDEX_NONE)
 	{
-		if (WeaponFiring)
-		{
-			if (FireTimer < 0.f)
-			{
-				if (!WeaponReloading)
-				{
-					Fire();
+		if (UBulletSimulationSubsystem* BulletSimulation = GetWorld()->GetSubsystem<UBulletSimulationSubsystem>())
+			BulletSimulation->UnregisterProjectileType(LightweightProjectileType);
+		LightweightProjectileType = INDEX_NONE;
+	}
 
-					EffectShotTimer = 0.3f;
+	//the streamed assets of the definition are released with the last table
+	ProjectileImpactTable.Reset();
+	HitScanImpactTable.Reset();
 
-					if(WeaponFireEffectComponent)
-						WeaponFireEffectComponent->SetVisibility(true);
-				}
-			}
-			else
-			{
-				EffectShotTimer -= DeltaTime;
+	Super::EndPlay(EndPlayReason);
+}
 
-				if (EffectShotTimer <= 0.0f)
-				{
-					if(WeaponFireEffectComponent)
-						WeaponFireEffectComponent->SetVisibility(false);
-				}
+void AWeaponDefault::OnSimulatedShots(TArrayView<const float> ShotAges)
+{
+	//what used to be FireTick
+	TOPDOWN_SCOPE(WeaponFireTick);
 
-				FireTimer -= DeltaTime;
-			}
-		}
-		else
-		{
-			if(FireTimer > 0.0f)
-				FireTimer -= DeltaTime;
-		}
-	}
-	else
+	FWeaponStateCore* State = GetWeaponState();
+	if (!State)
+		return;
+
+	const int32 NumShots = State->ConsumeRounds(ShotAges.Num());
+	WeaponInfo.Round = State->Round;
+
+	if (NumShots > 0)
 	{
-		if (!WeaponReloading)
-		{
-			InitReload();
-		}
+		FireBatch(ShotAges.Left(NumShots));
+
+		//one burst for all shots of the tick
+		UTopDownFXSubsystem* FX = WeaponFireEffectComponent ? GetWorld()->GetSubsystem<UTopDownFXSubsystem>() : nullptr;
+		if (FX)
+			FX->TriggerBurst(WeaponFireEffectComponent);
 	}
+
+	//fetched again, the shots may have registered weapons. Don't wait for the next tick, an idle weapon may not tick
+	State = GetWeaponState();
+	if (State && State->NeedsReload())
+		InitReload();
 }
 
-void AWeaponDefault::ReloadTick(float DeltaTime)
+void AWeaponDefault::OnSimulatedEffectEnded()
 {
+	//looping flashes stop emitting, burst ones are already done
+	if(WeaponFireEffectComponent)
+		WeaponFireEffectComponent->Deactivate();
+}
+
+void AWeaponDefault::UpdateWeaponState()
+{
+	EWeaponState NewState = EWeaponState::Idle;
+
 	if (WeaponReloading)
+		NewState = EWeaponState::Reloading;
+	else if (WeaponFiring)
+		NewState = EWeaponState::Firing;
+	else if (GetWeaponState() && !GetWeaponState()->IsSettled())
+		NewState = EWeaponState::RecoveringDispersion;
+
+	WeaponState = NewState;
+
+	//idle weapons are skipped by the simulation
+	if (WeaponSimulation)
+		WeaponSimulation->SetActive(WeaponSimulationSlot, WeaponState != EWeaponState::Idle);
+
+	if (WeaponFireLoopComponent)
 	{
-		if (ReloadTimer < 0.0f)
-		{
-			FinishReload();
-		}
-		else
-		{
-			ReloadTimer -= DeltaTime;
-		}
+		if (UWeaponAudioSubsystem* Audio = GetWorld()->GetSubsystem<UWeaponAudioSubsystem>())
+			Audio->SetFireLoopPlaying(WeaponFireLoopComponent, WeaponState == EWeaponState::Firing);
 	}
 }
 
-void AWeaponDefault::DispersionTick(float DeltaTime)
+void AWeaponDefault::SetWeaponDefinition(UWeaponRegistry* Registry, FWeaponHandle Handle)
 {
-	if (!WeaponReloading)
-	{
-		if (!WeaponFiring)
-		{
-			if (ShouldReduceDispersion)
-				CurrentDispersion = CurrentDispersion - CurrentDispersionReduction;
-			else
-				CurrentDispersion = CurrentDispersion + CurrentDispersionReduction;
-		}
-
-		if (CurrentDispersion < CurrentDispersionMin)
-		{
+	WeaponRegistry = Registry;
+	WeaponHandle = Handle;
 
-			CurrentDispersion = CurrentDispersionMin;
+	const FWeaponDefinition* Definition = Registry ? Registry->FindDefinition(Handle) : nullptr;
+	ProjectileImpactTable = Definition ? Definition->ProjectileImpacts.Pin() : nullptr;
+	HitScanImpactTable = Definition ? Definition->HitScanImpacts.Pin() : nullptr;
+}
 
-		}
-		else
-		{
-			if (CurrentDispersion > CurrentDispersionMax)
-			{
-				CurrentDispersion = CurrentDispersionMax;
-			}
-		}
-	}
-	if (ShowDebug)
-		UE_LOG(LogTemp, Warning, TEXT("Dispersion: MAX = %f. MIN = %f. Current = %f"), CurrentDispersionMax, CurrentDispersionMin, CurrentDispersion);
+const FWeaponInfo* AWeaponDefault::GetWeaponSetting() const
+{
+	const FWeaponDefinition* Definition = WeaponRegistry ? WeaponRegistry->FindDefinition(WeaponHandle) : nullptr;
+	return Definition ? &Definition->Info : nullptr;
 }
 
 void AWeaponDefault::WeaponInit()
@@ -150,261 +169,294 @@ void AWeaponDefault::WeaponInit()
 		StaticMeshWeapon->DestroyComponent();
 	}*/
 
-	if (WeaponSetting.EffectFireWeapon)
+	const FWeaponInfo* WeaponSetting = GetWeaponSetting();
+	if (!WeaponSetting)
 	{
-		WeaponFireEffectComponent = UNiagaraFunctionLibrary::SpawnSystemAttached(WeaponSetting.EffectFireWeapon, ShootLocation, NAME_None, FVector(0.f, 0.f, 0.f), FRotator(0.f), EAttachLocation::Type::KeepRelativeOffset, false, true);
-		
-		SetWeaponStateFire(false);
+		UE_LOG(LogTopDown, Warning, TEXT("AWeaponDefault::WeaponInit - %s has no weapon definition"), *GetName());
+		return;
 	}
 
-}
+	if (WeaponSetting->EffectFireWeapon.Get())
+	{
+		if (UTopDownFXSubsystem* FX = GetWorld()->GetSubsystem<UTopDownFXSubsystem>())
+			WeaponFireEffectComponent = FX->CreateMuzzleFlash(WeaponSetting->EffectFireWeapon.Get(), ShootLocation);
 
-void AWeaponDefault::SetWeaponStateFire(bool bIsFire)
-{
-	if (CheckWeaponCanFire())
+		SetWeaponStateFire(false);
+	}
+
+	if (WeaponSetting->SoundFireLoop.Get() && !WeaponFireLoopComponent)
 	{
-		if (bIsFire)
-		{
-			if (this->WeaponReloading)
-				bIsFire = false;
-		}
+		if (UWeaponAudioSubsystem* Audio = GetWorld()->GetSubsystem<UWeaponAudioSubsystem>())
+			WeaponFireLoopComponent = Audio->CreateFireLoop(WeaponSetting->SoundFireLoop.Get(), ShootLocation);
+	}
+
+	if (FWeaponStateCore* State = GetWeaponState())
+		State->Init(*WeaponSetting, WeaponInfo.Round);
+
+	UpdateWeaponState();
 
-		WeaponFiring = bIsFire;
+	UBulletSimulationSubsystem* BulletSimulation = GetWorld()->GetSubsystem<UBulletSimulationSubsystem>();
+	if (BulletSimulation && LightweightProjectileType != INDEX_NONE)
+		BulletSimulation->UnregisterProjectileType(LightweightProjectileType);
+
+	LightweightProjectileType = INDEX_NONE;
+	if (WeaponSetting->ProjectileSetting.Projectile && UBulletSimulationSubsystem::ShouldUseLightweightSimulation(WeaponSetting->ProjectileSetting))
+	{
+		const FWeaponDefinition* Definition = WeaponRegistry->FindDefinition(WeaponHandle);
+		if (BulletSimulation)
+			LightweightProjectileType = BulletSimulation->RegisterProjectileType(Definition->Name, WeaponSetting->ProjectileSetting, ProjectileImpactTable);
 	}
-	else
+
+	if (WeaponSetting->ProjectileSetting.Projectile && LightweightProjectileType == INDEX_NONE)
 	{
-		WeaponFiring = false;
+		if (UProjectilePoolSubsystem* Pool = GetWorld()->GetSubsystem<UProjectilePoolSubsystem>())
+			Pool->PrewarmPool(WeaponSetting->ProjectileSetting.Projectile, CVarProjectilePoolPrewarm.GetValueOnGameThread());
 	}
+}
 
-	if (WeaponFireEffectComponent)
+void AWeaponDefault::SetWeaponStateFire(bool bIsFire)
+{
+	//blocked and reloading weapons keep the trigger released
+	FWeaponStateCore* State = GetWeaponState();
+	WeaponFiring = State ? State->SetFiring(bIsFire) : false;
+
+	if (WeaponFireEffectComponent && !WeaponFiring)
 	{
-		WeaponFireEffectComponent->SetVisibility(bIsFire);
+		WeaponFireEffectComponent->Deactivate();
 	}
+
+	UpdateWeaponState();
 }
 
 bool AWeaponDefault::CheckWeaponCanFire()
 {
-	return !BlockFire;
+	const FWeaponStateCore* State = GetWeaponState();
+	return State && !State->IsFireBlocked();
+}
+
+FWeaponStateCore* AWeaponDefault::GetWeaponState() const
+{
+	return WeaponSimulation ? WeaponSimulation->GetWeaponState(WeaponSimulationSlot) : nullptr;
 }
 
-FProjectileInfo AWeaponDefault::GetProjectile()
+const FProjectileInfo* AWeaponDefault::GetProjectile() const
 {
-	return WeaponSetting.ProjectileSetting;
+	const FWeaponInfo* WeaponSetting = GetWeaponSetting();
+	return WeaponSetting ? &WeaponSetting->ProjectileSetting : nullptr;
 }
 
-void AWeaponDefault::Fire()
+void AWeaponDefault::FireBatch(TArrayView<const float> ShotAges)
 {
-	FireTimer = WeaponSetting.RateOfFire;
-	WeaponInfo.Round = WeaponInfo.Round - 1;
+	TOPDOWN_ALLOC_SCOPE(FireBatch);
+
+	const FWeaponInfo* WeaponSetting = GetWeaponSetting();
+	if (!WeaponSetting)
+		return;
+
+	//one sound for all shots of the tick, the loop plays by itself while firing
+	UWeaponAudioSubsystem* Audio = WeaponFireLoopComponent ? nullptr : GetWorld()->GetSubsystem<UWeaponAudioSubsystem>();
+	if (Audio && WeaponSetting->SoundFireWeapon.Get())
+		Audio->PlaySoundAtLocation(WeaponSetting->SoundFireWeapon.Get(), ShootLocation->GetComponentLocation(), UWeaponAudioSubsystem::PriorityFire, this);
+
+	for (const float ShotAge : ShotAges)
+	{
+		Fire(ShotAge);
+	}
+}
+
+void AWeaponDefault::Fire(float ShotAge)
+{
+	TOPDOWN_SCOPE(WeaponFire);
+	TOPDOWN_ALLOC_SCOPE(Fire);
+
+	const FWeaponInfo* WeaponSetting = GetWeaponSetting();
+	if (!WeaponSetting)
+		return;
+
+	//rounds are taken by OnSimulatedShots
 	ChangeDispersionByShot();
 
-	if(WeaponSetting.SoundFireWeapon)
-		UGameplayStatics::SpawnSoundAtLocation(GetWorld(), WeaponSetting.SoundFireWeapon, ShootLocation->GetComponentLocation());
+	const FWeaponStateCore* State = GetWeaponState();
+	if (ShowDebug && State)
+		UE_LOG(LogTopDownVerbose, Verbose, TEXT("Dispersion: MAX = %f. MIN = %f. Current = %f"), State->DispersionMax, State->DispersionMin, State->Dispersion);
 
-	int8 NumberProjectile = GetNumberProjectileByShot();
+	int8 NumberProjectile = WeaponSetting->NumberProjectileByShot;
 
 	if (ShootLocation)
 	{
-		FVector SpawnLocation = ShootLocation->GetComponentLocation();
-		FRotator SpawnRotation = ShootLocation->GetComponentRotation();
-		FProjectileInfo ProjectileInfo;
-		ProjectileInfo = GetProjectile();
+		const FTransform ShootTransform = ShootLocation->GetComponentTransform();
+		const FVector SpawnLocation = ShootTransform.GetLocation();
+		FRotator SpawnRotation;
+		const FProjectileInfo& ProjectileInfo = WeaponSetting->ProjectileSetting;
 
-		FVector EndLocation;
-		for (int8 i = 0; i < NumberProjectile; i++)
-		{
-			EndLocation = GetFireEndLocation();
+		UBulletSimulationSubsystem* BulletSimulation = LightweightProjectileType != INDEX_NONE ? GetWorld()->GetSubsystem<UBulletSimulationSubsystem>() : nullptr;
 
-			FVector Dir = EndLocation - SpawnLocation;
-
-			Dir.Normalize();
+		//all pellets of the shot in one call, reproducible from the seed
+		TArray<FVector, TInlineAllocator<16>> PelletDirections;
+		PelletDirections.SetNumUninitialized(FMath::Max<int32>(NumberProjectile, 0));
+		UMyTypes::SampleDispersionCone(GetFireDirection(ShootTransform), GetCurrentDispersion() * PI / 180.f, UMyTypes::MakeShotSeed(DispersionSeed, ShotIndex++), PelletDirections);
 
+		for (const FVector& Dir : PelletDirections)
+		{
 			FMatrix myMatrix(Dir, FVector(0, 1, 0), FVector(0, 0, 1), FVector::ZeroVector);
 			SpawnRotation = myMatrix.Rotator();
 
-			if (ProjectileInfo.Projectile)
-			{
-				FActorSpawnParameters SpawnParams;
-				SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
-				SpawnParams.Owner = GetOwner();
-				SpawnParams.Instigator = GetInstigator();
+			//Direction Projectile Current fly
+			TOPDOWN_DEBUG_LINE(Weapons, GetWorld(), SpawnLocation, SpawnLocation + Dir * 20000.0f, FColor::Black, 5.f, 0.5f);
 
-				AProjectileDefault* myProjectile = Cast<AProjectileDefault>(GetWorld()->SpawnActor(ProjectileInfo.Projectile, &SpawnLocation, &SpawnRotation, SpawnParams));
-				if (myProjectile)
-				{
-					myProjectile->InitProjectile(WeaponSetting.ProjectileSetting);
-				}
+			const FVector ProjectileLocation = GetLateShotLocation(ProjectileInfo, SpawnLocation, Dir, ShotAge);
+
+			if (BulletSimulation)
+			{
+				BulletSimulation->AddBullet(LightweightProjectileType, ProjectileLocation, Dir * ProjectileInfo.ProjectileInitSpeed, this, GetInstigatorController());
 			}
-			else
+			else if (ProjectileInfo.Projectile)
 			{
-				ETraceTypeQuery TraceChannel = UEngineTypes::ConvertToTraceType(ECollisionChannel::ECC_PhysicsBody);
-				const TArray<AActor*> ActorsToIgnore;
-				FHitResult HitResult;
-				FVector EndHitScanLocation = ShootLocation->GetComponentLocation() + ShootLocation->GetForwardVector() * WeaponSetting.DistacneTrace;
-
-				if (UKismetSystemLibrary::LineTraceSingle(GetWorld(), ShootLocation->GetComponentLocation(), EndHitScanLocation, TraceChannel, false, ActorsToIgnore, EDrawDebugTrace::None, HitResult, true))
+				AProjectileDefault* myProjectile = nullptr;
+				if (UProjectilePoolSubsystem* Pool = GetWorld()->GetSubsystem<UProjectilePoolSubsystem>())
 				{
-					if (HitResult.GetActor() && HitResult.PhysMaterial.IsValid())
-					{
-						EPhysicalSurface mySurfacetype = UGameplayStatics::GetSurfaceType(HitResult);
-
-						if (WeaponSetting.HitScanDecals.Contains(mySurfacetype))
-						{
-							UMaterialInterface* myMaterial = WeaponSetting.HitScanDecals[mySurfacetype];
+					myProjectile = Pool->AcquireProjectile(ProjectileInfo.Projectile, FTransform(SpawnRotation, ProjectileLocation), GetOwner(), GetInstigator());
+				}
+				else
+				{
+					LLM_SCOPE_BYTAG(TopDown_Projectiles);
 
-							if (myMaterial && HitResult.GetActor())
-							{
-								UGameplayStatics::SpawnDecalAttached(myMaterial, FVector(20.0f), HitResult.GetComponent(), NAME_None, HitResult.ImpactPoint, HitResult.ImpactNormal.Rotation(), EAttachLocation::KeepWorldPosition, 10.0f);
-							}
-						}
+					FActorSpawnParameters SpawnParams;
+					SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+					SpawnParams.Owner = GetOwner();
+					SpawnParams.Instigator = GetInstigator();
 
-					}
+					myProjectile = Cast<AProjectileDefault>(GetWorld()->SpawnActor(ProjectileInfo.Projectile, &ProjectileLocation, &SpawnRotation, SpawnParams));
+				}
 
-					if(ShowDebug)
-						DrawDebugLine(GetWorld(), ShootLocation->GetComponentLocation(), EndHitScanLocation, FColor::Yellow, false, 5.f, (uint8)'\000', 0.5f);
+				if (myProjectile)
+				{
+					myProjectile->InitProjectile(ProjectileInfo, ProjectileImpactTable);
 				}
 			}
+			else
+			{
+				FVector EndHitScanLocation = SpawnLocation + ShootTransform.GetUnitAxis(EAxis::X) * WeaponSetting->DistacneTrace;
 
-			AWeaponDefault::BulletEffect();
+				//traced with the other shots of this frame, decal and damage come next frame
+				if (UHitScanSubsystem* HitScan = GetWorld()->GetSubsystem<UHitScanSubsystem>())
+					HitScan->RequestTrace(SpawnLocation, EndHitScanLocation, this);
+			}
 		}
+
+		BulletEffect();
 	}
 }
 
 void AWeaponDefault::BulletEffect()
 {
-	if (!StaticMeshWeapon || !ShellBulletLocation)
-		return;
-
-	FVector Location = ShellBulletLocation->GetComponentLocation();
-	FRotator Rotation = ShellBulletLocation->GetComponentRotation();
-
-	AStaticMeshActor* ShellBullet = GetWorld()->SpawnActor<AStaticMeshActor>(Location, Rotation);
+	TOPDOWN_SCOPE(WeaponBulletEffect);
+	TOPDOWN_ALLOC_SCOPE(BulletEffect);
 
-	if (ShellBullet)
-	{
-		auto MeshComponent = ShellBullet->GetStaticMeshComponent();
-
-		if (!MeshComponent)
-			return;
-
-		ShellBullet->SetLifeSpan(5.0f);
+	const FWeaponInfo* WeaponSetting = GetWeaponSetting();
+	if (!StaticMeshWeapon || !ShellBulletLocation || !WeaponSetting)
+		return;
 
-		MeshComponent->SetMobility(EComponentMobility::Movable);
-		MeshComponent->SetStaticMesh(WeaponSetting.ShellBullets);
-		MeshComponent->SetCollisionProfileName("Pawn");
-		MeshComponent->SetSimulatePhysics(true);
+	UShellCasingSubsystem* ShellCasings = GetWorld()->GetSubsystem<UShellCasingSubsystem>();
+	if (!ShellCasings)
+		return;
 
-		UPrimitiveComponent* PrimitiveComponent = ShellBullet->FindComponentByClass<UPrimitiveComponent>();
+	//same ejection direction the physics impulse used to give
+	const FVector EjectDirection = (GetActorRightVector() + GetActorForwardVector() + FVector(0.0f, 0.0f, 2.0f)).GetSafeNormal();
+	const FVector EjectVelocity = EjectDirection * FMath::FRandRange(200.0f, 260.0f) + FMath::VRand() * 20.0f;
 
-		if (PrimitiveComponent)
-		{
-			PrimitiveComponent->AddImpulse((GetActorRightVector() + GetActorForwardVector() + FVector(0.0f, 0.0f, 2.0f)) * 15.0f);
-		}
-	}
+	ShellCasings->EjectCasing(WeaponSetting->ShellBullets.Get(), ShellBulletLocation->GetComponentTransform(), EjectVelocity, GetAttachParentActor());
 }
 
 
 
 void AWeaponDefault::UpdateStateWeapon(EMovementState NewMovementState)
 {
-	//ToDo Dispersion
-	BlockFire = false;
-
-	switch (NewMovementState)
+	FWeaponStateCore* State = GetWeaponState();
+	const FWeaponInfo* WeaponSetting = GetWeaponSetting();
+	if (State && WeaponSetting)
 	{
-	case EMovementState::Aim_State:
-
-		CurrentDispersionMax = WeaponSetting.DispersionWeapon.Aim_StateDispersionAimMax;
-		CurrentDispersionMin = WeaponSetting.DispersionWeapon.Aim_StateDispersionAimMin;
-		CurrentDispersionRecoil = WeaponSetting.DispersionWeapon.Aim_StateDispersionAimRecoil;
-		CurrentDispersionReduction = WeaponSetting.DispersionWeapon.Aim_StateDispersionReduction;
-		break;
-	case EMovementState::AimWalk_State:
-
-		CurrentDispersionMax = WeaponSetting.DispersionWeapon.AimWalk_StateDispersionAimMax;
-		CurrentDispersionMin = WeaponSetting.DispersionWeapon.AimWalk_StateDispersionAimMin;
-		CurrentDispersionRecoil = WeaponSetting.DispersionWeapon.AimWalk_StateDispersionAimRecoil;
-		CurrentDispersionReduction = WeaponSetting.DispersionWeapon.Aim_StateDispersionReduction;
-		break;
-	case EMovementState::Walk_State:
-
-		CurrentDispersionMax = WeaponSetting.DispersionWeapon.Walk_StateDispersionAimMax;
-		CurrentDispersionMin = WeaponSetting.DispersionWeapon.Walk_StateDispersionAimMin;
-		CurrentDispersionRecoil = WeaponSetting.DispersionWeapon.Walk_StateDispersionAimRecoil;
-		CurrentDispersionReduction = WeaponSetting.DispersionWeapon.Aim_StateDispersionReduction;
-		break;
-	case EMovementState::Run_State:
-
-		CurrentDispersionMax = WeaponSetting.DispersionWeapon.Run_StateDispersionAimMax;
-		CurrentDispersionMin = WeaponSetting.DispersionWeapon.Run_StateDispersionAimMin;
-		CurrentDispersionRecoil = WeaponSetting.DispersionWeapon.Run_StateDispersionAimRecoil;
-		CurrentDispersionReduction = WeaponSetting.DispersionWeapon.Aim_StateDispersionReduction;
-		break;
-	case EMovementState::Sprint_State:
-		BlockFire = true;
-		SetWeaponStateFire(false);//set fire trigger to false
-		//Block Fire
-		break;
-	default:
-		break;
+		//sprinting blocks fire and keeps the bounds of the previous state
+		State->SetMovementState(WeaponSetting->DispersionWeapon, NewMovementState);
+		State->SetReduceDispersion(ShouldReduceDispersion);
 	}
+
+	if (WeaponFiring && !CheckWeaponCanFire())
+		SetWeaponStateFire(false);//set fire trigger to false
+
+	//new dispersion bounds to settle to
+	UpdateWeaponState();
 }
 
 void AWeaponDefault::ChangeDispersionByShot()
 {
-	CurrentDispersion = CurrentDispersion + CurrentDispersionRecoil;
+	if (FWeaponStateCore* State = GetWeaponState())
+		State->AddRecoil();
 }
 
 float AWeaponDefault::GetCurrentDispersion() const
 {
-	float Result = CurrentDispersion;
-	return Result;
+	const FWeaponStateCore* State = GetWeaponState();
+	return State ? State->Dispersion : 0.0f;
 }
 
-FVector AWeaponDefault::ApplyDispersionToShoot(FVector DirectionShoot) const
+FVector AWeaponDefault::GetFireDirection(const FTransform& ShootTransform) const
 {
-	return FMath::VRandCone(DirectionShoot, GetCurrentDispersion() * PI / 180.f);
+	const FVector ShootStart = ShootTransform.GetLocation();
+	const FVector ShootForward = ShootTransform.GetUnitAxis(EAxis::X);
+	FVector Direction = ShootForward;
+
+	FVector tmpV = (ShootStart - ShootEndLocation);
+	//UE_LOG(LogTemp, Warning, TEXT("Vector: X = %f. Y = %f. Size = %f"), tmpV.X, tmpV.Y, tmpV.Size());
+
+	if (tmpV.Size() > SizeVectorToChangeShootDirectionLogic)
+		Direction = -tmpV.GetSafeNormal();
+
+	TOPDOWN_DEBUG_CONE(Dispersion, GetWorld(), ShootStart, Direction, GetWeaponSetting() ? GetWeaponSetting()->DistacneTrace : 0.0f, GetCurrentDispersion() * PI / 180.f, 32, FColor::Emerald, .1f, 1.0f);
+	//direction weapon look
+	TOPDOWN_DEBUG_LINE(Weapons, GetWorld(), ShootStart, ShootStart + ShootForward * 500.0f, FColor::Cyan, 5.f, 0.5f);
+	//direction projectile must fly
+	TOPDOWN_DEBUG_LINE(Weapons, GetWorld(), ShootStart, ShootEndLocation, FColor::Red, 5.f, 0.5f);
+
+	return Direction;
 }
 
-FVector AWeaponDefault::GetFireEndLocation() const
+FVector AWeaponDefault::GetLateShotLocation(const FProjectileInfo& ProjectileInfo, const FVector& SpawnLocation, const FVector& Direction, float ShotAge) const
 {
-	bool bShootDirection = false;
-	FVector EndLocation = FVector(0.f);
+	const float Distance = ProjectileInfo.ProjectileInitSpeed * ShotAge;
+	if (Distance <= KINDA_SMALL_NUMBER || !ProjectileInfo.Projectile)
+		return SpawnLocation;
 
-	FVector tmpV = (ShootLocation->GetComponentLocation() - ShootEndLocation);
-	//UE_LOG(LogTemp, Warning, TEXT("Vector: X = %f. Y = %f. Size = %f"), tmpV.X, tmpV.Y, tmpV.Size());
+	//a late shot starts where it would be if fired on time
+	const FVector End = SpawnLocation + Direction * Distance;
 
-	if (tmpV.Size() > SizeVectorToChangeShootDirectionLogic)
-	{
-		EndLocation = ShootLocation->GetComponentLocation() + ApplyDispersionToShoot((ShootLocation->GetComponentLocation() - ShootEndLocation).GetSafeNormal()) * -20000.0f;
-		if (ShowDebug)
-			DrawDebugCone(GetWorld(), ShootLocation->GetComponentLocation(), -(ShootLocation->GetComponentLocation() - ShootEndLocation), WeaponSetting.DistacneTrace, GetCurrentDispersion() * PI / 180.f, GetCurrentDispersion() * PI / 180.f, 32, FColor::Emerald, false, .1f, (uint8)'\000', 1.0f);
-	}
-	else
-	{
-		EndLocation = ShootLocation->GetComponentLocation() + ApplyDispersionToShoot(ShootLocation->GetForwardVector()) * 20000.0f;
-		if (ShowDebug)
-			DrawDebugCone(GetWorld(), ShootLocation->GetComponentLocation(), ShootLocation->GetForwardVector(), WeaponSetting.DistacneTrace, GetCurrentDispersion() * PI / 180.f, GetCurrentDispersion() * PI / 180.f, 32, FColor::Emerald, false, .1f, (uint8)'\000', 1.0f);
-	}
+	const AProjectileDefault* ProjectileCDO = ProjectileInfo.Projectile->GetDefaultObject<AProjectileDefault>();
+	const USphereComponent* CollisionSphere = ProjectileCDO ? ProjectileCDO->BulletCollisionSphere : nullptr;
+	if (!CollisionSphere)
+		return End;
 
-	if (ShowDebug)
-	{
-		//direction weapon look
-		DrawDebugLine(GetWorld(), ShootLocation->GetComponentLocation(), ShootLocation->GetComponentLocation() + ShootLocation->GetForwardVector() * 500.0f, FColor::Cyan, false, 5.f, (uint8)'\000', 0.5f);
-		//direction projectile must fly
-		DrawDebugLine(GetWorld(), ShootLocation->GetComponentLocation(), ShootEndLocation, FColor::Red, false, 5.f, (uint8)'\000', 0.5f);
-		//Direction Projectile Current fly
-		DrawDebugLine(GetWorld(), ShootLocation->GetComponentLocation(), EndLocation, FColor::Black, false, 5.f, (uint8)'\000', 0.5f);
-
-		//DrawDebugSphere(GetWorld(), ShootLocation->GetComponentLocation() + ShootLocation->GetForwardVector()*SizeVectorToChangeShootDirectionLogic, 10.f, 8, FColor::Red, false, 4.0f);
-	}
+	//same shape and ignored actors as the flight, the projectile stops short of what it would have hit on the way
+	//and its first move reports the hit
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(LateShot), false, this);
+	QueryParams.AddIgnoredActor(GetAttachParentActor());
+
+	FHitResult Hit;
+	const bool bHit = GetWorld()->SweepSingleByChannel(Hit, SpawnLocation, End, FQuat::Identity, CollisionSphere->GetCollisionObjectType(),
+		FCollisionShape::MakeSphere(CollisionSphere->GetScaledSphereRadius()), QueryParams, FCollisionResponseParams(CollisionSphere->GetCollisionResponseToChannels()));
 
-	return EndLocation;
+	return bHit ? Hit.Location : End;
 }
 
 int8 AWeaponDefault::GetNumberProjectileByShot() const
 {
-	return WeaponSetting.NumberProjectileByShot;
+	const FWeaponInfo* WeaponSetting = GetWeaponSetting();
+	return WeaponSetting ? WeaponSetting->NumberProjectileByShot : 0;
+}
+
+float AWeaponDefault::GetReloadTimer() const
+{
+	const FWeaponStateCore* State = GetWeaponState();
+	return State ? State->ReloadTimer : 0.0f;
 }
 
 int32 AWeaponDefault::GetWeaponRound()
@@ -414,18 +466,34 @@ int32 AWeaponDefault::GetWeaponRound()
 
 void AWeaponDefault::InitReload()
 {
+	const FWeaponInfo* WeaponSetting = GetWeaponSetting();
+	if (!WeaponSetting)
+		return;
+
 	WeaponReloading = true;
 
-	ReloadTimer = WeaponSetting.ReloadTime;
+	//zero or negative time finishes on the next simulation tick like the old ReloadTick did
+	if (FWeaponStateCore* State = GetWeaponState())
+		State->StartReload(WeaponSetting->ReloadTime);
 
-	if (WeaponSetting.AnimCharReload)
-		OnWeaponReloadStart.Broadcast(WeaponSetting.AnimCharReload);
+	UpdateWeaponState();
+
+	if (WeaponSetting->AnimCharReload.Get())
+		OnWeaponReloadStart.Broadcast(WeaponSetting->AnimCharReload.Get());
 }
 
 void AWeaponDefault::FinishReload()
 {
+	const FWeaponInfo* WeaponSetting = GetWeaponSetting();
+
 	WeaponReloading = false;
-	WeaponInfo.Round = WeaponSetting.MaxRound;
+	if (WeaponSetting)
+		WeaponInfo.Round = WeaponSetting->MaxRound;
+
+	if (FWeaponStateCore* State = GetWeaponState())
+		State->FinishReload(WeaponInfo.Round);
+
+	UpdateWeaponState();
 
 	OnWeaponReloadEnd.Broadcast();
 }
@@ -8,6 +8,7 @@
 #include "Components/ArrowComponent.h"
 #include "FuncLibrary/MyTypes.h"
 #include "ProjectileDefault.h"
+#include "Game/WeaponRegistry.h"
 #include "Delegates/Delegate.h"
 #include "WeaponDefault.generated.h"
 
@@ -38,67 +39,88 @@ public:
 	class UArrowComponent* ShellBulletLocation = nullptr;
 
 
-	UPROPERTY()
-	FWeaponInfo WeaponSetting;
+	//definition of WeaponHandle, looked up in the registry on every use and never kept, a rebuilt registry moves it.
+	//nullptr before SetWeaponDefinition or if the registry no longer has the handle
+	const FWeaponInfo* GetWeaponSetting() const;
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Weapon Info")
 	FAddicionalWeaponInfo WeaponInfo;
 
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 public:
-	// Tick func
-	virtual void Tick(float DeltaTime) override;
+	//timers and dispersion are updated by UWeaponSimulationSubsystem, the actor doesn't tick
+	void OnSimulatedShots(TArrayView<const float> ShotAges);
+	void OnSimulatedEffectEnded();
+
+	//simulation slot is updated only while firing, reloading or while fire timer and dispersion are still settling
+	void UpdateWeaponState();
 
-	void FireTick(float DeltaTime);
-	void ReloadTick(float DeltaTime);
-	void DispersionTick(float DeltaTime);
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "State")
+	EWeaponState WeaponState = EWeaponState::Idle;
 
+	//before WeaponInit
+	void SetWeaponDefinition(UWeaponRegistry* Registry, FWeaponHandle Handle);
 	void WeaponInit();
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FireLogic")
 	bool WeaponFiring = false;
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ReloadLogic")
 	bool WeaponReloading = false;
-	float EffectShotTimer = 0.0f;
 
 	UFUNCTION(BlueprintCallable)
 	void SetWeaponStateFire(bool bIsFire);
 
 	bool CheckWeaponCanFire();
 
-	FProjectileInfo GetProjectile();
+	//nullptr without a weapon definition
+	const FProjectileInfo* GetProjectile() const;
 
-	void Fire();
+	void FireBatch(TArrayView<const float> ShotAges);
+	void Fire(float ShotAge = 0.0f);
 
 	void UpdateStateWeapon(EMovementState NewMovementState);
 	void ChangeDispersionByShot();
 	float GetCurrentDispersion() const;
-	FVector ApplyDispersionToShoot(FVector DirectionShoot)const;
 
-	FVector GetFireEndLocation()const;
+	//direction before dispersion, pellets are spread around it
+	FVector GetFireDirection(const FTransform& ShootTransform)const;
+	//where a projectile fired ShotAge seconds ago is now, clamped to the first blocking hit on the way
+	FVector GetLateShotLocation(const FProjectileInfo& ProjectileInfo, const FVector& SpawnLocation, const FVector& Direction, float ShotAge) const;
 	int8 GetNumberProjectileByShot() const;
 
-	//Timers
-	float FireTimer = 0.0f;
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ReloadLogic")
-	float ReloadTimer = 0.0f;
+	float GetReloadTimer() const;
 
-	//flags
-	bool BlockFire = false;
 	//Dispersion
 	bool ShouldReduceDispersion = false;
-	float CurrentDispersion = 0.0f;
-	float CurrentDispersionMax = 1.0f;
-	float CurrentDispersionMin = 0.1f;
-	float CurrentDispersionRecoil = 0.1f;
-	float CurrentDispersionReduction = 0.1f;
+
+	UPROPERTY()
+	class UWeaponSimulationSubsystem* WeaponSimulation = nullptr;
+	//slot in WeaponSimulation, INDEX_NONE outside of game worlds
+	int32 WeaponSimulationSlot = INDEX_NONE;
+	//fire, reload and dispersion rules of the slot, nullptr outside of game worlds. Not kept, registrations move it
+	struct FWeaponStateCore* GetWeaponState() const;
 
 	UNiagaraComponent* WeaponFireEffectComponent = nullptr;
+	//SoundFireLoop voice, nullptr without one or on a dedicated server
+	UAudioComponent* WeaponFireLoopComponent = nullptr;
+	UPROPERTY()
+	UWeaponRegistry* WeaponRegistry = nullptr;
+	FWeaponHandle WeaponHandle;
+	//shared with the definition, projectiles and traces of this weapon point to them. Keep the weapon assets resident until EndPlay
+	TSharedPtr<const FSurfaceImpactTable> ProjectileImpactTable;
+	TSharedPtr<const FSurfaceImpactTable> HitScanImpactTable;
+	//handle in UBulletSimulationSubsystem, INDEX_NONE if projectiles are actors
+	int32 LightweightProjectileType = INDEX_NONE;
 
 	FVector ShootEndLocation = FVector(0);
 
+	//pellets of a shot come from FRandomStream(MakeShotSeed(DispersionSeed, ShotIndex))
+	int32 DispersionSeed = 0;
+	uint32 ShotIndex = 0;
+
 	UFUNCTION(BlueprintCallable)
 	int32 GetWeaponRound();
 	void InitReload();
@@ -0,0 +1,267 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "WeaponStateCore.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "TopDown.h"
+
+static void RunWeaponStateBenchmark(const TArray<FString>& Args)
+{
+	const int32 NumWeapons = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 1000;
+	const int32 NumTicks = Args.Num() > 1 ? FMath::Max(FCString::Atoi(*Args[1]), 1) : 10000;
+
+	const FWeaponStateBenchmarkResult Result = FWeaponStateCore::RunBenchmark(NumWeapons, NumTicks);
+	const double NumSteps = double(NumWeapons) * NumTicks;
+
+	UE_LOG(LogTopDown, Display, TEXT("TopDown.WeaponState.Benchmark - %d weapons x %d ticks in %.3f ms, %.1f M ticks/s, %.2f ns/tick. Shots %lld, reloads %lld, dispersion sum %.4f"),
+		NumWeapons, NumTicks, Result.Seconds * 1000.0, Result.Seconds > 0.0 ? NumSteps / Result.Seconds / 1000000.0 : 0.0, Result.Seconds * 1000000000.0 / NumSteps, Result.NumShots, Result.NumReloads, Result.DispersionSum);
+}
+
+static FAutoConsoleCommand WeaponStateBenchmarkCommand(
+	TEXT("TopDown.WeaponState.Benchmark"),
+	TEXT("Step FWeaponStateCore without a world: TopDown.WeaponState.Benchmark [Weapons=1000] [Ticks=10000]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&RunWeaponStateBenchmark));
+
+//trigger held for two seconds and released for one, movement state changes every half a second, an empty magazine reloads
+FWeaponStateBenchmarkResult FWeaponStateCore::RunBenchmark(int32 NumWeapons, int32 NumTicks)
+{
+	const float DeltaTime = 1.0f / 60.0f;
+
+	static const EMovementState MovementStates[] = { EMovementState::Aim_State, EMovementState::AimWalk_State, EMovementState::Walk_State, EMovementState::Run_State, EMovementState::Sprint_State };
+
+	FWeaponInfo Info;
+	Info.RateOfFire = 0.1f;
+	Info.ReloadTime = 1.5f;
+	Info.MaxRound = 30;
+
+	TArray<FWeaponStateCore> States;
+	States.SetNum(NumWeapons);
+	for (int32 i = 0; i < NumWeapons; i++)
+	{
+		States[i].Init(Info, Info.MaxRound);
+		States[i].SetMovementState(Info.DispersionWeapon, MovementStates[i % 4]);
+	}
+
+	float ShotAges[FWeaponStateCore::MaxShotsPerTick];
+	FWeaponStateBenchmarkResult Result;
+
+	const double StartTime = FPlatformTime::Seconds();
+
+	for (int32 TickIndex = 0; TickIndex < NumTicks; TickIndex++)
+	{
+		const bool bTrigger = (TickIndex % 180) < 120;
+		const bool bChangeState = (TickIndex % 30) == 0;
+
+		for (int32 i = 0; i < NumWeapons; i++)
+		{
+			FWeaponStateCore& State = States[i];
+
+			if (bChangeState)
+			{
+				State.SetMovementState(Info.DispersionWeapon, MovementStates[(TickIndex / 30 + i) % UE_ARRAY_COUNT(MovementStates)]);
+				State.SetReduceDispersion((i & 1) != 0);
+			}
+			State.SetFiring(bTrigger);
+
+			int32 NumShots = 0;
+			const EWeaponStateEvents Events = State.Tick(DeltaTime, FWeaponStateCore::MaxShotsPerTick, ShotAges, NumShots);
+
+			if (EnumHasAnyFlags(Events, EWeaponStateEvents::ReloadFinished))
+				State.FinishReload(Info.MaxRound);
+
+			if (EnumHasAnyFlags(Events, EWeaponStateEvents::Shots))
+			{
+				const int32 NumFired = State.ConsumeRounds(NumShots);
+				for (int32 Shot = 0; Shot < NumFired; Shot++)
+				{
+					State.AddRecoil();
+				}
+				Result.NumShots += NumFired;
+
+				if (State.NeedsReload())
+				{
+					State.StartReload(Info.ReloadTime);
+					Result.NumReloads++;
+				}
+			}
+		}
+	}
+
+	Result.Seconds = FPlatformTime::Seconds() - StartTime;
+
+	//same numbers on every run and platform, a changed rule shows up here (TopDown.WeaponState.Rules test)
+	for (const FWeaponStateCore& State : States)
+	{
+		Result.DispersionSum += State.Dispersion;
+	}
+	return Result;
+}
+
+void FWeaponStateCore::Init(const FWeaponInfo& Info, int32 InRound)
+{
+	RateOfFire = FMath::Max(Info.RateOfFire, KINDA_SMALL_NUMBER);
+	Round = InRound;
+}
+
+void FWeaponStateCore::SetMovementState(const FWeaponDispersion& WeaponDispersion, EMovementState MovementState)
+{
+	Flags &= ~EWeaponStateFlags::FireBlocked;
+
+	float NewMax = 1.0f;
+	float NewMin = 0.1f;
+	float NewRecoil = 0.1f;
+	float NewReduction = 0.1f;
+
+	//ToDo Dispersion
+	switch (MovementState)
+	{
+	case EMovementState::Aim_State:
+		NewMax = WeaponDispersion.Aim_StateDispersionAimMax;
+		NewMin = WeaponDispersion.Aim_StateDispersionAimMin;
+		NewRecoil = WeaponDispersion.Aim_StateDispersionAimRecoil;
+		NewReduction = WeaponDispersion.Aim_StateDispersionReduction;
+		break;
+	case EMovementState::AimWalk_State:
+		NewMax = WeaponDispersion.AimWalk_StateDispersionAimMax;
+		NewMin = WeaponDispersion.AimWalk_StateDispersionAimMin;
+		NewRecoil = WeaponDispersion.AimWalk_StateDispersionAimRecoil;
+		NewReduction = WeaponDispersion.Aim_StateDispersionReduction;
+		break;
+	case EMovementState::Walk_State:
+		NewMax = WeaponDispersion.Walk_StateDispersionAimMax;
+		NewMin = WeaponDispersion.Walk_StateDispersionAimMin;
+		NewRecoil = WeaponDispersion.Walk_StateDispersionAimRecoil;
+		NewReduction = WeaponDispersion.Aim_StateDispersionReduction;
+		break;
+	case EMovementState::Run_State:
+		NewMax = WeaponDispersion.Run_StateDispersionAimMax;
+		NewMin = WeaponDispersion.Run_StateDispersionAimMin;
+		NewRecoil = WeaponDispersion.Run_StateDispersionAimRecoil;
+		NewReduction = WeaponDispersion.Aim_StateDispersionReduction;
+		break;
+	case EMovementState::Sprint_State:
+		Flags |= EWeaponStateFlags::FireBlocked;
+		Flags &= ~EWeaponStateFlags::Firing;
+		return;
+	default:
+		break;
+	}
+
+	DispersionMin = NewMin;
+	DispersionMax = NewMax;
+	DispersionRecoil = NewRecoil;
+	DispersionReduction = NewReduction;
+}
+
+bool FWeaponStateCore::SetFiring(bool bFiring)
+{
+	if (bFiring && !IsFireBlocked() && !IsReloading())
+		Flags |= EWeaponStateFlags::Firing;
+	else
+		Flags &= ~EWeaponStateFlags::Firing;
+
+	return IsFiring();
+}
+
+void FWeaponStateCore::SetReduceDispersion(bool bReduce)
+{
+	if (bReduce)
+		Flags |= EWeaponStateFlags::ReduceDispersion;
+	else
+		Flags &= ~EWeaponStateFlags::ReduceDispersion;
+}
+
+void FWeaponStateCore::StartReload(float ReloadTime)
+{
+	Flags |= EWeaponStateFlags::Reloading;
+	ReloadTimer = ReloadTime;
+}
+
+void FWeaponStateCore::FinishReload(int32 MaxRound)
+{
+	Flags &= ~EWeaponStateFlags::Reloading;
+	ReloadTimer = 0.0f;
+	Round = MaxRound;
+}
+
+int32 FWeaponStateCore::ConsumeRounds(int32 NumShots)
+{
+	const int32 NumFired = FMath::Clamp(NumShots, 0, FMath::Max(Round, 0));
+	Round -= NumFired;
+	return NumFired;
+}
+
+bool FWeaponStateCore::IsSettled() const
+{
+	if (FireTimer > 0.0f)
+		return false;
+
+	//not firing dispersion moves toward one of the bounds
+	if (EnumHasAnyFlags(Flags, EWeaponStateFlags::ReduceDispersion))
+		return Dispersion <= DispersionMin;
+
+	return Dispersion >= DispersionMax;
+}
+
+EWeaponStateEvents FWeaponStateCore::Tick(float DeltaTime, int32 MaxShots, float* OutShotAges, int32& OutNumShots)
+{
+	OutNumShots = 0;
+
+	const bool bFiring = IsFiring();
+	const bool bReloading = IsReloading();
+	EWeaponStateEvents Events = EWeaponStateEvents::None;
+
+	//an empty magazine keeps the fire timer frozen while reloading
+	if (bReloading)
+	{
+		ReloadTimer -= DeltaTime;
+		if (ReloadTimer <= 0.0f)
+			Events |= EWeaponStateEvents::ReloadFinished;
+	}
+	else if (bFiring)
+	{
+		FireTimer -= DeltaTime;
+
+		while (FireTimer <= 0.0f && OutNumShots < MaxShots)
+		{
+			//how long ago inside this tick the shot was due
+			OutShotAges[OutNumShots++] = FMath::Min(-FireTimer, DeltaTime);
+			FireTimer += RateOfFire;
+		}
+
+		if (OutNumShots > 0)
+		{
+			EffectTimer = EffectShotTime;
+			Events |= EWeaponStateEvents::Shots;
+		}
+		else if (EffectTimer > 0.0f)
+		{
+			EffectTimer -= DeltaTime;
+			if (EffectTimer <= 0.0f)
+				Events |= EWeaponStateEvents::EffectEnded;
+		}
+	}
+	else
+	{
+		//shots can't be saved up while the trigger is released
+		FireTimer = FMath::Max(FireTimer - DeltaTime, 0.0f);
+	}
+
+	if (!bReloading)
+	{
+		if (!bFiring)
+		{
+			if (EnumHasAnyFlags(Flags, EWeaponStateFlags::ReduceDispersion))
+				Dispersion -= DispersionReduction;
+			else
+				Dispersion += DispersionReduction;
+		}
+		Dispersion = FMath::Clamp(Dispersion, DispersionMin, FMath::Max(DispersionMin, DispersionMax));
+
+		if (!bFiring && IsSettled())
+			Events |= EWeaponStateEvents::Settled;
+	}
+
+	return Events;
+}
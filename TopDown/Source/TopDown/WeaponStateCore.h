@@ -0,0 +1,89 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "FuncLibrary/MyTypes.h"
+
+enum class EWeaponStateFlags : uint8
+{
+	None = 0,
+	Firing = 1 << 0,
+	Reloading = 1 << 1,
+	ReduceDispersion = 1 << 2,
+	//sprinting
+	FireBlocked = 1 << 3
+};
+ENUM_CLASS_FLAGS(EWeaponStateFlags);
+
+//what has to be handled after a tick
+enum class EWeaponStateEvents : uint8
+{
+	None = 0,
+	Shots = 1 << 0,
+	ReloadFinished = 1 << 1,
+	EffectEnded = 1 << 2,
+	Settled = 1 << 3
+};
+ENUM_CLASS_FLAGS(EWeaponStateEvents);
+
+//TopDown.WeaponState.Benchmark, the counts and the dispersion sum only depend on the rules, the time on the machine
+struct FWeaponStateBenchmarkResult
+{
+	int64 NumShots = 0;
+	int64 NumReloads = 0;
+	double DispersionSum = 0.0;
+	double Seconds = 0.0;
+};
+
+//Fire, reload and dispersion rules of one weapon as plain data, no UObjects, world or allocations.
+//UWeaponSimulationSubsystem keeps one per weapon slot and AWeaponDefault drives it, TopDown.WeaponState.Benchmark steps it on its own.
+//Same inputs give the same shots, so it can be replayed to check what a client fired
+struct FWeaponStateCore
+{
+	static constexpr int32 MaxShotsPerTick = 16;
+	//muzzle effect stays visible this long after a shot
+	static constexpr float EffectShotTime = 0.3f;
+
+	EWeaponStateFlags Flags = EWeaponStateFlags::None;
+	float RateOfFire = 0.5f;
+	//carries the remainder between ticks, so rate of fire doesn't depend on frame rate
+	float FireTimer = 0.0f;
+	float ReloadTimer = 0.0f;
+	float EffectTimer = 0.0f;
+	float Dispersion = 0.0f;
+	float DispersionMin = 0.1f;
+	float DispersionMax = 1.0f;
+	float DispersionRecoil = 0.1f;
+	float DispersionReduction = 0.1f;
+	int32 Round = 0;
+
+	void Init(const FWeaponInfo& Info, int32 InRound);
+
+	//dispersion bounds of the movement state, sprinting releases the trigger and keeps the bounds of the previous state
+	void SetMovementState(const FWeaponDispersion& WeaponDispersion, EMovementState MovementState);
+	//returns whether the trigger is pulled now, a blocked or reloading weapon doesn't fire
+	bool SetFiring(bool bFiring);
+	void SetReduceDispersion(bool bReduce);
+
+	//zero or negative time finishes on the next tick
+	void StartReload(float ReloadTime);
+	void FinishReload(int32 MaxRound);
+
+	//takes the rounds of up to NumShots shots, returns how many can be fired
+	int32 ConsumeRounds(int32 NumShots);
+	void AddRecoil() { Dispersion += DispersionRecoil; }
+
+	//advances the timers, ages of the shots due in this tick go to OutShotAges (MaxShots at most)
+	EWeaponStateEvents Tick(float DeltaTime, int32 MaxShots, float* OutShotAges, int32& OutNumShots);
+
+	bool IsFiring() const { return EnumHasAnyFlags(Flags, EWeaponStateFlags::Firing); }
+	bool IsReloading() const { return EnumHasAnyFlags(Flags, EWeaponStateFlags::Reloading); }
+	bool IsFireBlocked() const { return EnumHasAnyFlags(Flags, EWeaponStateFlags::FireBlocked); }
+	bool NeedsReload() const { return Round <= 0 && !IsReloading(); }
+	//fire timer ran out and dispersion reached its bound
+	bool IsSettled() const;
+
+	//steps weapons the way AWeaponDefault drives its slot
+	static FWeaponStateBenchmarkResult RunBenchmark(int32 NumWeapons, int32 NumTicks);
+};